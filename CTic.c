@@ -51,10 +51,41 @@ Copyright 2018 Peter VanDerWal
 			1 Tic == 1.318336 seconds : 1 Tic == 1024 milliT : 1 Tic == 21093376 clock cycles
 		clock runs approx 1.5 seconds slow per day  +/- accuracy of the 16Mhz clock
 		only *need* to do timehacks a few times per day to keep clock synced.	Doesn't hurt to sync more often
+		With Circus built with TIME_SYNC the EXT_TIME frames slew the clock and trim OCR1A for that
+		error and the crystal's, so a few per day keep nodes within a milliTic of each other
 /**/ 
 
 #include <Tic.h>
 
+#ifdef DO_DEBOUNCE
+static Debounce_Port debounced;		// the debounce port's pins, see CounterDebounce.h
+#endif
+
+#ifdef COUNTER_T1
+static volatile uint16_t T1Overflows;	// high half of the hardware count
+static uint32_t T1Copied;				// what the milliTic ISR last put in COUNTER_T1_COUNT
+
+ISR(TIMER1_OVF_vect){ // every 65536 edges on T1
+	T1Overflows++;
+}
+
+// the count so far, called with interrupts off
+static inline uint32_t counterT1() {
+	uint16_t low = TCNT1;
+	uint16_t high = T1Overflows;
+	if ((TIFR1 & (1 << TOV1)) && low < 0x8000) high++;	// wrapped, the overflow ISR hasn't run yet
+	return (uint32_t)high << 16 | low;
+}
+
+// COUNTER_T1_COUNT was stored since the last milliTic (Circus.c's COUNTER_32 registers), count on from there
+static inline void counterT1Load() {
+	uint32_t count = COUNTER_T1_COUNT;
+	TCNT1 = count;
+	T1Overflows = count >> 16;
+	TIFR1 = 1 << TOV1;		// an overflow still pending belongs to the old count
+}
+#endif
+
 void ticSetup() {
 #ifdef COUNTER_1_MODE 
 	pinMode(2, INPUT);
@@ -88,6 +119,17 @@ void ticSetup() {
 #ifdef COUNTER_4_PULLUP 
 	digitalWrite(5, HIGH);
 #endif
+#ifdef COUNTER_T1
+	pinMode(5, INPUT);
+#ifdef COUNTER_T1_PULLUP
+	digitalWrite(5, HIGH);
+#endif
+#endif
+#ifdef DO_DEBOUNCE
+	DEBOUNCE_DDR &= ~DEBOUNCE_MASK;
+	DEBOUNCE_OUT |= DEBOUNCE_PULLUPS;
+	debounced.state = DEBOUNCE_IN & DEBOUNCE_MASK;	// count edges from here on, not the pins' first level
+#endif
 
     cli();                      
 #ifdef MICROTIC
@@ -99,6 +141,13 @@ void ticSetup() {
     TCCR2B |= (1 << CS10);     // Set CS10 bit for no prescaler
     OCR2A = 80;  // no prescaller = 1 interupt every 81 cycles = 1 microT (~5 microseconds), microT * 256 = milliTic * 1024 = 1 Tic, 1.5 second error per day
     TIMSK2 |= (1 << OCIE2A);   // enable timer compare interrupt
+#elif defined(COUNTER_T1)
+	// Timer1 counts T1 edges, the miliTic interrupt comes from Timer2
+    TCCR2A = (1 << WGM21);     // CTC mode
+    TCCR2B = (1 << CS22) | (1 << CS20);	// prescaler 128
+    TCNT2  = 0;
+    OCR2A = (MILLITIC_RELOAD + 1) / 128 - 1;   // 160 * 128 cycles, the ISR makes up the rest
+    TIMSK2 |= (1 << OCIE2A);
 #else
 	// use miliTic interrupt, more accurate but lose microT()
     TCCR1A = 0;     // set entire TCCR1A register to 0                
@@ -108,6 +157,13 @@ void ticSetup() {
     TCCR1B |= (1 << CS10);     // Set CS10 bit for no prescaler
     OCR1A = 20598;  // no prescaller = 1 interupt every 20599 cycles = 1 mTic * 1024 = 1 Tic, 1.5 second error per day
     TIMSK1 |= (1 << OCIE1A);   // enable timer compare interrupt
+#endif
+#ifdef COUNTER_T1
+    TCCR1A = 0;
+    TCCR1B = COUNTER_T1 == FALLING ? (1 << CS12) | (1 << CS11) : (1 << CS12) | (1 << CS11) | (1 << CS10);	// clocked by T1
+    TCNT1  = 0;
+    T1Overflows = 0;
+    TIMSK1 = (1 << TOIE1);     // the only Timer1 interrupt, once per 65536 edges
 #endif
     sei();//enable interrupts  
 }
@@ -216,66 +272,45 @@ void delayMicroTics(uint16_t mTics) {
 ISR(TIMER2_COMPA_vect){ //timer2 interrupt ~197.5 kHz,  every 5 microseconds	
 	++microTic;
 	if (!microTic){
+#elif defined(COUNTER_T1)
+ISR(TIMER2_COMPA_vect){ //timer2 interrupt ~777 Hz, Timer1 is counting
+		static uint16_t t2Cycles;	// of the next milliTic, what the last one couldn't take first
 #else
 ISR(TIMER1_COMPA_vect){ //timer1 interrupt ~777 Hz, 	
 #endif
 
 		mTic++;  
 #ifdef DO_DEBOUNCE
-		if (!(mTicLo & DEBOUNCE_TIME )){ // default 64 mTic debounce
-			static uint8_t oldStatus
-			uint8_t newStat = (PIND & DEBOUNCE_MASK);
-			uint8_t difference = newStat ^ oldStatus ; //result of XOR will be zero unless a bit has changed
-			//byte newStat = digitalRead(WATER_METER);
-			if(difference) {
-#ifdef COUNTER_1_DEBOUNCE
-				if (difference &  DEBOUNCE1) {
-#if COUNTER_1_DEBOUNCE = 0
-					if (oldStatus &  DEBOUNCE1)) Counter1++;
-#elif COUNTER_1_DEBOUNCE = 1				
-					if (newStat &  DEBOUNCE1) Counter1++;
-#elif COUNTER_1_DEBOUNCE = 2
-					Counter1++;
-#endif
-				}
-#endif			
-#ifdef COUNTER_2_DEBOUNCE
-				if (difference &  DEBOUNCE2) {
-#if COUNTER_2_DEBOUNCE = 0
-					if (oldStatus &  DEBOUNCE2)) Counter2++;
-#elif COUNTER_2_DEBOUNCE = 1				
-					if (newStat &  DEBOUNCE2) Counter2++;
-#elif COUNTER_2_DEBOUNCE = 2
-					Counter2++;
+		if (!(mTicLo & DEBOUNCE_STEP)) { // 4 samples per DEBOUNCE_TIME, default every 16 mTic
+			uint8_t counted = debouncePort(&debounced, DEBOUNCE_IN & DEBOUNCE_MASK);
+			if (counted) {
+				counted = debounceEdges(&debounced, counted, DEBOUNCE_RISE_MASK, DEBOUNCE_FALL_MASK);
+#ifdef DEBOUNCE_COUNT_0
+				if (counted & 0x01) DEBOUNCE_COUNT_0++;
 #endif
-				}
+#ifdef DEBOUNCE_COUNT_1
+				if (counted & 0x02) DEBOUNCE_COUNT_1++;
 #endif
-#ifdef COUNTER_3_DEBOUNCE
-				if (difference &  DEBOUNCE3) {
-#if COUNTER_3_DEBOUNCE = 0
-					if (oldStatus &  DEBOUNCE3)) Counter3++;
-#elif COUNTER_3_DEBOUNCE = 1				
-					if (newStat &  DEBOUNCE3) Counter3++;
-#elif COUNTER_3_DEBOUNCE = 2
-					Counter3++;
-#endif
-				}
-#endif	
-#ifdef COUNTER_4_DEBOUNCE
-				if (difference &  DEBOUNCE4) {
-#if COUNTER_4_DEBOUNCE = 0
-					if (oldStatus &  DEBOUNCE4)) Counter4++;
-#elif COUNTER_4_DEBOUNCE = 1				
-					if (newStat &  DEBOUNCE4) Counter4++;
-#elif COUNTER_4_DEBOUNCE = 2
-					Counter4++;
+#ifdef DEBOUNCE_COUNT_2
+				if (counted & 0x04) DEBOUNCE_COUNT_2++;
 #endif
-				}
+#ifdef DEBOUNCE_COUNT_3
+				if (counted & 0x08) DEBOUNCE_COUNT_3++;
+#endif
+#ifdef DEBOUNCE_COUNT_4
+				if (counted & 0x10) DEBOUNCE_COUNT_4++;
+#endif
+#ifdef DEBOUNCE_COUNT_5
+				if (counted & 0x20) DEBOUNCE_COUNT_5++;
+#endif
+#ifdef DEBOUNCE_COUNT_6
+				if (counted & 0x40) DEBOUNCE_COUNT_6++;
+#endif
+#ifdef DEBOUNCE_COUNT_7
+				if (counted & 0x80) DEBOUNCE_COUNT_7++;
 #endif
-				oldStatus = newStat;
 			}
 		}
-	
 #endif	
 		if (!(mTic & 0x03ff)){
 			Tic++;
@@ -292,11 +327,21 @@ ISR(TIMER1_COMPA_vect){ //timer1 interrupt ~777 Hz,
 			TIC_MACRO
 #endif			
 		}
+#ifdef COUNTER_T1
+		if (COUNTER_T1_COUNT != T1Copied) counterT1Load();
+		T1Copied = COUNTER_T1_COUNT = counterT1();
+#endif
 #ifdef CIRCUS
-		if (deadTime) deadTime--;
+		circusMilliTic();
 #endif
 #ifdef MICROTIC
 	}
+#elif defined(COUNTER_T1)
+		t2Cycles += MILLITIC_RELOAD + 1;
+		OCR2A = (t2Cycles >> 7) - 1;
+		t2Cycles &= 0x7f;
+#else
+		OCR1A = MILLITIC_RELOAD;
 #endif
 }
 
@@ -30,11 +30,31 @@ Circus code takes care of creating these variables
  // Note: Debounce uses TIC timer to do a software debounce.
  
 #define DEBOUNCE_TIME #mTics    // should be a power of 2, i.e. 16, 32, 64, etc.
-								// defaults to 64 mTics
+								// defaults to 64 mTics, a pin has to hold a new level that long to count
 
 //if you want to enable a pullup resistor
 #define COUNTER_1_PULLUP   //ditto for counters 2,3, and/or 4						
 //This works with either MODE or DEBOUNCE
+
+// Up to 8 debounced counters on all pins of one port, instead of or as well as COUNTER_n_DEBOUNCE
+// edges are masks of the port's pins, a pin in both masks counts every change
+#define DEBOUNCE_RISE  0x24				// pins counted when they go high
+#define DEBOUNCE_FALL  0x04				// pins counted when they go low
+#define DEBOUNCE_PULLUPS 0x24			// pins with the internal pullup on
+#define DEBOUNCE_COUNT_2  CDA.uintD[5]	// where each pin in DEBOUNCE_RISE/FALL counts, pin 2 here
+#define DEBOUNCE_COUNT_5  CDA.uintD[4]	// any uint16_t, pins may share one
+#define DEBOUNCE_IN  PINC				// the port, defaults to PIND/PORTD/DDRD
+#define DEBOUNCE_OUT PORTC
+#define DEBOUNCE_DDR DDRC
+
+// Counting in hardware: edges on T1 (Arduino pin 5, PD5) clock Timer1, no interrupt per edge, so
+// turbine meters in the hundreds of kHz cost next to nothing.  Timer0 keeps millis()/micros() (Circus
+// needs them), so without MICROTIC the milliTic moves to Timer2, prescaler 128, as accurate as Timer1's.
+#define COUNTER_T1  RISING				// or FALLING
+#define COUNTER_T1_COUNT  _counter32	// uint32_t the count is copied to every milliTic, defaults to
+										// _counter32 (Circus.c built with COUNTER_32), a value stored
+										// there is loaded into Timer1 at the next milliTic
+#define COUNTER_T1_PULLUP
 */
 
 /* Naming Conventions
@@ -79,35 +99,95 @@ void timer4Function(void) __attribute__((weak));
 #endif
 #endif
 
+// COUNTER_n_DEBOUNCE are pins 2 - 5 of the debounce port with Countern as their count
 #ifdef COUNTER_1_DEBOUNCE
-#define DEBOUNCE1 2
+#define DEBOUNCE1 0x04
+#define DEBOUNCE_COUNT_2 Counter1
+#define DEBOUNCE_RISE1 (COUNTER_1_DEBOUNCE != 0 ? DEBOUNCE1 : 0)	// 0 = low, 1 = high, 2 = change
+#define DEBOUNCE_FALL1 (COUNTER_1_DEBOUNCE != 1 ? DEBOUNCE1 : 0)
 #else 
 #define DEBOUNCE1 0
+#define DEBOUNCE_RISE1 0
+#define DEBOUNCE_FALL1 0
 #endif
 #ifdef COUNTER_2_DEBOUNCE
-#define DEBOUNCE2 4
+#define DEBOUNCE2 0x08
+#define DEBOUNCE_COUNT_3 Counter2
+#define DEBOUNCE_RISE2 (COUNTER_2_DEBOUNCE != 0 ? DEBOUNCE2 : 0)
+#define DEBOUNCE_FALL2 (COUNTER_2_DEBOUNCE != 1 ? DEBOUNCE2 : 0)
 #else 
 #define DEBOUNCE2 0
+#define DEBOUNCE_RISE2 0
+#define DEBOUNCE_FALL2 0
 #endif
 #ifdef COUNTER_3_DEBOUNCE
-#define DEBOUNCE3 8
+#define DEBOUNCE3 0x10
+#define DEBOUNCE_COUNT_4 Counter3
+#define DEBOUNCE_RISE3 (COUNTER_3_DEBOUNCE != 0 ? DEBOUNCE3 : 0)
+#define DEBOUNCE_FALL3 (COUNTER_3_DEBOUNCE != 1 ? DEBOUNCE3 : 0)
 #else 
 #define DEBOUNCE3 0
+#define DEBOUNCE_RISE3 0
+#define DEBOUNCE_FALL3 0
 #endif
 #ifdef COUNTER_4_DEBOUNCE
-#define DEBOUNCE4 16
+#define DEBOUNCE4 0x20
+#define DEBOUNCE_COUNT_5 Counter4
+#define DEBOUNCE_RISE4 (COUNTER_4_DEBOUNCE != 0 ? DEBOUNCE4 : 0)
+#define DEBOUNCE_FALL4 (COUNTER_4_DEBOUNCE != 1 ? DEBOUNCE4 : 0)
 #else 
 #define DEBOUNCE4 0
+#define DEBOUNCE_RISE4 0
+#define DEBOUNCE_FALL4 0
+#endif
+
+#ifndef DEBOUNCE_RISE
+#define DEBOUNCE_RISE 0
+#endif
+#ifndef DEBOUNCE_FALL
+#define DEBOUNCE_FALL 0
+#endif
+#ifndef DEBOUNCE_PULLUPS
+#define DEBOUNCE_PULLUPS 0
+#endif
+#ifndef DEBOUNCE_IN
+#define DEBOUNCE_IN  PIND
+#define DEBOUNCE_OUT PORTD
+#define DEBOUNCE_DDR DDRD
 #endif
 
-#define DEBOUNCE_MASK DEBOUNCE1 + DEBOUNCE2 + DEBOUNCE3 + DEBOUNCE4
-#if DEBOUNCE_MASK > 1
+#define DEBOUNCE_RISE_MASK (DEBOUNCE_RISE | DEBOUNCE_RISE1 | DEBOUNCE_RISE2 | DEBOUNCE_RISE3 | DEBOUNCE_RISE4)
+#define DEBOUNCE_FALL_MASK (DEBOUNCE_FALL | DEBOUNCE_FALL1 | DEBOUNCE_FALL2 | DEBOUNCE_FALL3 | DEBOUNCE_FALL4)
+#define DEBOUNCE_MASK (DEBOUNCE_RISE_MASK | DEBOUNCE_FALL_MASK)
+#if DEBOUNCE_RISE || DEBOUNCE_FALL || DEBOUNCE1 || DEBOUNCE2 || DEBOUNCE3 || DEBOUNCE4
 #define DO_DEBOUNCE
+#include <CounterDebounce.h>
 #endif
 
 
 #ifndef DEBOUNCE_TIME
-#define DEBOUNCE_TIME 0x3f
+#define DEBOUNCE_TIME 64
+#endif
+#define DEBOUNCE_STEP (DEBOUNCE_TIME / DEBOUNCE_SAMPLES - 1)	// mTic mask, sample every DEBOUNCE_TIME / 4
+#if defined(DO_DEBOUNCE) && (DEBOUNCE_TIME < DEBOUNCE_SAMPLES || (DEBOUNCE_TIME & (DEBOUNCE_TIME - 1)))
+#error "DEBOUNCE_TIME is a power of 2, 4 or more"
+#endif
+
+#ifdef COUNTER_T1
+#ifdef COUNTER_4_DEBOUNCE
+#error "COUNTER_T1 counts pin 5 in hardware, COUNTER_4_DEBOUNCE can't have it too"
+#endif
+#ifndef COUNTER_T1_COUNT
+#define COUNTER_T1_COUNT _counter32
+#endif
+#endif
+
+// cycles of the next milliTic - 1, Circus.c's TIME_SYNC slews and trims the clock with it.  Timer2
+// (COUNTER_T1) counts in 128 cycles, the ISR carries what doesn't fit over to the next milliTic.
+#ifdef CIRCUS
+#define MILLITIC_RELOAD _milliTicReload
+#else
+#define MILLITIC_RELOAD 20598
 #endif
 
 #ifdef COUNTER_1_MODE 
@@ -135,4 +215,4 @@ void delayMicroTics(uint16_t);
 #endif
 
 
-#endif /* TICTIMER_H */
\ No newline at end of file
+#endif /* TICTIMER_H */
\ No newline at end of file
@@ -56,88 +56,460 @@ LICENSE:
 #endif
 
 #include <Circus.h>
+#include <CircusToken.h>
 
+// a line quiet for IDLE_BYTES byte times (by micros()) starts a new frame, as in Modbus RTU: frames run
+// back to back and a node finds the start of the next one after noise.  A byte may wait up to 2 byte
+// times for the RX ISR before the UART overruns, so 4 at least.  0 = DEADTIME milliTics instead
+#ifndef IDLE_BYTES
+#define IDLE_BYTES 4
+#endif
+#if IDLE_BYTES && IDLE_BYTES < 4
+#error "IDLE_BYTES has to outlast a late RX ISR, 4 at least"
+#endif
 #ifndef DEADTIME
 #define DEADTIME 5
 #endif
 
+// 1 = forward tokens addressed to other nodes as they arrive instead of waiting for the whole token
+#ifndef CUT_THROUGH
+#define CUT_THROUGH 0
+#endif
+
+// 1 = check and answer tokens inside the RX ISR as the 4th byte lands instead of waiting for yield(),
+// forwarding no longer depends on loop().  nodeControl() is still called from yield().
+#ifndef PROCESS_IN_ISR
+#define PROCESS_IN_ISR 0
+#endif
+
+// 1 = the RX ISR folds each byte into Crc as it arrives so the check is done when the 4th byte lands
+#ifndef CRC_INCREMENTAL
+#define CRC_INCREMENTAL 1
+#endif
+
+// 1 = keep the worst receive-to-forward time (last byte in to first byte out) in _maxForwardLatency
+#ifndef MEASURE_LATENCY
+#define MEASURE_LATENCY 0
+#endif
+#define LATENCY_STAMP() ((uint16_t)micros())
+// with MEASURE_LATENCY, keep the times of the last LATENCY_SAMPLES frames forwarded for EXT_LATENCY:
+// first byte to last byte in and last byte in to first byte out.  A power of 2, 0 = only the worst.
+#ifndef LATENCY_SAMPLES
+#define LATENCY_SAMPLES 0
+#endif
+#if LATENCY_SAMPLES && (!MEASURE_LATENCY || (LATENCY_SAMPLES & (LATENCY_SAMPLES - 1)) || LATENCY_SAMPLES > 128)
+#error "LATENCY_SAMPLES needs MEASURE_LATENCY and is a power of 2, 128 at most"
+#endif
+
+// 1 = count frames, crc and UART errors and resyncs for the diagnostics page the Ringmaster reads with
+// EXT_BLOCK frames (BLOCK_DIAG, see CircusToken.h), 12 bytes of RAM.  0 = UART errors go unnoticed
+#ifndef DIAGNOSTICS
+#define DIAGNOSTICS 1
+#endif
+
+// 1 = EXT_CONTROL read-modify-writes of a register: set bits, clear bits, add and compare-and-swap,
+// done with interrupts off so the ISRs' own updates can't come in between, see CircusToken.h
+#ifndef REGISTER_OPS
+#define REGISTER_OPS 1
+#endif
+
+// register pages, 0 = none.  The Ringmaster selects page 1 - PAGES with CTRL_PAGE, registers 1 - 6 of
+// tokens, block frames and gathers are then the sketch's PAGE_MAP entry for it (Circus.h) until it
+// selects page 0, the CDA, again.  Registers 0 and 7 are the same on every page.
+#ifndef PAGES
+#define PAGES 0
+#endif
+#if PAGES > 255
+#error "PAGES is selected with a byte, 255 at most"
+#endif
+
+// 1 = nodes fill empty EXT_REPORT frames with changes of the registers the Ringmaster watches
+#ifndef CHANGE_REPORTS
+#define CHANGE_REPORTS 1
+#endif
+
+// 1 = the Ringmaster may move the whole ring to another baud rate, CTRL_BAUD_CHECK/CTRL_BAUD
+#ifndef BAUD_SWITCH
+#define BAUD_SWITCH 1
+#endif
+
+
+// number of rings this node is on, ring n uses USARTn (ATmega2560: up to 4).  Every ring forwards its
+// own tokens on its own UART, all of them reach the same registers.
+#ifndef CIRCUS_RINGS
+#define CIRCUS_RINGS 1
+#endif
+
+// USART number of a sub-ring this node is the Ringmaster of, 0 = not a bridge.  EXT_BRIDGE frames
+// on ring 0 addressed to this node are passed on to the sub-ring as plain tokens, see CircusToken.h.
+// It can't be one of the node's own rings, e.g. CIRCUS_BRIDGE 1 with one ring on an ATmega2560.
+#ifndef CIRCUS_BRIDGE
+#define CIRCUS_BRIDGE 0
+#endif
+// milliTics the bridge waits for a reply from its sub-ring, a lap of 15 nodes at 9600 is about 55
+#ifndef BRIDGE_TIMEOUT
+#define BRIDGE_TIMEOUT 100
+#endif
+
+#if CIRCUS_BRIDGE && CIRCUS_BRIDGE < CIRCUS_RINGS
+#error "CIRCUS_BRIDGE has to be a USART that isn't one of the CIRCUS_RINGS"
+#endif
+#if CIRCUS_BRIDGE && (CUT_THROUGH || PROCESS_IN_ISR)
+#error "a bridge holds frames until its sub-ring answers, only Circus() can do that"
+#endif
 
-//#include "Uart.h"
+// USARTs in use, the rings plus the bridge's sub-ring
+#if CIRCUS_BRIDGE
+#define UART_COUNT (CIRCUS_BRIDGE + 1)
+#else
+#define UART_COUNT CIRCUS_RINGS
+#endif
 
 // =============================================== UART Definitions ===================================================
+#ifdef USART0_RX_vect		// ATmega2560 and friends number all their USARTs
+ #define UART0_RECEIVE_INTERRUPT   USART0_RX_vect
+ #define UART0_TRANSMIT_INTERRUPT  USART0_UDRE_vect
+#else
  #define UART0_RECEIVE_INTERRUPT   USART_RX_vect
  #define UART0_TRANSMIT_INTERRUPT  USART_UDRE_vect
- #define UART0_STATUS      UCSR0A
- #define UART0_CONTROL     UCSR0B
- #define UART0_CONTROLC    UCSR0C
- #define UART0_DATA        UDR0
- #define UART0_UDRIE       UDRIE0
- #define UART0_UBRRL       UBRR0L
- #define UART0_UBRRH       UBRR0H
- #define UART0_BIT_U2X     U2X0
- #define UART0_BIT_RXCIE   RXCIE0
- #define UART0_BIT_RXEN    RXEN0
- #define UART0_BIT_TXEN    TXEN0
- #define UART0_BIT_UCSZ0   UCSZ00
- #define UART0_BIT_UCSZ1   UCSZ01
-
-//UART
-
-
-/* Token structure:
-0x00:	Low byte of int data
-0x01:	High byte of int data
-0x02:	targetID, R/W, 3bit registerID
-0x03:	crc
-*/
-
-// pete Token is not exposed to user, rewrite without macros
-union {
+#endif
+
+#if UART_COUNT > 1 && !defined(UDR1)
+#error "CIRCUS_RINGS > 1 or a bridge needs a chip with more than one USART"
+#endif
+
+// register of the USART behind ring n.  n is a constant in the ISRs, so this folds to a plain register
+// access there; the bit positions are the same in every USART, the USART0 names are used for all of them.
+#if UART_COUNT > 3
+#define UART_REG(n, r0, r1, r2, r3)	(*((n) == 0 ? &r0 : (n) == 1 ? &r1 : (n) == 2 ? &r2 : &r3))
+#elif UART_COUNT > 2
+#define UART_REG(n, r0, r1, r2, r3)	(*((n) == 0 ? &r0 : (n) == 1 ? &r1 : &r2))
+#elif UART_COUNT > 1
+#define UART_REG(n, r0, r1, r2, r3)	(*((n) == 0 ? &r0 : &r1))
+#else
+#define UART_REG(n, r0, r1, r2, r3)	(r0)
+#endif
+#define UART_STATUS(n)		UART_REG(n, UCSR0A, UCSR1A, UCSR2A, UCSR3A)
+#define UART_CONTROL(n)		UART_REG(n, UCSR0B, UCSR1B, UCSR2B, UCSR3B)
+#define UART_CONTROLC(n)	UART_REG(n, UCSR0C, UCSR1C, UCSR2C, UCSR3C)
+#define UART_DATA(n)		UART_REG(n, UDR0, UDR1, UDR2, UDR3)
+#define UART_UBRRH(n)		UART_REG(n, UBRR0H, UBRR1H, UBRR2H, UBRR3H)
+#define UART_UBRRL(n)		UART_REG(n, UBRR0L, UBRR1L, UBRR2L, UBRR3L)
+
+
+// Token and extended token (frame) layouts are described in CircusToken.h
+
+// Every ring buffers up to TOKEN_FIFO tokens (or frames up to FRAME_MAX bytes) so the Ringmaster can keep several in flight.
+// Slots are used in order by three free running counters (only the low bits index fifo[]):
+//   rxHead    slot being received, rxIdx is the byte within it
+//   procTail  next received slot for Circus() to process
+//   txTail    slot being transmitted, txIdx is the byte within it
+// txTail <= procTail <= rxHead <= txTail + TOKEN_FIFO
+#ifndef TOKEN_FIFO
+#define TOKEN_FIFO 4		// must be a power of 2
+#endif
+#define FIFO_MASK (TOKEN_FIFO - 1)
+
+// CDA register with the low half of a 32 bit pulse counter, the next register holds the high half,
+// 0 = none.  The sketch counts into _counter32, see Circus.h.
+#ifndef COUNTER_32
+#define COUNTER_32 0
+#endif
+// CDA register for the pulses the 32 bit counter saw in the last Tic, 0 = none
+#ifndef COUNTER_RATE
+#define COUNTER_RATE 0
+#endif
+#if COUNTER_32 && (COUNTER_32 > 5 || COUNTER_RATE > 6 || COUNTER_RATE == COUNTER_32 || COUNTER_RATE == COUNTER_32 + 1)
+#error "COUNTER_32 takes two of the registers 1 - 6, COUNTER_RATE another one"
+#endif
+#if COUNTER_RATE && !COUNTER_32
+#error "COUNTER_RATE is the rate of the COUNTER_32 counter"
+#endif
+#if CIRCUS_BRIDGE && TOKEN_FIFO > 8
+#error "a bridge keeps one bit per fifo slot in Circus_Ring.waiting, TOKEN_FIFO can be 8 at most"
+#endif
+
+// 1 = keep the Tic clock on the Ringmaster's from EXT_TIME frames: the ring's delay is taken out,
+// the milliTic is lengthened or shortened to slew the clock instead of stepping it, and trimmed for
+// the drift seen between frames, see timeHack().  The sketch's milliTic timer has to reload with
+// _milliTicReload, as CTic.c and CircusNode.h do.
+#ifndef TIME_SYNC
+#define TIME_SYNC 1
+#endif
+// cycles a milliTic may be lengthened or shortened by to slew the clock, 640 = 1/32 of one,
+// so half a Tic takes about 16 seconds
+#ifndef TIME_SLEW
+#define TIME_SLEW 640
+#endif
+#if TIME_SYNC && TOKEN_FIFO > 8
+#error "TIME_SYNC keeps one bit per fifo slot in Circus_Ring.timeSlots, TOKEN_FIFO can be 8 at most"
+#endif
+#define MILLITIC_CYCLES 20599L	// Timer1 compare value + 1 at 16 MHz, see CTic.c
+#define TIC_U_PER_US 3258UL		// 1/65536 Tics per microsecond, times 65536
+#define TIME_TRIM_MAX 5273		// 1000 ppm of a milliTic, in 1/256 cycles
+#define TIME_DRIFT_MIN (1UL << 20)	// 16 Tics, frames closer together than this only slew
+
+// scheduled events a node can hold, 0 = none, the four daily timers in registers 1 - 4 run instead.
+// The Ringmaster adds and removes them with EXT_EVENT frames, yield() runs the sketch's circusEvent()
+// for the ones that are due, see Circus.h.
+#ifndef EVENTS
+#define EVENTS 0
+#endif
+#if EVENTS > 255
+#error "EVENTS is counted in a byte, 255 at most"
+#endif
+
+typedef union {
   uint16_t uIntData;
   int16_t intData;
-  uint8_t buffer[5];
-} volatile static Token;
-#define UartError Token.buffer[4] 	// allows a one byte overrun,
+  uint8_t buffer[FRAME_MAX];
+} Token_Slot;
 
-volatile uint8_t RxIdx;
+// everything one ring's token pipeline needs, one per UART
+typedef struct {
+	volatile Token_Slot fifo[TOKEN_FIFO];
+	volatile uint8_t len[TOKEN_FIFO];	// frame length of each slot, 4 for a plain token
+	volatile uint8_t rxLen;			// length of the frame being received, known once byte 2 is in
+	volatile uint8_t rxHead;
+	volatile uint8_t procTail;
+	volatile uint8_t txTail;
+	volatile uint8_t rxIdx;
+	volatile uint8_t txIdx;
+	volatile uint8_t rxDrop;		// fifo was full when the current token started, its bytes are discarded
+	volatile uint8_t crc;
+#if IDLE_BYTES
+	unsigned long rxAt;			// micros() as the last byte came in
+	uint32_t idleUs;			// IDLE_BYTES byte times at the UART's rate
+#else
+	volatile uint8_t deadtime;		// milliTics until a quiet line starts a new token, see circusMilliTic()
+#endif
+#if CRC_INCREMENTAL
+	volatile uint8_t rxCrc[TOKEN_FIFO];	// crc of the frame as received, compared with its last byte by processToken()
+#endif
+#if CUT_THROUGH
+	volatile uint8_t cutThrough;	// bytes of a passing token that may be forwarded, 0 = not cutting through
+#endif
+#if MEASURE_LATENCY
+	volatile uint16_t rxStamp[TOKEN_FIFO];
+#endif
+#if LATENCY_SAMPLES
+	uint16_t rxFirst;			// LATENCY_STAMP() as the first byte of the frame being received came in
+	volatile uint16_t rxSpan[TOKEN_FIFO];	// first byte to last byte in
+#endif
+#if CIRCUS_BRIDGE
+	uint8_t issueTail;			// next received slot for Circus() to process, procTail stops at waiting slots
+	uint8_t waiting;			// bit n set = slot n waits for the sub-ring, ring 0 only
+#endif
+#if BAUD_SWITCH
+	uint32_t baud;				// rate the UART runs at now
+	uint32_t newBaud;			// CTRL_BAUD, switch to this once the frame has left, 0 = none
+	uint8_t baudDrained;		// the fifo was empty and the transmitter idle at baudStamp
+	unsigned long baudStamp;
+#endif
+#if TIME_SYNC
+	uint16_t byteUs;			// microseconds per byte on the wire
+	volatile uint8_t timeSlots;	// bit n set = slot n is a good EXT_TIME frame, the TX ISR adds this node's delay
+	volatile unsigned long timeRx[TOKEN_FIFO];	// micros() as an EXT_TIME frame's last byte came in
+	volatile uint8_t txIdle;	// the TX ISR ran out of bytes at txIdleAt
+	volatile unsigned long txIdleAt;
+#endif
+	uint8_t uart;				// USART number
+} Circus_Ring;
+
+static Circus_Ring Rings[CIRCUS_RINGS];
+
+volatile uint16_t _tokenOverflows;	// tokens dropped because a fifo was full, all rings
 //volatile uint16_t * Tic;
+#define TARGET_QUEUE 8		// power of 2, holds a full block frame
+static volatile uint8_t Targets[TARGET_QUEUE];	// register accesses waiting for nodeControl(), called from yield()
+static volatile uint8_t TargetHead;
+static volatile uint8_t TargetTail;
+#if MEASURE_LATENCY
+volatile uint16_t _maxForwardLatency;	// microseconds, worst of all rings, write 0 to restart the measurement
+#endif
+#if DIAGNOSTICS
+static volatile uint16_t Diag[DIAG_LATENCY];	// the diagnostics page below DIAG_LATENCY, every ring, wrap
+#endif
+#if LATENCY_SAMPLES
+static volatile uint16_t LatencyRx[LATENCY_SAMPLES];	// first byte to last byte in, by the TX ISR of every ring
+static volatile uint16_t LatencyHold[LATENCY_SAMPLES];	// last byte in to first byte out
+static volatile uint16_t LatencyTaken;					// samples so far, the newest is at LatencyTaken - 1
+#endif
 
-volatile uint8_t _deadtime;
-static volatile uint8_t Crc;
-static volatile uint8_t TxCrc;
-static volatile uint8_t TxIdx;
+#if CHANGE_REPORTS
+static uint8_t Watch;				// bit n set = register n is watched, CTRL_WATCH
+static uint16_t Threshold[8];		// smallest change worth a report, CTRL_THRESHOLD
+static uint16_t Reported[8];		// value of each watched register the Ringmaster last saw
+static uint8_t ReportNext;			// round robin, a busy register can't take every report frame
+#endif
+
+#if COUNTER_32
+volatile uint32_t _counter32;		// pulses, counted by the sketch's ISRs
+static uint32_t CounterTicStart;	// _counter32 when this Tic started
+static uint16_t CounterMilliTics;	// into this Tic
+static uint8_t CounterLatched;		// a half was read or stored, the other one waits for its access
+#endif
+
+#if CIRCUS_BRIDGE
+// EXT_BRIDGE requests on their way round the sub-ring, oldest first.  Every one holds a ring 0 fifo
+// slot until its reply is in, so there are never more than TOKEN_FIFO of them.
+typedef struct {
+	uint8_t slot;				// ring 0 fifo slot of the EXT_BRIDGE frame
+	uint8_t token[4];			// as sent into the sub-ring
+} Bridge_Request;
+
+static Bridge_Request BridgeQueue[TOKEN_FIFO];
+static volatile uint8_t BridgeHead;		// next request to queue
+static volatile uint8_t BridgeSent;		// next request for the TX ISR, BridgeTxIdx is the byte within it
+static volatile uint8_t BridgeTxIdx;
+static uint8_t BridgeTail;				// oldest request without a reply
+static volatile uint8_t BridgeWait;		// milliTics left for the oldest request's reply
+static volatile uint8_t BridgeReply[TOKEN_FIFO][4];	// tokens back from the sub-ring
+static volatile uint8_t BridgeRxHead;
+static volatile uint8_t BridgeRxIdx;
+static volatile uint8_t BridgeRxDrop;
+#if IDLE_BYTES
+static unsigned long BridgeRxAt;
+static uint32_t BridgeIdleUs;			// the sub-ring runs at BAUD
+#else
+static volatile uint8_t BridgeDeadtime;
+#endif
+static uint8_t BridgeRxTail;
+#endif
+
+volatile uint16_t _milliTicReload = MILLITIC_CYCLES - 1;	// Timer1 compare value for the next milliTic
+#if TIME_SYNC
+static uint16_t SyncTic;			// Tic at the last milliTic
+static uint16_t SyncMilliTics;		// milliTics into the Tic
+static unsigned long SyncMicros;	// micros() at the last milliTic
+static int32_t SyncSlew;			// cycles still to add to the coming milliTics, negative = to take off
+static int16_t SyncTrim;			// cycles added to every milliTic for the crystal's drift, in 1/256 cycles
+static int16_t SyncFraction;		// 1/256 cycles of the trim not added yet, 0 - 255
+static uint32_t SyncLast;			// this node's time at the last EXT_TIME frame, in 1/65536 Tic
+static uint8_t SyncValid;			// SyncLast is set and the clock hasn't been stepped since
+#endif
+
+#if EVENTS
+typedef struct {
+	uint32_t due;		// day number << 16 | Tic
+	uint16_t period;	// EVENT_EVERY, Tics between runs, 0 = not recurring
+	uint8_t days;		// EVENT_DAYS, bit n = day numbers that are n mod 7, 0 = every Tics or once
+	uint8_t id;
+	uint8_t action;
+} Circus_Event;
+
+static Circus_Event Events[EVENTS];	// a min-heap on due, the next one is Events[0]
+static uint8_t EventCount;
+static uint16_t EventDay;		// day number, counts midnights from the one EVENT_DAY set
+static uint16_t EventDayTic;	// Tic the day number was last brought up to date at
+static uint16_t EventTic;		// Tic eventControl() last ran in
+#endif
+
+#if PAGES
+static uint8_t Page;		// CTRL_PAGE, registers 1 - 6 are PAGE_MAP[Page - 1], 0 = the CDA, every ring
+#endif
 
-const uint8_t CRCSEED=0x88;
+uint8_t _baudError;
+
+const uint8_t CRCSEED=TOKEN_CRC_SEED;
 
 Circus_Data_Array CDA;
 
-// Errors are returned by exclusive or-ing the error code with the register nibble changing target node to current node
-#define BUFFER_ERROR 0x0B
-#define CRC_ERROR 0x0C
-#define  UART_ERROR 0x0D
+/*************************************************************************
+Function: baudSetting()
+Purpose:  find UBRR and U2X for a baud rate, see CircusBaud.h
+Input:    baud rate, where to put UBRR and U2X
+Returns:  error in per mille, 255 if the UART can't get anywhere near it
+**************************************************************************/
+static uint8_t baudSetting(uint32_t baud, uint16_t *ubrr, uint8_t *u2x)
+{
+	uint32_t error;
+
+	if (!baud || baud > F_CPU / 8)
+		return 255;
+	// 1x has better noise immunity and less critical timing, only double the speed where it gets closer
+	*u2x = BAUD_U2X(F_CPU, baud);
+	*ubrr = *u2x ? BAUD_UBRR(F_CPU, baud, 8) : BAUD_UBRR(F_CPU, baud, 16);
+	if (*ubrr > 4095)
+		return 255;
+	error = BAUD_BEST_ERROR(F_CPU, baud);
+	return error > 254 ? 254 : error;
+}
+
+/*************************************************************************
+Function: uartBaud()
+Purpose:  program USART n for a baud rate, the line should be idle; a rate
+          the UART can't reach leaves it as it was, _baudError says 255
+**************************************************************************/
+static void uartBaud(uint8_t n, uint32_t baud)
+{
+	uint16_t ubrr = 0;
+	uint8_t u2x = 0;
+
+	_baudError = baudSetting(baud, &ubrr, &u2x);
+	if (_baudError == 255)
+		return;		// ubrr would be 0 (flat out) or too big for UBRRH, some arbitrary rate either way
+	UART_UBRRH(n) = (ubrr >> 8);
+	UART_UBRRL(n) = ubrr;
+	UART_STATUS(n) = u2x ? _BV(U2X0) : 0;
+}
+
+/*************************************************************************
+Function: uartStart()
+Purpose:  enable USART n's receiver, transmitter and receive interrupt, 8-N-1
+**************************************************************************/
+static void uartStart(uint8_t n)
+{
+	/* Enable USART receiver and transmitter and receive complete interrupt */
+	UART_CONTROL(n) = _BV(RXCIE0)|(1<<RXEN0)|(1<<TXEN0);
+
+	// Set frame format = 8-N-1
+	UART_CONTROLC(n) = 0x06;
+}
+
+/*************************************************************************
+Function: setBaud()
+Purpose:  program a ring's UART for a baud rate, the line should be idle
+**************************************************************************/
+static void setBaud(Circus_Ring *ring, uint32_t baud)
+{
+	uartBaud(ring->uart, baud);
+#if BAUD_SWITCH
+	ring->baud = baud;
+#endif
+#if IDLE_BYTES
+	ring->idleUs = IDLE_BYTES * 10000000UL / baud;
+#endif
+#if TIME_SYNC
+	ring->byteUs = 10000000UL / baud;
+#endif
+}
 
 /*************************************************************************
 Function: circus_init()
-Purpose:  initialize UART and set baudrate
-Input:    baudrate using macro UART_BAUD_SELECT()
+Purpose:  initialize the UART of every ring and set baudrate
+Input:    none, the rate is the sketch's BAUD
 Returns:  none
 **************************************************************************/
-//pete  Mixing and matching defined constants for UART, clean this up, maybe define myself?
 void circus_init()
 {   
-    uint16_t baudrate = F_CPU / (16 * BAUD)- 1 ;
-
-	UBRR0H  = (baudrate >> 8);
-	UBRR0L  = baudrate;
+	uint8_t n;
 
-	// not using 2x speed att, 1x better has better noise immunity less critical timing
-	UCSR0A = 0;	
-
-    /* Enable USART receiver and transmitter and receive complete interrupt */
-    UCSR0B = _BV(RXCIE0)|(1<<RXEN0)|(1<<TXEN0);
-
-	// Set frame format = 8-N-1
-	UCSR0C = 0x06;
+	for (n = 0; n < CIRCUS_RINGS; n++) {
+		Rings[n].uart = n;
+		setBaud(&Rings[n], BAUD);
+		uartStart(n);
+#if TIME_SYNC
+		Rings[n].txIdle = 1;
+#endif
+	}
+#if CIRCUS_BRIDGE
+	uartBaud(CIRCUS_BRIDGE, BAUD);		// the sub-ring stays at BAUD, CTRL_BAUD only moves ring 0
+#if IDLE_BYTES
+	BridgeIdleUs = IDLE_BYTES * 10000000UL / BAUD;
+#endif
+	uartStart(CIRCUS_BRIDGE);
+#endif
 	
 	if (DEBOUNCE_TIME) {
 		pinModeFast(DEBOUNCE_PIN, INPUT);
@@ -148,7 +520,976 @@ void circus_init()
 	
 }/* circus_init */
 
-void nodeControl(uint8_t target_Reg) { /* empty */ }
+void __attribute__ ((weak)) nodeControl(uint8_t target_Reg) { /* empty */ }
+
+/*************************************************************************
+Function: queueTarget()
+Purpose:  remember a register access for nodeControl(), called from yield()
+Input:    address/command byte of the access
+**************************************************************************/
+static void queueTarget(uint8_t target)
+{
+	if ((uint8_t)(TargetHead - TargetTail) < TARGET_QUEUE)
+		Targets[TargetHead++ & (TARGET_QUEUE - 1)] = target;
+}
+
+#if COUNTER_32
+/*************************************************************************
+Function: counterLatch()
+Purpose:  copy a count into the two counter registers
+**************************************************************************/
+static void counterLatch(uint32_t count)
+{
+	CDA.uintD[COUNTER_32] = count;
+	CDA.uintD[COUNTER_32 + 1] = count >> 16;
+}
+
+/*************************************************************************
+Function: counterAccess()
+Purpose:  keep the two halves of the 32 bit counter consistent, the low half
+          goes first: reading it latches the whole count, the high half
+          keeps that value until it has been read too; storing it loads the
+          counter from both halves, the high half stored before
+Input:    address/command byte of an access to one of the halves, data to store
+**************************************************************************/
+static void counterAccess(uint8_t target, uint16_t data)
+{
+	uint8_t low = (target & TOKEN_REG_MASK) == COUNTER_32;
+	uint8_t sreg = SREG;
+
+	cli();
+	if (!(target & TOKEN_STORE)) {
+		if (low)
+			counterLatch(_counter32);
+		CounterLatched = low;
+	} else if (low) {
+		_counter32 = (uint32_t)CDA.uintD[COUNTER_32 + 1] << 16 | data;
+		CounterTicStart = _counter32;
+		CounterLatched = 0;
+	} else {
+		CounterLatched = 1;
+	}
+	SREG = sreg;
+}
+
+/*************************************************************************
+Function: counterTic()
+Purpose:  at the end of every Tic, the rate and a fresh snapshot unless the
+          Ringmaster is between the two halves, called from circusMilliTic()
+**************************************************************************/
+static void counterTic(void)
+{
+	uint32_t count = _counter32;
+#if COUNTER_RATE
+	uint32_t rate = count - CounterTicStart;
+	CDA.uintD[COUNTER_RATE] = rate > 0xffff ? 0xffff : rate;
+#endif
+	CounterTicStart = count;
+	if (CounterLatched)
+		CounterLatched = 0;		// waited a Tic for the other half, that's long enough
+	else
+		counterLatch(count);
+}
+#endif
+
+#if PAGES
+/*************************************************************************
+Function: pageRegister()
+Purpose:  get or store register 1 - 6 of the selected page; stores to
+          PROGMEM and getter pages are dropped
+Input:    address/command byte, data to store
+Returns:  previous contents of the register
+**************************************************************************/
+static uint16_t pageRegister(uint8_t target, uint16_t data)
+{
+	const Circus_Page *page = &PAGE_MAP[Page - 1];
+	uint8_t reg = (target & TOKEN_REG_MASK) - 1;
+	uint8_t sreg;
+	uint16_t reply;
+
+	switch (page->kind) {
+	case PAGE_RAM:
+		sreg = SREG;
+		cli();		// the sketch's ISRs may update them
+		reply = page->at.ram[reg];
+		if (target & TOKEN_STORE)
+			page->at.ram[reg] = data;
+		SREG = sreg;
+		return reply;
+	case PAGE_PROGMEM:
+		return pgm_read_word(&page->at.progmem[reg]);
+	default:
+		return page->at.getter(Page, reg + 1);
+	}
+}
+#endif
+
+/*************************************************************************
+Function: accessRegister()
+Purpose:  get or store one register for a token or block frame
+Input:    address/command byte, data to store
+Returns:  previous contents of the register
+**************************************************************************/
+static uint16_t accessRegister(uint8_t target, uint16_t data)
+{
+	uint8_t reg = target & TOKEN_REG_MASK;
+	uint16_t reply;
+
+#if PAGES
+	if (Page && reg && reg < 7)
+		return pageRegister(target, data);		// not watched, nothing for nodeControl()
+#endif
+#if COUNTER_32
+	if (reg == COUNTER_32 || reg == COUNTER_32 + 1)
+		counterAccess(target, data);
+#endif
+	reply = CDA.uintD[reg]; //set reply to data at requested register
+	if ( target & TOKEN_STORE) { //if "store" data.  Note: Both Store or Get, returned value will be previous data at selected location
+		CDA.uintD[reg]=data;
+	}
+	if (!reg && (target & TOKEN_NID_MASK) == NID) {	// if reading or setting register[0]
+		CIRCUS_f_NEWSTAT = 0;   // clear NewStat flag since reply contains original value for register[0]
+	}
+#if CHANGE_REPORTS
+	Reported[reg] = (target & TOKEN_STORE) ? data : reply;	// the Ringmaster sees this value, nothing to report
+#endif
+	queueTarget(target);
+	return reply;
+}
+
+#if REGISTER_OPS
+/*************************************************************************
+Function: modifyRegister()
+Purpose:  one read-modify-write of a register for EXT_CONTROL, with
+          interrupts off from the read to the store
+Input:    CTRL_ code, address byte, parameter, the value CTRL_CAS expects
+Returns:  the previous value
+**************************************************************************/
+static uint16_t modifyRegister(uint8_t code, uint8_t target, uint16_t param, uint16_t expect)
+{
+	uint8_t reg = target & TOKEN_REG_MASK;
+	uint8_t sreg = SREG;
+	uint16_t previous, value;
+
+	cli();		// Tic and the debounce counter move in the milliTic ISR
+	previous = value = CDA.uintD[reg];
+	switch (code) {
+	case CTRL_SET_BITS:
+		value |= param;
+		break;
+	case CTRL_CLEAR_BITS:
+		value &= ~param;
+		break;
+	case CTRL_ADD:
+		value += param;
+		break;
+	case CTRL_CAS:
+		if (previous == expect)
+			value = param;
+		break;
+	}
+	CDA.uintD[reg] = value;
+	if (!reg && (target & TOKEN_NID_MASK) == NID)
+		CIRCUS_f_NEWSTAT = 0;	// the reply carries register[0], as for a get
+	SREG = sreg;
+#if CHANGE_REPORTS
+	Reported[reg] = value;
+#endif
+	queueTarget(target | TOKEN_STORE);	// reported as a store to the address the frame went to
+	return previous;
+}
+#endif
+
+/*************************************************************************
+Function: frameCrc()
+Purpose:  crc of every byte of a frame except the crc byte itself
+**************************************************************************/
+static uint8_t frameCrc(volatile uint8_t *frame, uint8_t len)
+{
+	uint8_t crc = CRCSEED;
+	uint8_t i;
+	for (i = 0; i < len - 1; i++)
+		crc = crc8(frame[i], crc);
+	return crc;
+}
+
+#if DIAGNOSTICS
+/*************************************************************************
+Function: diagRegister()
+Purpose:  get or store one register of the diagnostics page (DIAG_)
+Input:    address byte, value to store
+Returns:  the register before a store
+**************************************************************************/
+static uint16_t diagRegister(uint8_t addr, uint16_t value)
+{
+	volatile uint16_t *counter;
+	uint8_t sreg = SREG;
+	uint16_t previous;
+
+	switch (addr & TOKEN_REG_MASK) {
+	case DIAG_LATENCY:
+#if MEASURE_LATENCY
+		counter = &_maxForwardLatency;
+		break;
+#else
+		return 0;		// not measured
+#endif
+	case DIAG_OVERFLOWS:
+		counter = &_tokenOverflows;
+		break;
+	default:
+		counter = &Diag[addr & TOKEN_REG_MASK];
+		break;
+	}
+	cli();		// the ISRs count
+	previous = *counter;
+	if (addr & TOKEN_STORE)
+		*counter = value;
+	SREG = sreg;
+	return previous;
+}
+#endif
+
+/*************************************************************************
+Function: processGather()
+Purpose:  EXT_BLOCK get sent to NID 0, this node's value of the register
+          goes into its own slot, see CircusToken.h
+Returns:  1 if the frame was changed
+**************************************************************************/
+static uint8_t processGather(volatile uint8_t *frame)
+{
+	uint8_t slot = (NID >> 4) - ((frame[0] & BLOCK_HIGH) ? 9 : 1);	// wraps for nodes before the first slot
+	uint8_t addr = NID | (frame[1] & TOKEN_REG_MASK);
+	uint16_t reply;
+
+	if (slot >= (frame[0] & BLOCK_COUNT))
+		return 0;		// no slot for this node
+#if DIAGNOSTICS
+	if (frame[0] & BLOCK_DIAG)
+		reply = diagRegister(addr, 0);
+	else
+#endif
+		reply = accessRegister(addr, 0);
+	frame[3 + 2 * slot] = reply;
+	frame[4 + 2 * slot] = reply >> 8;
+	return 1;
+}
+
+/*************************************************************************
+Function: processBlock()
+Purpose:  EXT_BLOCK, get or store a run of registers, see CircusToken.h
+Returns:  1 if the frame was changed
+**************************************************************************/
+static uint8_t processBlock(volatile uint8_t *frame)
+{
+	uint8_t count = frame[0] & BLOCK_COUNT;
+	uint8_t target = frame[1];
+	uint8_t Tid = target & TOKEN_NID_MASK;
+	uint8_t acked = 0;
+	uint8_t i;
+
+#if !DIAGNOSTICS
+	if (frame[0] & BLOCK_DIAG)
+		return 0;		// no diagnostics page, comes back unchanged
+#endif
+	if (!Tid && !(target & TOKEN_STORE))
+		return processGather(frame);
+	if (Tid && Tid != NID)
+		return 0;		// not for this node
+	if (!Tid && (frame[0] & BLOCK_ACK)) {	// group store, members store and clear their bit
+		volatile uint8_t *members = &frame[3 + 2 * count + (NID >> 7)];
+		uint8_t bit = _BV((NID >> 4) & 7);
+		if (!(*members & bit))
+			return 0;		// not one of the group
+		*members &= ~bit;
+		acked = 1;
+	}
+	for (i = 0; i < count; i++) {
+		volatile uint8_t *data = &frame[3 + 2 * i];
+		uint8_t addr = (target & ~TOKEN_REG_MASK) | ((target + i) & TOKEN_REG_MASK);	// registers wrap after 7
+		uint16_t reply;
+#if DIAGNOSTICS
+		if (frame[0] & BLOCK_DIAG)
+			reply = diagRegister(addr, data[0] | data[1] << 8);
+		else
+#endif
+			reply = accessRegister(addr, data[0] | data[1] << 8);
+		if (Tid == NID) {
+			data[0] = reply;
+			data[1] = reply >> 8;
+		}
+	}
+	if (Tid != NID)
+		return acked;
+	if (frame[0] & BLOCK_DIAG)
+		frame[0] |= BLOCK_DONE;
+	return 1;
+}
+
+#if CHANGE_REPORTS
+/*************************************************************************
+Function: processReport()
+Purpose:  EXT_REPORT, put the first watched register that changed enough
+          into an empty report frame
+Returns:  1 if the frame was changed
+**************************************************************************/
+static uint8_t processReport(volatile uint8_t *frame)
+{
+	uint8_t i;
+
+	if (frame[3] || !Watch)
+		return 0;		// already carrying another node's report
+	for (i = 0; i < 8; i++) {
+		uint8_t reg = (ReportNext + i) & TOKEN_REG_MASK;
+		if (Watch & (1 << reg)) {
+			uint16_t value = CDA.uintD[reg];
+			uint16_t change = value - Reported[reg];
+			if ((int16_t)change < 0)
+				change = -change;
+			if (change && change >= Threshold[reg]) {
+				frame[0] = value;
+				frame[1] = value >> 8;
+				frame[3] = NID | reg;
+				Reported[reg] = value;
+				ReportNext = reg + 1;
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+#endif
+
+#if LATENCY_SAMPLES
+/*************************************************************************
+Function: processLatency()
+Purpose:  EXT_LATENCY, copy the newest forwarding times into the frame
+Returns:  1 if the frame was changed
+**************************************************************************/
+static uint8_t processLatency(volatile uint8_t *frame)
+{
+	uint8_t count = frame[0] & 0x7f;
+	uint8_t sreg = SREG;
+	uint16_t taken;
+	uint8_t i;
+
+	if ((frame[1] & TOKEN_NID_MASK) != NID || (frame[0] & LATENCY_DONE))
+		return 0;
+	cli();		// every ring's TX ISR adds samples
+	taken = LatencyTaken;
+	for (i = 0; i < count; i++) {
+		uint8_t k = (taken - 1 - i) & (LATENCY_SAMPLES - 1);
+		uint16_t rx = i < taken && i < LATENCY_SAMPLES ? LatencyRx[k] : 0;
+		uint16_t hold = i < taken && i < LATENCY_SAMPLES ? LatencyHold[k] : 0;
+		frame[5 + 4 * i] = rx;
+		frame[6 + 4 * i] = rx >> 8;
+		frame[7 + 4 * i] = hold;
+		frame[8 + 4 * i] = hold >> 8;
+	}
+	if (frame[1] & TOKEN_STORE) {
+		LatencyTaken = 0;
+		_maxForwardLatency = 0;
+	}
+	SREG = sreg;
+	frame[0] |= LATENCY_DONE;
+	frame[3] = taken;
+	frame[4] = taken >> 8;
+	return 1;
+}
+#endif
+
+/*************************************************************************
+Function: processControl()
+Purpose:  EXT_CONTROL, node settings that aren't registers
+Returns:  1 if the frame was changed
+**************************************************************************/
+static uint8_t processControl(Circus_Ring *ring, volatile uint8_t *frame)
+{
+	uint8_t Tid = frame[1] & TOKEN_NID_MASK;
+	uint8_t reg = frame[1] & TOKEN_REG_MASK;
+	uint16_t param = frame[3] | frame[4] << 8;
+	uint16_t reply;
+	uint8_t i;
+#if BAUD_SWITCH
+	uint16_t ubrr;
+	uint8_t u2x;
+#endif
+
+	if (Tid && Tid != NID)
+		return 0;
+	switch (frame[0]) {
+#if CHANGE_REPORTS
+	case CTRL_WATCH:
+		reply = Watch;
+		for (i = 0; i < 8; i++)
+			if ((param & ~Watch) & (1 << i))
+				Reported[i] = CDA.uintD[i];	// newly watched, report changes from now on
+		Watch = param;
+		break;
+	case CTRL_THRESHOLD:
+		reply = Threshold[reg];
+		Threshold[reg] = param;
+		break;
+#endif
+#if BAUD_SWITCH
+	case CTRL_BAUD_CHECK:
+		if (baudSetting(param * 100UL, &ubrr, &u2x) <= BAUD_MAX_ERROR)
+			return 0;
+		frame[3] = 0;	// can't, and neither can the ring
+		frame[4] = 0;
+		return 1;
+	case CTRL_BAUD:
+		if (baudSetting(param * 100UL, &ubrr, &u2x) > BAUD_MAX_ERROR)
+			return 0;	// the Ringmaster didn't check first, stay put
+		reply = ring->baud / 100;		// this ring's rate, every ring switches on its own
+		ring->newBaud = param * 100UL;
+		ring->baudDrained = 0;
+		break;
+#endif
+#if REGISTER_OPS
+	case CTRL_SET_BITS:
+	case CTRL_CLEAR_BITS:
+	case CTRL_ADD:
+	case CTRL_CAS:
+#if COUNTER_32
+		if (reg == COUNTER_32 || reg == COUNTER_32 + 1)
+			return 0;		// the halves are latched, gets and stores only
+#endif
+#if PAGES
+		if (Page && reg && reg < 7)
+			return 0;		// pages are gets and stores only
+#endif
+		reply = modifyRegister(frame[0], frame[1], param, frame[0] == CTRL_CAS ? frame[5] | frame[6] << 8 : 0);
+		if (Tid == NID)
+			frame[0] |= CTRL_DONE;
+		break;
+#endif
+#if PAGES
+	case CTRL_PAGE:
+		if (param > PAGES)
+			return 0;		// no such page, comes back without CTRL_DONE
+		reply = Page;
+		Page = param;
+		if (Tid == NID)
+			frame[0] |= CTRL_DONE;
+		break;
+#endif
+	default:
+		return 0;		// not supported by this node, comes back unchanged
+	}
+	if (Tid != NID)
+		return 0;		// broadcast, forwarded as it came
+	frame[3] = reply;
+	frame[4] = reply >> 8;
+	return 1;
+}
+
+#if CIRCUS_BRIDGE
+/*************************************************************************
+Function: processBridge()
+Purpose:  EXT_BRIDGE, send the token it carries into the sub-ring and hold
+          the frame until bridgeDrain() has the reply
+Input:    ring, fifo slot number, frame
+Returns:  0, the frame is changed later
+**************************************************************************/
+static uint8_t processBridge(Circus_Ring *ring, uint8_t slot, volatile uint8_t *frame)
+{
+	Bridge_Request *request;
+
+	if ((frame[1] & TOKEN_NID_MASK) != NID || frame[5] != BRIDGE_PENDING || ring != &Rings[0])
+		return 0;
+	request = &BridgeQueue[BridgeHead & FIFO_MASK];
+	request->slot = slot;
+	request->token[0] = frame[3];
+	request->token[1] = frame[4];
+	request->token[2] = frame[0];
+	request->token[3] = crc8(frame[0], crc8(frame[4], crc8(frame[3], CRCSEED)));
+	if (BridgeHead == BridgeTail)
+		BridgeWait = BRIDGE_TIMEOUT;
+	ring->waiting |= _BV(slot & FIFO_MASK);
+	BridgeHead++;
+	UART_CONTROL(CIRCUS_BRIDGE) |= _BV(UDRIE0);
+	return 0;
+}
+
+/*************************************************************************
+Function: bridgeAnswer()
+Purpose:  put the sub-ring's reply (or what became of it) into the oldest
+          request's frame and let ring 0 forward it
+Input:    BRIDGE_ status, reply token or 0
+**************************************************************************/
+static void bridgeAnswer(uint8_t status, volatile uint8_t *reply)
+{
+	Bridge_Request *request = &BridgeQueue[BridgeTail++ & FIFO_MASK];
+	volatile uint8_t *frame = Rings[0].fifo[request->slot & FIFO_MASK].buffer;
+
+	if (reply) {
+		frame[0] = reply[2];
+		frame[3] = reply[0];
+		frame[4] = reply[1];
+	}
+	frame[5] = status;
+	frame[6] = frameCrc(frame, 7);
+	Rings[0].waiting &= ~_BV(request->slot & FIFO_MASK);
+	BridgeWait = BRIDGE_TIMEOUT;		// for the next one
+}
+
+/*************************************************************************
+Function: bridgeDrain()
+Purpose:  match the tokens back from the sub-ring to the requests, the
+          sub-ring keeps order just like any other
+**************************************************************************/
+static void bridgeDrain(void)
+{
+	while (BridgeRxTail != BridgeRxHead) {
+		volatile uint8_t *reply = BridgeReply[BridgeRxTail & FIFO_MASK];
+		uint8_t i;
+
+		if (BridgeTail == BridgeSent) {
+			// nothing is waiting for it, late after BRIDGE_LOST
+		} else if (frameCrc(reply, 4) != reply[3]) {
+			bridgeAnswer(BRIDGE_DAMAGED, 0);
+		} else {
+			for (i = BridgeTail; i != BridgeSent; i++)
+				if (BridgeQueue[i & FIFO_MASK].token[2] == reply[2])
+					break;
+			if (i == BridgeSent) {
+				bridgeAnswer(BRIDGE_ERROR, reply);	// a node changed the address byte, only the oldest can be it
+			} else {
+				while (BridgeTail != i)				// everything sent before it is gone
+					bridgeAnswer(BRIDGE_LOST, 0);
+				bridgeAnswer(BRIDGE_OK, reply);
+			}
+		}
+		BridgeRxTail++;
+	}
+	if (BridgeTail != BridgeSent && !BridgeWait)
+		bridgeAnswer(BRIDGE_LOST, 0);
+}
+#endif
+
+#if TIME_SYNC
+/*************************************************************************
+Function: timeHack()
+Purpose:  EXT_TIME, compare the Ringmaster's time with this node's clock:
+          step whole Tics, slew the rest and trim the milliTic by the
+          drift since the last frame; the TX ISR adds this node's delay
+Input:    ring, fifo slot number, frame
+**************************************************************************/
+static void timeHack(Circus_Ring *ring, uint8_t slot, volatile uint8_t *frame)
+{
+	uint16_t tic = frame[3] | frame[4] << 8;
+	uint16_t part = frame[0] | frame[1] << 8;
+	uint16_t delay = frame[5] | frame[6] << 8;
+	uint32_t master = (uint32_t)tic << 16 | part;
+	unsigned long start = ring->timeRx[slot & FIFO_MASK] - (unsigned long)TIME_LEN * ring->byteUs;
+	long since;
+	uint32_t local;
+	int32_t offset;
+	uint8_t sreg = SREG;
+
+	cli();
+	ring->timeSlots |= _BV(slot & FIFO_MASK);	// the TX ISR clears the other slots' bits
+	since = SyncMicros - start;		// the frame's first byte started in before the last milliTic by this much
+	local = (uint32_t)Tic << 16 | (uint32_t)SyncMilliTics << 6;
+	SREG = sreg;
+	if (since > 500000L)
+		return;			// waited half a second for loop(), too stale to go by
+	local -= since * (long)TIC_U_PER_US >> 16;
+	master += (uint32_t)delay * (TIME_DELAY_US * TIC_U_PER_US) >> 16;
+	offset = master - local;
+
+	if (offset >= 32768L || offset < -32768L) {	// more than half a Tic off, step whole Tics
+		int16_t tics = (offset + 32768L) >> 16;
+		cli();
+		Tic += tics;
+		SyncTic += tics;
+		SREG = sreg;
+		offset -= (int32_t)tics << 16;
+		local += (int32_t)tics << 16;
+		SyncValid = 0;		// the drift since the last frame is lost in the step
+	} else if (SyncValid && local - SyncLast >= TIME_DRIFT_MIN) {
+		// what the slew hasn't done yet isn't drift, the rest built up since the last frame
+		int32_t drift = offset + SyncSlew / MILLITIC_CYCLES * 64 + SyncSlew % MILLITIC_CYCLES * 64 / MILLITIC_CYCLES;
+		int32_t trim = SyncTrim - drift * (MILLITIC_CYCLES * 256 >> 10) / (int32_t)((local - SyncLast) >> 10);
+		if (trim > TIME_TRIM_MAX) trim = TIME_TRIM_MAX;
+		if (trim < -TIME_TRIM_MAX) trim = -TIME_TRIM_MAX;
+		cli();
+		SyncTrim = trim;
+		SREG = sreg;
+	}
+	SyncLast = local;
+	SyncValid = 1;
+	cli();
+	SyncSlew = -(offset * MILLITIC_CYCLES >> 6);	// cycles, a milliTic is 64/65536 Tic
+	SREG = sreg;
+}
+
+/*************************************************************************
+Function: timeMilliTic()
+Purpose:  count the milliTics into the Tic and set the length of the next
+          one: the trim plus as much of the slew as one milliTic may take,
+          called from circusMilliTic()
+**************************************************************************/
+static void timeMilliTic(void)
+{
+	int16_t step = TIME_SLEW;
+
+	// only the sketch's own count starts a Tic, a Tic set at boot or by the master keeps the phase
+	if (Tic == (uint16_t)(SyncTic + 1))
+		SyncMilliTics = 0;
+	else
+		SyncMilliTics = (SyncMilliTics + 1) & 0x03ff;
+	SyncTic = Tic;
+	SyncMicros = micros();
+	if (SyncSlew < TIME_SLEW)
+		step = SyncSlew < -TIME_SLEW ? -TIME_SLEW : SyncSlew;
+	SyncSlew -= step;
+	SyncFraction += SyncTrim;
+	step += SyncFraction >> 8;
+	SyncFraction &= 0xff;
+	_milliTicReload = MILLITIC_CYCLES - 1 + step;
+}
+
+/*************************************************************************
+Function: timeForward()
+Purpose:  add the time an EXT_TIME frame spent in this node to its delay,
+          called by the TX ISR once its first byte is in UDR
+Input:    ring, fifo slot number
+**************************************************************************/
+static inline void timeForward(Circus_Ring *ring, uint8_t slot)
+{
+	volatile uint8_t *frame = ring->fifo[slot & FIFO_MASK].buffer;
+	unsigned long now = micros();
+	unsigned long out = now + ring->byteUs;		// the byte before it has just started
+	unsigned long held;
+	uint16_t delay = frame[5] | frame[6] << 8;
+
+	if (ring->txIdle) {		// the transmitter ran dry, its last byte may be out by now
+		out = ring->txIdleAt + ring->byteUs;
+		if ((long)(now - out) > 0) out = now;
+	}
+	held = out - (ring->timeRx[slot & FIFO_MASK] - (unsigned long)TIME_LEN * ring->byteUs);
+	delay += (held + TIME_DELAY_US / 2) / TIME_DELAY_US;
+	frame[5] = delay;
+	frame[6] = delay >> 8;
+	frame[TIME_LEN - 1] = frameCrc(frame, TIME_LEN);
+	ring->timeSlots &= ~_BV(slot & FIFO_MASK);
+}
+#endif
+
+#if EVENTS
+/*************************************************************************
+Function: eventClock()
+Purpose:  bring the day number up to date with Tic: on past midnight is the
+          next day, slewed or stepped back past it the day before; a jump
+          of more than 1024 Tics is Tic being set and keeps the day
+Returns:  now, day number << 16 | Tic
+**************************************************************************/
+static uint32_t eventClock(void)
+{
+	uint16_t tic = Tic;
+	int16_t moved = tic - EventDayTic;
+
+	if (moved > 0 && moved <= 1024 && tic < EventDayTic)
+		EventDay++;
+	else if (moved < 0 && moved >= -1024 && tic > EventDayTic)
+		EventDay--;
+	EventDayTic = tic;
+	return (uint32_t)EventDay << 16 | tic;
+}
+
+/*************************************************************************
+Function: eventFirst()
+Purpose:  the next time Tic reaches tic after now, on one of the days if
+          there are any
+**************************************************************************/
+static uint32_t eventFirst(uint32_t now, uint16_t tic, uint8_t days)
+{
+	uint32_t due = (now & 0xffff0000UL) | tic;
+
+	if ((int32_t)(due - now) <= 0)
+		due += 0x10000UL;		// reached today already
+	if (days)
+		while (!(days & _BV((uint16_t)(due >> 16) % 7)))
+			due += 0x10000UL;
+	return due;
+}
+
+static inline uint8_t eventBefore(uint8_t a, uint8_t b)
+{
+	return (int32_t)(Events[a].due - Events[b].due) < 0;
+}
+
+static void eventSwap(uint8_t a, uint8_t b)
+{
+	Circus_Event e = Events[a];
+	Events[a] = Events[b];
+	Events[b] = e;
+}
+
+/*************************************************************************
+Function: eventDown()
+Purpose:  move event i down the heap below the ones due before it
+**************************************************************************/
+static void eventDown(uint8_t i)
+{
+	for (;;) {
+		uint16_t child = 2 * i + 1;
+		uint8_t next = i;
+		if (child < EventCount && eventBefore(child, next))
+			next = child;
+		if (child + 1 < EventCount && eventBefore(child + 1, next))
+			next = child + 1;
+		if (next == i)
+			return;
+		eventSwap(i, next);
+		i = next;
+	}
+}
+
+/*************************************************************************
+Function: eventPlace()
+Purpose:  move event i up or down the heap to where its due time belongs
+**************************************************************************/
+static void eventPlace(uint8_t i)
+{
+	while (i && eventBefore(i, (i - 1) / 2)) {
+		eventSwap(i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+	eventDown(i);
+}
+
+static void eventRemove(uint8_t i)
+{
+	Events[i] = Events[--EventCount];
+	if (i < EventCount)
+		eventPlace(i);
+}
+
+/*************************************************************************
+Function: processEvent()
+Purpose:  EXT_EVENT, add or remove an event or set the day number
+Returns:  1 if the frame was changed
+**************************************************************************/
+static uint8_t processEvent(volatile uint8_t *frame)
+{
+	uint8_t Tid = frame[1] & TOKEN_NID_MASK;
+	uint8_t code = frame[0];
+	uint8_t id = frame[3];
+	uint16_t tic = frame[5] | frame[6] << 8;
+	uint16_t param = frame[7] | frame[8] << 8;
+	uint8_t status = EVENT_OK;
+	uint32_t now, moved;
+	uint8_t i;
+
+	if (Tid && Tid != NID)
+		return 0;
+	now = eventClock();
+	for (i = 0; i < EventCount && Events[i].id != id; i++)
+		;
+	switch (code) {
+	case EVENT_ONCE:
+	case EVENT_EVERY:
+	case EVENT_DAYS:
+		if (!id || (code == EVENT_EVERY && !param) || (code == EVENT_DAYS && !(param & 0x7f))) {
+			status = EVENT_NONE;
+			break;
+		}
+		if (i == EventCount) {
+			if (EventCount == EVENTS) {
+				status = EVENT_FULL;
+				break;
+			}
+			EventCount++;
+		}
+		Events[i].id = id;
+		Events[i].action = frame[4];
+		Events[i].period = code == EVENT_EVERY ? param : 0;
+		Events[i].days = code == EVENT_DAYS ? param & 0x7f : 0;
+		Events[i].due = eventFirst(now, tic, Events[i].days);
+		eventPlace(i);
+		break;
+	case EVENT_REMOVE:
+		if (!id)
+			EventCount = 0;
+		else if (i < EventCount)
+			eventRemove(i);
+		else
+			status = EVENT_NONE;
+		break;
+	case EVENT_DAY:
+		// every event moves with the day number, the ones on certain days to the next of them
+		moved = (uint32_t)(uint16_t)(param - EventDay) << 16;
+		now += moved;
+		for (i = 0; i < EventCount; i++) {
+			Events[i].due += moved;
+			if (Events[i].days)
+				Events[i].due = eventFirst(now, (uint16_t)Events[i].due, Events[i].days);
+		}
+		EventDay = param;
+		for (i = EventCount / 2; i-- > 0; )
+			eventDown(i);
+		break;
+	default:
+		status = EVENT_NONE;
+		break;
+	}
+	if (Tid != NID)
+		return 0;		// broadcast, forwarded as it came
+	frame[0] = status;
+	frame[7] = EventCount;
+	frame[8] = 0;
+	return 1;
+}
+#endif
+
+/*************************************************************************
+Function: processToken()
+Purpose:  validate one received token or frame, access CDA if it is 
+          addressed to this node and set the crc it will be forwarded with
+Input:    ring, fifo slot number
+Returns:  none
+**************************************************************************/
+static void processToken(Circus_Ring *ring, uint8_t slot)
+{
+	volatile Token_Slot *token = &ring->fifo[slot & FIFO_MASK];
+	volatile uint8_t *frame = token->buffer;
+	uint8_t len = ring->len[slot & FIFO_MASK];
+#if CRC_INCREMENTAL
+	uint8_t crc = ring->rxCrc[slot & FIFO_MASK];
+#else
+	uint8_t crc = frameCrc(frame, len);
+#endif
+	if ( crc != frame[len - 1] ) { //crc error
+#if DIAGNOSTICS
+		Diag[DIAG_CRC]++;
+#endif
+		if (frame[2] == EXT_TIME) {		// byte 1 is time, the Ringmaster sees the bad crc
+			return;
+		} else if (frame[2] == EXT_REPORT) {	// empty it, byte 1 is report data
+			frame[0] = 0;
+			frame[1] = 0;
+			frame[3] = REPORT_DAMAGED;
+		} else if (IS_EXTENDED(frame[2])) {	// byte 0 may set the frame length, leave it alone
+			frame[1] = NID + (CRC_ERROR^frame[1]&0x0f);
+		} else {
+			frame[0] = crc;  			//calculated crc
+			frame[1] = frame[3];		//received crc
+			frame[2] = NID + (CRC_ERROR^frame[2]&0x0f);
+		}
+	} else if (IS_EXTENDED(frame[2])) {
+		uint8_t changed = 0;
+		switch (frame[2]) {
+		case EXT_BLOCK:
+			changed = processBlock(frame);
+			break;
+#if CHANGE_REPORTS
+		case EXT_REPORT:
+			changed = processReport(frame);
+			break;
+#endif
+		case EXT_CONTROL:
+			changed = processControl(ring, frame);
+			break;
+#if LATENCY_SAMPLES
+		case EXT_LATENCY:
+			changed = processLatency(frame);
+			break;
+#endif
+#if CIRCUS_BRIDGE
+		case EXT_BRIDGE:
+			changed = processBridge(ring, slot, frame);
+			break;
+#endif
+#if TIME_SYNC
+		case EXT_TIME:
+			timeHack(ring, slot, frame);
+			break;
+#endif
+#if EVENTS
+		case EXT_EVENT:
+			changed = processEvent(frame);
+			break;
+#endif
+		}
+		if (!changed)
+			return;			// forwarded with the crc it came with
+#if DIAGNOSTICS
+		Diag[DIAG_ANSWERED]++;
+#endif
+	} else { // valid CRC
+		uint8_t Tid = (frame[2]&TOKEN_NID_MASK);
+		if (NID == Tid) {
+			token->uIntData = accessRegister(frame[2], token->uIntData); 
+#if DIAGNOSTICS
+			Diag[DIAG_ANSWERED]++;
+#endif
+		} else {
+			if (!Tid)		// broadcast/group store
+				accessRegister(frame[2], token->uIntData);
+			return;			// forwarded unchanged with the crc it came with
+		}
+	}
+	frame[len - 1] = frameCrc(frame, len);	// reply/error frames changed the payload, forward with a matching crc
+}
+
+/*************************************************************************
+Function: drainRing()
+Purpose:  process one ring's received tokens and start forwarding them
+**************************************************************************/
+static void drainRing(Circus_Ring *ring)
+{
+#if CIRCUS_BRIDGE
+	// every frame is processed as it comes in, so the bridge can have several tokens on the sub-ring,
+	// but one waiting for its reply holds up everything behind it
+	while (ring->issueTail != ring->rxHead) {
+		processToken(ring, ring->issueTail);
+		ring->issueTail++;
+	}
+	while (ring->procTail != ring->issueTail && !(ring->waiting & _BV(ring->procTail & FIFO_MASK))) {
+		ring->procTail++;
+		UART_CONTROL(ring->uart) |= _BV(UDRIE0);
+	}
+#elif !PROCESS_IN_ISR
+	// RX ISR only writes slot rxHead and TX ISR only reads slots before procTail, no need to block them
+	while (ring->procTail != ring->rxHead) {
+		processToken(ring, ring->procTail);
+		ring->procTail++;
+		//enable tx interrupt
+		UART_CONTROL(ring->uart) |= _BV(UDRIE0);
+	}
+#endif
+#if BAUD_SWITCH
+	if (ring->newBaud) {
+		// CTRL_BAUD: everything received has been forwarded and the UDRE interrupt is off, so at most
+		// the last byte is still in the shift register, give it two byte times before switching
+		if (ring->txTail != ring->rxHead || ring->rxIdx || (UART_CONTROL(ring->uart) & _BV(UDRIE0))) {
+			ring->baudDrained = 0;
+		} else if (!ring->baudDrained) {
+			ring->baudDrained = 1;
+			ring->baudStamp = micros();
+		} else if (micros() - ring->baudStamp >= 20000000UL / ring->baud) {
+			setBaud(ring, ring->newBaud);
+			ring->newBaud = 0;
+		}
+	}
+#endif
+}
+
+/*************************************************************************
+Function: ringBusy()
+Purpose:  does a ring have anything for Circus() to do
+**************************************************************************/
+static uint8_t ringBusy(Circus_Ring *ring)
+{
+#if BAUD_SWITCH
+	if (ring->newBaud)
+		return 1;		// CTRL_BAUD is waiting for the line to drain
+#endif
+	return ring->procTail != ring->rxHead;
+}
 
 /*************************************************************************
 Function: Circus()
@@ -158,75 +1499,52 @@ Returns:  none
 **************************************************************************/
 void Circus(void) 
 {
-	uint8_t target = 0;
-//if yield works then Circus() is only called when RxIdx > 3
-	// disable rx interrupt	
-	UCSR0B &= ~_BV(RXCIE0);
-
-	if (RxIdx = 4) { //rx only complete token, no overrun
-		uint8_t crc = crc8(crc8(crc8(CRCSEED,Token.buffer[0]),Token.buffer[1]),Token.buffer[2]) ;
-/*		if (UartError) {
-			Token.buffer[0] = UartError;
-			Token.buffer[2] = NID + (UART_ERROR^(Token.buffer[2]&0x0f));
-		} else */
-		if ( crc == Token.buffer[3] ) { // valid CRC
-			uint8_t Tid = (Token.buffer[2]&0xF0);
-			if ( NID == Tid || !Tid ) {		// if addressed to this node
-				uint8_t reg = Token.buffer[2]&0x07;
-				uint16_t reply = CDA.uintD[reg]; //set reply to data at requested register
-				target = Token.buffer[2];
-				if ( target & 0x08) { //if "store" data.  Note: Both Store or Get, returned value will be previous data at selected location
-					CDA.uintD[reg]=Token.uIntData;
-				} else {
-				}
-				if (NID == Tid) {
-					Token.uIntData=reply; 
-					if (!reg) {					// if reading or setting register[0]
-						CIRCUS_f_NEWSTAT = 0;   // clear NewStat flag since reply contains original value for register[0]
-					}					
-				}
-			}
-			
-		} else { //crc error
-			Token.buffer[0] = crc;  			//calculated crc
-			Token.buffer[1] = Token.buffer[3];	//received crc
-			Token.buffer[2] = NID + (CRC_ERROR^Token.buffer[2]&0x0f);
-		}
-	} else {  //buffer overrun
-		Token.buffer[0]=RxIdx;
-		Token.buffer[1]=TxIdx;
-		Token.buffer[2] = NID + (BUFFER_ERROR^Token.buffer[2]&0x0f); 
-	}
-	TxCrc = crc8(crc8(crc8(CRCSEED,Token.buffer[0]),Token.buffer[1]),Token.buffer[2]);
-	TxIdx = 0;
-	//enable tx interrupt
-	UCSR0B &= _BV(UDRIE0);
-	RxIdx = 0;
-	//enable rx interrupt
-	UCSR0B &= _BV(RXCIE0);
-	
-	if (target)					//user defined nodeControl is only called when node token is addressed to current node
-		nodeControl(target);	//nodeControl what action (if any) is needed)
+	uint8_t n;
+
+#if CIRCUS_BRIDGE
+	bridgeDrain();
+#endif
+	for (n = 0; n < CIRCUS_RINGS; n++)
+		drainRing(&Rings[n]);
+	// user defined nodeControl is only called for register accesses by tokens addressed to this node,
+	// once they are on their way
+	while (TargetTail != TargetHead)
+		nodeControl(Targets[TargetTail++ & (TARGET_QUEUE - 1)]);
 }
 
-uint8_t crc8(uint8_t crc_data, uint8_t crc) {
-    uint8_t i;
-    i = (crc_data ^ crc) & 0xff;
-    crc = 0;
-    if (i & 1)   crc ^= 0x5e;
-    if (i & 2)   crc ^= 0xbc;
-    if (i & 4)   crc ^= 0x61;
-    if (i & 8)   crc ^= 0xc2;
-    if (i & 0x10)  crc ^= 0x9d;
-    if (i & 0x20)  crc ^= 0x23;
-    if (i & 0x40)  crc ^= 0x46;
-    if (i & 0x80)  crc ^= 0x8c;
-    return(crc);
+/*************************************************************************
+Function: circusMilliTic()
+Purpose:  count down every ring's dead time, end the 32 bit counter's Tics
+          and set the next milliTic's length, called from the milliTic timer
+**************************************************************************/
+void circusMilliTic(void)
+{
+#if !IDLE_BYTES
+	uint8_t n;
+
+	for (n = 0; n < CIRCUS_RINGS; n++)
+		if (Rings[n].deadtime) Rings[n].deadtime--;
+#endif
+#if CIRCUS_BRIDGE
+#if !IDLE_BYTES
+	if (BridgeDeadtime) BridgeDeadtime--;
+#endif
+	if (BridgeWait) BridgeWait--;
+#endif
+#if COUNTER_32
+	if (++CounterMilliTics == 1024) {
+		CounterMilliTics = 0;
+		counterTic();
+	}
+#endif
+#if TIME_SYNC
+	timeMilliTic();
+#endif
 }
 
 //*********************************** Timers ******************************************************//
 
-void timerControl() {
+void __attribute__ ((weak)) timerControl() {
 	uint8_t doTimers = _timersRun & CIRCUS_TimersEnabled; 	//bit mask, 1 = timer# is_enable AND has not run today
 	if ( doTimers & 0x01 && Tic >= CDA.uintD[1]) { // has this timer run today?  If not, is it time to run yet?
 		if (CDA.control.timer1) TIMER_1(1); 	// is timer still allowed to run?
@@ -252,7 +1570,60 @@ void timerControl() {
 	}
 }
 
+#if EVENTS
+/*************************************************************************
+Function: eventControl()
+Purpose:  run the events that are due and schedule their next run, called
+          from yield() when Tic has moved on; only the top of the heap is
+          looked at, however many events there are
+**************************************************************************/
+static void eventControl(void)
+{
+	uint8_t sreg = SREG;
+	uint32_t now;
+
+	cli();		// with PROCESS_IN_ISR the RX ISR changes the heap too
+	now = eventClock();
+	EventTic = (uint16_t)now;
+	while (EventCount && (int32_t)(now - Events[0].due) >= 0) {
+		Circus_Event *e = &Events[0];
+		uint8_t action = e->action;
+		if (e->period) {
+			e->due += e->period;
+			if ((int32_t)(now - e->due) >= 0)		// the clock jumped, skip the runs it went past
+				e->due += ((now - e->due) / e->period + 1) * e->period;
+			eventDown(0);
+		} else if (e->days) {
+			e->due = eventFirst(now, (uint16_t)e->due, e->days);
+			eventDown(0);
+		} else {
+			eventRemove(0);
+		}
+		SREG = sreg;
+		circusEvent(action);
+		cli();
+		now = eventClock();
+	}
+	SREG = sreg;
+}
 
+/*************************************************************************
+Function: circusEvent()
+Purpose:  run an event's action, the sketch defines its own; this one runs
+          the four timers' actions, as far as register 0 still enables them
+**************************************************************************/
+void __attribute__ ((weak)) circusEvent(uint8_t action)
+{
+	if (action < 1 || action > TIMERS || !(CDA.byteD[0] & _BV(action - 1)))
+		return;
+	switch (action) {
+	case 1: TIMER_1(1); break;
+	case 2: TIMER_2(2); break;
+	case 3: TIMER_3(3); break;
+	case 4: TIMER_4(4); break;
+	}
+}
+#endif
 
 //***********************************  Hooks into the Arduino environment ****************************************//
 
@@ -261,46 +1632,272 @@ void initVariant() {
 }
 
 void yield(void) {		//yield runs before loop
-    if (RxIdx>3)
-		Circus(); //process token
+	uint8_t n;
+
+	for (n = 0; n < CIRCUS_RINGS; n++) {
+		if (ringBusy(&Rings[n]) || TargetTail != TargetHead) {
+			Circus(); //process tokens
+			break;
+		}
+	}
+#if EVENTS
+	if (Tic != EventTic)
+		eventControl();		// once a Tic
+#else
 	if (TIMERS && _timersRun)
 		timerControl();
+#endif
 }
 
 //********************************************  Transmit and Receive ISRs  *******************************************//
 
 /*************************************************************************
-Function: UART Receive interrupt
-Purpose:  called when the UART has received a character
+Function: ringReceive()
+Purpose:  body of a UART receive interrupt, called when the UART has
+          received a character
+Input:    ring, its USART number (a constant, see UART_REG)
 **************************************************************************/
-ISR (UART0_RECEIVE_INTERRUPT)        
+static inline void ringReceive(Circus_Ring *ring, uint8_t n) __attribute__((always_inline));
+static inline void ringReceive(Circus_Ring *ring, uint8_t n)
 {
+	uint8_t data;
+	uint8_t rxIdx = ring->rxIdx;
+#if IDLE_BYTES
+	unsigned long now = micros();
 
-    if (_deadtime) {
-		_deadtime = DEADTIME;
-	} else {  //dead time expired, either a new token or lost data 
-		RxIdx = 0 ;  //reset to begining of token
+	if (now - ring->rxAt >= ring->idleUs) {		// quiet line, either a new token or lost data
+#else
+    if (!ring->deadtime) {  //dead time expired, either a new token or lost data 
+#endif
+#if CUT_THROUGH
+		if (ring->cutThrough) {	// line died part way through a token being cut through, abandon it
+			ring->cutThrough = 0;
+			ring->txIdx = 0;
+		}
+#endif
+#if DIAGNOSTICS
+		if (rxIdx)
+			Diag[DIAG_RESYNCS]++;	// the line went quiet part way through a frame
+#endif
+		rxIdx = 0 ;  //reset to begining of token
 	}
+#if IDLE_BYTES
+	ring->rxAt = now;
+#else
+	ring->deadtime = DEADTIME;
+#endif
 
-    // Pete fix this?
-	UartError |= UART0_STATUS & (_BV(FE0)|_BV(DOR0) ) ;    //check for UART Framing and/or Data Over Run errors 
+#if DIAGNOSTICS
+	{	// the flags belong to the byte in UDR, read them first
+		uint8_t status = UART_STATUS(n);
+		if (status & _BV(FE0))
+			Diag[DIAG_FRAMING]++;
+		if (status & _BV(DOR0))
+			Diag[DIAG_OVERRUNS]++;
+	}
+#endif
+	data = UART_DATA(n);
+	if (!rxIdx) {
+		ring->rxDrop = (uint8_t)(ring->rxHead - ring->txTail) >= TOKEN_FIFO;
+		if (ring->rxDrop) _tokenOverflows++;
+		ring->rxLen = 4;
+#if LATENCY_SAMPLES
+		ring->rxFirst = LATENCY_STAMP();
+#endif
+	}
+	if (!ring->rxDrop) {
+		volatile uint8_t *frame = ring->fifo[ring->rxHead & FIFO_MASK].buffer;
+		frame[rxIdx] = data;
+#if CRC_INCREMENTAL
+		if (rxIdx < ring->rxLen - 1)
+			ring->crc = crc8(data, rxIdx ? ring->crc : CRCSEED);
+		else
+			ring->rxCrc[ring->rxHead & FIFO_MASK] = ring->crc;
+#endif
+		if (rxIdx == 2)
+			ring->rxLen = frameLength(frame[0], frame[1], data);
+	} else if (rxIdx == 2) {
+		ring->rxLen = 4;	// dropped frames are assumed to be plain tokens, a quiet line resyncs anything longer
+	}
 
-	//pete no need for seperate tx buffer, set Ringmaster to only allow one token at a time, 
-	//or send slow enough to process without over running.
-	Token.buffer[RxIdx++]=UART0_DATA;
-	return;
-} // UART recieve ISR
+	if (++rxIdx >= ring->rxLen) {	// token complete
+		rxIdx = 0;
+#if DIAGNOSTICS
+		Diag[DIAG_FRAMES]++;
+#endif
+		if (!ring->rxDrop) {
+#if MEASURE_LATENCY
+			ring->rxStamp[ring->rxHead & FIFO_MASK] = LATENCY_STAMP();
+#endif
+#if LATENCY_SAMPLES
+			ring->rxSpan[ring->rxHead & FIFO_MASK] = ring->rxStamp[ring->rxHead & FIFO_MASK] - ring->rxFirst;
+#endif
+#if TIME_SYNC
+			if (ring->fifo[ring->rxHead & FIFO_MASK].buffer[2] == EXT_TIME && ring->rxLen == TIME_LEN)
+				ring->timeRx[ring->rxHead & FIFO_MASK] = micros();
+#endif
+			ring->len[ring->rxHead & FIFO_MASK] = ring->rxLen;
+			ring->rxHead++;
+#if CUT_THROUGH
+			if (ring->cutThrough) {	// already on its way out, Circus() never sees it
+				ring->cutThrough = 0;
+				ring->procTail++;
+				UART_CONTROL(n) |= _BV(UDRIE0);
+			} else
+#endif
+			{
+#if PROCESS_IN_ISR
+				processToken(ring, ring->procTail);
+				ring->procTail++;
+				UART_CONTROL(n) |= _BV(UDRIE0);
+#endif
+			}
+		}
+	}
+#if CUT_THROUGH
+	/* Cut-through: once the address byte is in and the token is for some other node, start forwarding.
+	   The token passes unchanged, crc included, so a corrupted token is caught by the next node that 
+	   stores it (or the Ringmaster) rather than here.  Only the token at the head of an empty fifo is 
+	   cut through; tokens for this node, broadcasts and tokens queued behind others are stored and 
+	   forwarded by Circus(). */
+	else if (rxIdx == 3 && !ring->rxDrop && ring->rxHead == ring->procTail && ring->rxHead == ring->txTail) {
+		uint8_t Tid = ring->fifo[ring->rxHead & FIFO_MASK].buffer[2]&TOKEN_NID_MASK;
+		if (Tid && Tid != NID) {		// plain token for another node, never an extended frame
+			ring->cutThrough = 3;
+			UART_CONTROL(n) |= _BV(UDRIE0);
+		}
+	}
+#endif
+	ring->rxIdx = rxIdx;
+}
 	
 /*************************************************************************
-Function: UART Data Register Empty interrupt
-Purpose:  called when the UART is ready to transmit the next uint8_t
+Function: ringTransmit()
+Purpose:  body of a UART Data Register Empty interrupt, called when the
+          UART is ready to transmit the next uint8_t
+Input:    ring, its USART number (a constant, see UART_REG)
 **************************************************************************/
-ISR (UART0_TRANSMIT_INTERRUPT) 
+static inline void ringTransmit(Circus_Ring *ring, uint8_t n) __attribute__((always_inline));
+static inline void ringTransmit(Circus_Ring *ring, uint8_t n)
 {
-	if (TxIdx < 4) { //transmit data
-		UART0_DATA = Token.buffer[TxIdx++];  
+	uint8_t txTail = ring->txTail;
+
+	if (txTail != ring->procTail) { //transmit processed token
+#if MEASURE_LATENCY
+		if (!ring->txIdx) {	// first byte of the token, cut-through tokens start elsewhere and are skipped
+			uint16_t latency = LATENCY_STAMP() - ring->rxStamp[txTail & FIFO_MASK];
+			if (latency > _maxForwardLatency) _maxForwardLatency = latency;
+#if LATENCY_SAMPLES
+			LatencyRx[LatencyTaken & (LATENCY_SAMPLES - 1)] = ring->rxSpan[txTail & FIFO_MASK];
+			LatencyHold[LatencyTaken & (LATENCY_SAMPLES - 1)] = latency;
+			LatencyTaken++;
+#endif
+		}
+#endif
+		UART_DATA(n) = ring->fifo[txTail & FIFO_MASK].buffer[ring->txIdx];
+#if TIME_SYNC
+		if (!ring->txIdx && (ring->timeSlots & _BV(txTail & FIFO_MASK)))
+			timeForward(ring, txTail);		// bytes 5 - 7 haven't gone yet
+		ring->txIdle = 0;
+#endif
+		if (++ring->txIdx >= ring->len[txTail & FIFO_MASK]) {
+			ring->txIdx = 0;
+			ring->txTail = txTail + 1;
+		}
+#if CUT_THROUGH
+	} else if (ring->txIdx < ring->cutThrough) {	// forward a passing token while it is still arriving
+		UART_DATA(n) = ring->fifo[txTail & FIFO_MASK].buffer[ring->txIdx++];
+#if TIME_SYNC
+		ring->txIdle = 0;
+#endif
+#endif
 	}else{
-        /* tx buffer empty, disable UDRE interrupt */
-        UCSR0B &= ~_BV(UDRIE0);
+        /* nothing ready to send, disable UDRE interrupt, RX ISR or Circus() re-enables it */
+        UART_CONTROL(n) &= ~_BV(UDRIE0);
+#if TIME_SYNC
+		ring->txIdleAt = micros();
+		ring->txIdle = 1;
+#endif
     }
 }
+
+#if CIRCUS_BRIDGE
+/*************************************************************************
+Function: bridgeReceive()
+Purpose:  body of the sub-ring's receive interrupt, collects the tokens
+          coming back for bridgeDrain()
+Input:    USART number of the sub-ring
+**************************************************************************/
+static inline void bridgeReceive(uint8_t n) __attribute__((always_inline));
+static inline void bridgeReceive(uint8_t n)
+{
+	uint8_t data;
+#if IDLE_BYTES
+	unsigned long now = micros();
+
+	if (now - BridgeRxAt >= BridgeIdleUs)
+		BridgeRxIdx = 0;
+	BridgeRxAt = now;
+#else
+
+	if (!BridgeDeadtime)
+		BridgeRxIdx = 0;
+	BridgeDeadtime = DEADTIME;
+#endif
+	data = UART_DATA(n);
+	if (!BridgeRxIdx)
+		BridgeRxDrop = (uint8_t)(BridgeRxHead - BridgeRxTail) >= TOKEN_FIFO;
+	if (!BridgeRxDrop)
+		BridgeReply[BridgeRxHead & FIFO_MASK][BridgeRxIdx] = data;
+	if (++BridgeRxIdx >= 4) {
+		BridgeRxIdx = 0;
+		if (!BridgeRxDrop)
+			BridgeRxHead++;
+	}
+}
+
+/*************************************************************************
+Function: bridgeTransmit()
+Purpose:  body of the sub-ring's Data Register Empty interrupt, sends the
+          queued requests
+Input:    USART number of the sub-ring
+**************************************************************************/
+static inline void bridgeTransmit(uint8_t n) __attribute__((always_inline));
+static inline void bridgeTransmit(uint8_t n)
+{
+	if (BridgeSent != BridgeHead) {
+		UART_DATA(n) = BridgeQueue[BridgeSent & FIFO_MASK].token[BridgeTxIdx];
+		if (++BridgeTxIdx >= 4) {
+			BridgeTxIdx = 0;
+			BridgeSent++;
+		}
+	} else {
+		UART_CONTROL(n) &= ~_BV(UDRIE0);
+	}
+}
+#endif
+
+ISR (UART0_RECEIVE_INTERRUPT)  { ringReceive(&Rings[0], 0); }
+ISR (UART0_TRANSMIT_INTERRUPT) { ringTransmit(&Rings[0], 0); }
+#if CIRCUS_RINGS > 1
+ISR (USART1_RX_vect)   { ringReceive(&Rings[1], 1); }
+ISR (USART1_UDRE_vect) { ringTransmit(&Rings[1], 1); }
+#endif
+#if CIRCUS_RINGS > 2
+ISR (USART2_RX_vect)   { ringReceive(&Rings[2], 2); }
+ISR (USART2_UDRE_vect) { ringTransmit(&Rings[2], 2); }
+#endif
+#if CIRCUS_RINGS > 3
+ISR (USART3_RX_vect)   { ringReceive(&Rings[3], 3); }
+ISR (USART3_UDRE_vect) { ringTransmit(&Rings[3], 3); }
+#endif
+#if CIRCUS_BRIDGE == 1
+ISR (USART1_RX_vect)   { bridgeReceive(1); }
+ISR (USART1_UDRE_vect) { bridgeTransmit(1); }
+#elif CIRCUS_BRIDGE == 2
+ISR (USART2_RX_vect)   { bridgeReceive(2); }
+ISR (USART2_UDRE_vect) { bridgeTransmit(2); }
+#elif CIRCUS_BRIDGE == 3
+ISR (USART3_RX_vect)   { bridgeReceive(3); }
+ISR (USART3_UDRE_vect) { bridgeTransmit(3); }
+#endif
@@ -1,6 +1,6 @@
 /* user's sketch must define:
 const uint8_t NID = ;				// Node ID, each node should have a different ID, high nibble only 0x10 - 0xF0
-const uint16_t BAUD = ;
+const uint32_t BAUD = ;				// or = CIRCUS_BAUD with CIRCUS_BAUD defined ahead of #include <Circus.h> to have it checked, see CircusBaud.h
 const uint8_t DEBOUNCE_TIME = 64;	// 0 = disable debounce counter, must be one of 0, 16,32,64 or 128
 const uint8_t DEBOUNCE_PIN = 5;		// CIRCUS_COUNTER will increment every time this pin changes state:
 									// low to high = +1, high to low = +1
@@ -8,6 +8,8 @@ const uint8_t DEBOUNCE_PULLUP = ;	// 1 = enable internal pullup resistor, 0 = di
 
 The following are optional, user should define it needed
 You can define up to 4 timers and 1 counter. 
+A C++ sketch can describe all of this in one struct instead and have the unused parts compile away,
+see CircusNode.h.
 
 #define TIMERS 4   // the number of timers you want to use, if you don't want timers don't #define 
 then for each timer you need to define a MACRO that either performs a simple action or calls a function()
@@ -43,6 +45,65 @@ i.e.
 
 You can also define COUNTER_PULLUP which enable an internal pull up resistor on the COUNTER pin
 
+A 16 bit counter wraps in minutes on a busy flow meter.  Built with COUNTER_32 (a register number, see
+Circus.c) Circus keeps a 32 bit count in _counter32 instead, count into that (CounterISR.h does with
+COUNTER_32 defined, CTic.h's DEBOUNCE_COUNT_n can name it, CTic.h's COUNTER_T1 counts into it in hardware).  Register COUNTER_32 and the next one show
+the low and high half, refreshed every Tic; reading the low half latches both, so a block read of the
+two (or the low half, then the high half) always gives one count.  With COUNTER_RATE another register
+has the pulses of the last Tic.  Storing the high half, then the low half, loads the counter.
+
+TIME
+Storing Tic (register 7) sets the clock, late by however long the token took to get there.  Built with
+TIME_SYNC (on by default, see Circus.c) the node follows the Ringmaster's EXT_TIME frames instead: the
+delay of every node on the way is taken out, the milliTic is made up to 1/32 longer or shorter until
+the clock has caught up, and trimmed by the drift seen between frames.  The milliTic ISR has to load
+OCR1A with _milliTicReload after calling circusMilliTic(), CTic.c and CircusNode.h do.
+
+EVENTS
+The four timers run once a day each, from registers 1 - 4.  Built with EVENTS (a number, see Circus.c)
+the node holds that many scheduled events instead and registers 1 - 4 are user data: the Ringmaster
+adds them with EXT_EVENT frames (CircusToken.h), to run once, every so many Tics or on certain days of
+the week at a Tic, and sets the day number they go by.  yield() looks at the next one due once a Tic
+and calls circusEvent(action) for it.  The sketch defines circusEvent(), or leaves it to Circus.c's,
+which calls TIMER_1 - TIMER_4 for actions 1 - 4 if their bits in register 0 are set.
+
+LATENCY
+Built with MEASURE_LATENCY (see Circus.c) _maxForwardLatency is the longest any frame waited in the
+node.  With LATENCY_SAMPLES as well, the receive and transmit ISRs keep the times of the last frames
+through the node, stamped with micros() as their first byte came in, their last byte came in and
+their first byte went out; the Ringmaster reads them with EXT_LATENCY frames (CircusToken.h) and
+can build the node's processing time and jitter from them while the ring is in use.
+
+DIAGNOSTICS
+Built with DIAGNOSTICS (on by default, see Circus.c) the node counts the frames it received and
+answered, crc failures, UART framing errors and overruns, and frames cut short by a quiet line, next
+to _maxForwardLatency and _tokenOverflows.  The Ringmaster reads them as a page of 8 registers with
+an EXT_BLOCK frame (BLOCK_DIAG, DIAG_ in CircusToken.h) and clears them by storing zeros.  The node
+whose crc failures and framing errors jump over those of the node before it sits behind a bad link.
+
+REGISTER_OPS
+Built with REGISTER_OPS (on by default, see Circus.c) the Ringmaster can set or clear bits of a
+register, add to it or compare-and-swap it with one EXT_CONTROL frame (CTRL_SET_BITS and the rest in
+CircusToken.h) instead of a get and a store a lap apart.  The node does it with interrupts off and
+passes it to nodeControl() like a store, so a timer enable bit can be flipped in register 0 without
+losing the newStat or attention bits the sketch sets meanwhile.
+
+PAGES
+Built with PAGES (a number, see Circus.c) a node has more than 8 registers: the Ringmaster selects a
+page with an EXT_CONTROL frame (CTRL_PAGE in CircusToken.h) and registers 1 - 6 of the tokens and
+block frames after it are that page's, registers 0 and 7 stay control and Tic.  The sketch maps the
+pages in PAGE_MAP, page n is PAGE_MAP[n - 1], 3 bytes each:
+	static volatile uint16_t levels[6];
+	static const uint16_t limits[6] PROGMEM = {100, 200, 300, 400, 500, 600};
+	static uint16_t readAdc(uint8_t page, uint8_t reg) { return analogRead(reg); }
+	const Circus_Page PAGE_MAP[] = {CIRCUS_PAGE_RAM(levels), CIRCUS_PAGE_PROGMEM(limits),
+		CIRCUS_PAGE_GETTER(readAdc)};
+A RAM page is read and stored with interrupts off, PROGMEM constants and getters are read only and
+drop stores.  A getter runs wherever the token is processed, in the receive ISR with PROCESS_IN_ISR,
+so it has to be quick.  Paged registers aren't watched for change reports, aren't passed to
+nodeControl() and refuse the register operations.  What the sketch would otherwise hand out through
+_cmdStat and register 6 a command at a time can be read directly, 6 registers in one block frame.
+
 /**/
 
 /* Naming Conventions
@@ -60,6 +121,8 @@ extern "C" {
 #endif
 
 #include <stdint.h>
+#include <CircusCrc.h>
+#include <CircusBaud.h>
 
 typedef volatile union _Circus_Data_Array {
 	uint8_t byteD[16];
@@ -79,21 +142,41 @@ typedef volatile union _Circus_Data_Array {
 } Circus_Data_Array;
 
 extern Circus_Data_Array CDA;
-extern volatile uint8_t RxIdx;
+
+// a register page, registers 1 - 6 while the Ringmaster has it selected, needs PAGES (Circus.c)
+typedef struct {
+	uint8_t kind;			// PAGE_RAM, PAGE_PROGMEM or PAGE_GETTER
+	union {
+		volatile uint16_t *ram;			// 6 variables
+		const uint16_t *progmem;		// 6 constants in flash
+		uint16_t (*getter)(uint8_t page, uint8_t reg);	// called for every get, reg is 1 - 6
+	} at;
+} Circus_Page;
+#define PAGE_RAM		0
+#define PAGE_PROGMEM	1
+#define PAGE_GETTER		2
+#define CIRCUS_PAGE_RAM(vars)		{PAGE_RAM, {.ram = (vars)}}
+#define CIRCUS_PAGE_PROGMEM(consts)	{PAGE_PROGMEM, {.progmem = (consts)}}
+#define CIRCUS_PAGE_GETTER(fn)		{PAGE_GETTER, {.getter = (fn)}}
+extern const Circus_Page PAGE_MAP[];	// provided by the sketch, PAGES entries
+extern volatile uint16_t _tokenOverflows;	// tokens dropped because a token fifo of this node was full
+extern volatile uint16_t _maxForwardLatency;	// worst last-byte-in to first-byte-out time in microseconds, needs MEASURE_LATENCY
 extern volatile uint8_t _timersRun;
+extern volatile uint32_t _counter32;		// pulses, needs COUNTER_32
+extern volatile uint16_t _milliTicReload;	// compare value of the next milliTic, Timer1's OCR1A
 //extern volatile uint8_t _timersEnabled;
-extern volatile uint8_t _deadtime;
+extern uint8_t _baudError;		// per mille between the baud rate asked for and the one the UART runs at
 
 extern const uint8_t NID;
-extern const uint16_t BAUD;
+extern const uint32_t BAUD;
 extern const uint8_t DEBOUNCE_TIME;		//zero disables debounce counter
 extern const uint8_t DEBOUNCE_PIN;
 extern const uint8_t DEBOUNCE_PULLUP;	//1= enable internal pullup resistor, 0=disable
 extern const uint8_t TIMERS;
-extern const void (*TIMER_1)(uint8_t);
-extern const void (*TIMER_2)(uint8_t);
-extern const void (*TIMER_3)(uint8_t);
-extern const void (*TIMER_4)(uint8_t);
+extern void (* const TIMER_1)(uint8_t);
+extern void (* const TIMER_2)(uint8_t);
+extern void (* const TIMER_3)(uint8_t);
+extern void (* const TIMER_4)(uint8_t);
 // Seed CRC with something other than zero
 extern const uint8_t CRCSEED;  //crc8 returns zero if fed zeros, so start with some value other than zero
 
@@ -114,14 +197,20 @@ extern const uint8_t CRCSEED;  //crc8 returns zero if fed zeros, so start with s
 #define CIRCUS_TimersEnabled (CDA.byteD[0]&(_BV(TIMERS)-1))
 
 
-void nodeControl(uint8_t) __attribute__ ((weak));
+// Circus.c has do-nothing/default versions of these, a sketch (or CircusNode.h) overrides them by defining its own
+void nodeControl(uint8_t);
 
 void circus_init();
 
+void setupTic(void);			// called by circus_init(), starts the milliTic timer (CircusNode.h has one)
+
+void circusMilliTic(void);		// every milliTic, times out a partly received token on every ring
+
 void Circus(void);
-uint8_t crc8( uint8_t, uint8_t);
 
-void timerControl(void) __attribute__ ((weak));
+void timerControl(void);
+
+void circusEvent(uint8_t action);	// an EVENTS event is due, called from yield()
 
 //void setupDebounce(uint8_t, uint8_t, uint8_t);
 
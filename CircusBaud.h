@@ -0,0 +1,42 @@
+/* Baud rate arithmetic for the AVR USART, shared by the node code (Circus.c) and the host tools in extras/
+Doesn't depend on Arduino.h.
+
+The USART divides the CPU clock by 16 (or by 8 with U2X) and by UBRR + 1, so most rates can only be
+approximated:
+	rate = fcpu / (div * (UBRR + 1))		div = 16, or 8 with U2X
+16 MHz:	  9600  x1 UBRR 103  +0.2%		 57600  x2 UBRR 34   -0.8%
+		 38400  x1 UBRR 25   +0.2%		115200  x2 UBRR 16   +2.1%
+		250000  x1 UBRR 3     0.0%		500000  x1 UBRR 1     0.0%
+Circus.c picks U2X only where it gets closer, the x1 receiver samples every bit more often and takes
+more noise.  Nodes share their crystal's error with each other, it only matters on the links to and
+from the Ringmaster.
+
+A sketch can have the rate checked at compile time: #define CIRCUS_BAUD 250000 before #include <Circus.h>
+(or -DCIRCUS_BAUD=250000 for the whole build) and define const uint32_t BAUD = CIRCUS_BAUD; itself.
+More than 4% off is an error, more than BAUD_MAX_ERROR or 1% a warning.
+*/
+
+#pragma once
+
+// UBRR rounded to the nearest divider, div = 16 or 8 (U2X).  Good for rates up to fcpu / 8.
+#define BAUD_UBRR(fcpu, baud, div)		(((fcpu) + (div) * (baud) / 2) / ((div) * (baud)) - 1)
+#define BAUD_ACTUAL(fcpu, baud, div)	((fcpu) / ((div) * (BAUD_UBRR(fcpu, baud, div) + 1)))
+// how far the USART is off the nominal rate, in per mille rounded up so 1.08% counts as 11 and trips
+// the 1% band, unsigned so it also works in #if
+#define BAUD_ERROR(fcpu, baud, div)		(((BAUD_ACTUAL(fcpu, baud, div) > (baud) ? BAUD_ACTUAL(fcpu, baud, div) - (baud) \
+											: (baud) - BAUD_ACTUAL(fcpu, baud, div)) * 1000 + (baud) - 1) / (baud))
+#define BAUD_U2X(fcpu, baud)			(BAUD_UBRR(fcpu, baud, 8) <= 4095 && BAUD_ERROR(fcpu, baud, 8) < BAUD_ERROR(fcpu, baud, 16))
+#define BAUD_BEST_ERROR(fcpu, baud)		(BAUD_U2X(fcpu, baud) ? BAUD_ERROR(fcpu, baud, 8) : BAUD_ERROR(fcpu, baud, 16))
+
+// per mille, a node refuses (CTRL_BAUD_CHECK) rates it is further off than this; 8-N-1 breaks at about 4%
+#define BAUD_MAX_ERROR	25
+
+#ifdef CIRCUS_BAUD
+#if BAUD_BEST_ERROR(F_CPU, CIRCUS_BAUD) > 40
+#error "CIRCUS_BAUD is more than 4% off at this F_CPU, the nodes can't talk to the Ringmaster"
+#elif BAUD_BEST_ERROR(F_CPU, CIRCUS_BAUD) > BAUD_MAX_ERROR
+#warning "CIRCUS_BAUD is 2.5% - 4% off at this F_CPU, only a Ringmaster off the same way will work"
+#elif BAUD_BEST_ERROR(F_CPU, CIRCUS_BAUD) > 10
+#warning "CIRCUS_BAUD is 1% - 2.5% off at this F_CPU, the Ringmaster has to be within 1.5%"
+#endif
+#endif
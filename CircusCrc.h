@@ -0,0 +1,29 @@
+/* CRC-8 used by Circus tokens (Dallas/Maxim 1-Wire polynomial, x^8 + x^5 + x^4 + 1, reflected)
+
+crc8(data, crc) folds one byte into a running crc, a token's crc is
+	crc8(crc8(crc8(CRCSEED, byte0), byte1), byte2)
+
+Two interchangeable implementations, pick one with CRC_TABLE when building CircusCrc.c:
+	0 = bitwise, eight conditional xors per byte, no extra flash (default)
+	1 = 256 byte lookup table in PROGMEM, one table read per byte
+
+This file and CircusCrc.c don't depend on Arduino.h so the host tools in extras/ can share them.
+*/
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#ifndef CRC_TABLE
+#define CRC_TABLE 0
+#endif
+
+uint8_t crc8( uint8_t, uint8_t);
+
+#ifdef __cplusplus
+}
+#endif
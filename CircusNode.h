@@ -0,0 +1,292 @@
+/* Compile time node configuration, a header only C++ alternative to the constants, TIMER_n pointers
+and COUNTER_ macros Circus.h and CTic.h ask a sketch for.
+
+A sketch describes its node in one struct: NID, baud rate, which timers run what, which pins count
+into which registers.  CircusNode<Config> turns that into exactly the code it needs:
+	- timer actions are template arguments, called directly (and usually inlined) from timerControl(),
+	  no TIMER_n function pointers, no TIMERS >= n tests at run time
+	- the milliTic ISR (Timer1 compare, 1.2875 ms) only samples the debounce pins if there are any
+	  (all of them at once, CounterDebounce.h),
+	  only reloads the timers at midnight if there are any, then calls circusMilliTic()
+	- a register used for two things, a timer that doesn't exist or a debounce pin on the UART is a
+	  compile error instead of a surprise
+Unused features compile away, so the node is smaller and its Timer1 ISR shorter than with CTic.c.
+
+The registers keep their usual meaning: CDA.uintD[0] is control (timer n is enabled by its bit n - 1),
+CDA.uintD[7] is Tic.  Timer n fires once a day when Tic reaches CDA.uintD[n] (or the register given).
+Built with EVENTS (Circus.c) the Ringmaster schedules the timers instead: an event with action n runs
+timer n's action, its register isn't used.
+
+USAGE (sketch, C++):
+	#include <Circus.h>
+	#include <CircusNode.h>
+
+	static void pumpOn(uint8_t timer)  { digitalWrite(7, HIGH); }
+	static void pumpOff(uint8_t timer) { digitalWrite(7, LOW); }
+
+	struct Pump : CircusNodeDefaults {
+		static const uint8_t Nid = 0x30;
+		static const uint32_t Baud = 9600;
+		typedef CircusList<CircusTimer<1, pumpOn>, CircusTimer<2, pumpOff> > Timers;
+		typedef CircusList<CircusDebounce<5, DEBOUNCE_CHANGE, 5> > Counters;	// pin 5 counts into CDA[5]
+	};
+	CIRCUS_NODE(Pump)
+
+CIRCUS_NODE defines what Circus.c links against (NID, BAUD, TIMERS, ...), timerControl(), setupTic()
+and the Timer1 compare ISR, so the sketch must not also use CTic.c's.  A Config only has to give
+what differs from CircusNodeDefaults.
+*/
+
+#pragma once
+
+#if ARDUINO < 100
+#include <WProgram.h>
+#else
+#include <Arduino.h>
+#endif
+
+#include <Circus.h>
+#include <CounterDebounce.h>
+
+// CircusDebounce edges, as CTic.h's COUNTER_n_DEBOUNCE
+#define DEBOUNCE_LOW	0	// count when the pin goes low
+#define DEBOUNCE_HIGH	1	// count when the pin goes high
+#define DEBOUNCE_CHANGE	2	// count both
+
+/*************************************************************************
+Struct:   CircusItem
+Purpose:  what every timer or counter provides, the defaults do nothing
+**************************************************************************/
+struct CircusItem {
+	static const uint8_t Regs = 0;		// bit n = uses CDA.uintD[n]
+	static const uint8_t Pins = 0;		// bit n = debounces PORTD pin n (Arduino pin n)
+	static const uint8_t TimerBits = 0;	// bit n - 1 = is timer n
+	static const uint8_t Rise = 0;		// bit n = counts pin n going high
+	static const uint8_t Fall = 0;		// bit n = counts pin n going low
+	static void setup() {}
+	static uint8_t timer(uint8_t run) { return 0; }		// TimerBits if it ran (or was disabled) today
+	static void count(uint8_t counted) {}				// the debounced pins that counted this sample
+	static void event(uint8_t action) {}				// an EVENTS event with this action is due
+};
+
+/*************************************************************************
+Struct:   CircusTimer
+Purpose:  timer N (1 - 4) calls Action(N) once a day when Tic reaches
+          CDA.uintD[Reg], if CDA.control.timerN is set
+**************************************************************************/
+template <uint8_t N, void (*Action)(uint8_t), uint8_t Reg = N>
+struct CircusTimer : CircusItem {
+	static_assert(N >= 1 && N <= 4, "timers are 1 - 4, enabled by CDA.control.timer1 - timer4");
+	static_assert(Reg >= 1 && Reg <= 6, "register 0 is control and 7 is Tic");
+	static const uint8_t Regs = 1 << Reg;
+	static const uint8_t TimerBits = 1 << (N - 1);
+
+	static inline uint8_t timer(uint8_t run)
+	{
+		if (!(run & TimerBits) || Tic < CDA.uintD[Reg])
+			return 0;
+		if (CDA.byteD[0] & TimerBits)
+			Action(N);
+		return TimerBits;		// done for today either way
+	}
+
+	static inline void event(uint8_t action)
+	{
+		if (action == N && (CDA.byteD[0] & TimerBits))
+			Action(N);
+	}
+};
+
+/*************************************************************************
+Struct:   CircusDebounce
+Purpose:  count the Edge of PORTD pin Pin into CDA.uintD[Reg], the pin
+          has to hold a new level for DebounceTime milliTics, see
+          CounterDebounce.h
+**************************************************************************/
+template <uint8_t Pin, uint8_t Edge = DEBOUNCE_CHANGE, uint8_t Reg = 5, bool Pullup = false>
+struct CircusDebounce : CircusItem {
+	static_assert(Pin >= 2 && Pin <= 7, "debounced pins are PORTD 2 - 7, 0 and 1 are the ring's UART");
+	static_assert(Edge <= DEBOUNCE_CHANGE, "Edge is DEBOUNCE_LOW, DEBOUNCE_HIGH or DEBOUNCE_CHANGE");
+	static_assert(Reg >= 1 && Reg <= 6, "register 0 is control and 7 is Tic");
+	static const uint8_t Regs = 1 << Reg;
+	static const uint8_t Pins = 1 << Pin;
+	static const uint8_t Rise = Edge != DEBOUNCE_LOW ? Pins : 0;
+	static const uint8_t Fall = Edge != DEBOUNCE_HIGH ? Pins : 0;
+
+	static void setup() { pinMode(Pin, Pullup ? INPUT_PULLUP : INPUT); }
+
+	static inline void count(uint8_t counted)
+	{
+		if (counted & Pins)
+			CDA.uintD[Reg]++;
+	}
+};
+
+/*************************************************************************
+Struct:   CircusCounter
+Purpose:  count INT0/INT1 (Arduino pin 2 or 3) interrupts into CDA.uintD[Reg],
+          Mode is RISING, FALLING, LOW or CHANGE
+**************************************************************************/
+template <uint8_t Pin, uint8_t Mode, uint8_t Reg = 5, bool Pullup = false>
+struct CircusCounter : CircusItem {
+	static_assert(Pin == 2 || Pin == 3, "interrupt counters are on INT0/INT1, Arduino pins 2 and 3");
+	static_assert(Reg >= 1 && Reg <= 6, "register 0 is control and 7 is Tic");
+	static const uint8_t Regs = 1 << Reg;
+
+	static void interrupt() { CDA.uintD[Reg]++; }
+	static void setup()
+	{
+		pinMode(Pin, Pullup ? INPUT_PULLUP : INPUT);
+		attachInterrupt(Pin - 2, interrupt, Mode);
+	}
+};
+
+/*************************************************************************
+Struct:   CircusList
+Purpose:  a compile time list of timers or counters, every call is
+          unrolled into the items' own code
+**************************************************************************/
+template <class... Items> struct CircusList;
+
+template <> struct CircusList<> : CircusItem {
+	static const bool Clash = false;		// two items share a register or pin
+};
+
+template <class First, class... Rest>
+struct CircusList<First, Rest...> {
+	typedef CircusList<Rest...> Tail;
+	static const uint8_t Regs = First::Regs | Tail::Regs;
+	static const uint8_t Pins = First::Pins | Tail::Pins;
+	static const uint8_t TimerBits = First::TimerBits | Tail::TimerBits;
+	static const uint8_t Rise = First::Rise | Tail::Rise;
+	static const uint8_t Fall = First::Fall | Tail::Fall;
+	static const bool Clash = (First::Regs & Tail::Regs) || (First::Pins & Tail::Pins)
+		|| (First::TimerBits & Tail::TimerBits) || Tail::Clash;
+
+	static void setup() { First::setup(); Tail::setup(); }
+	static inline uint8_t timer(uint8_t run) { return First::timer(run) | Tail::timer(run); }
+	static inline void count(uint8_t counted) { First::count(counted); Tail::count(counted); }
+	static inline void event(uint8_t action) { First::event(action); Tail::event(action); }
+};
+
+/*************************************************************************
+Struct:   CircusNodeDefaults
+Purpose:  base for a sketch's Config, no timers, no counters
+**************************************************************************/
+struct CircusNodeDefaults {
+	static const uint8_t Nid = 0x10;
+	static const uint32_t Baud = 9600;
+	static const uint8_t DebounceTime = 64;		// milliTics a debounce pin has to hold a new level, a power of 2
+	typedef CircusList<> Timers;
+	typedef CircusList<> Counters;
+};
+
+/*************************************************************************
+Class:    CircusNode
+Purpose:  the node Config describes, see CIRCUS_NODE
+**************************************************************************/
+template <class Config>
+class CircusNode {
+public:
+	typedef typename Config::Timers Timers;
+	typedef typename Config::Counters Counters;
+
+	static_assert(Config::Nid && !(Config::Nid & 0x0f), "NID is 0x10 - 0xF0");
+	static_assert(!Timers::Clash && !Counters::Clash && !(Timers::Regs & Counters::Regs),
+		"a register, pin or timer is used twice");
+	static_assert(!Timers::Pins && !Counters::TimerBits, "timers go in Timers, counters in Counters");
+	static_assert(Config::DebounceTime >= DEBOUNCE_SAMPLES && !(Config::DebounceTime & (Config::DebounceTime - 1)),
+		"DebounceTime is a power of 2, 4 or more");
+
+	// Circus.h's TIMERS, the highest timer number
+	static const uint8_t TimerCount = Timers::TimerBits & 0x08 ? 4 : Timers::TimerBits & 0x04 ? 3
+		: Timers::TimerBits & 0x02 ? 2 : Timers::TimerBits ? 1 : 0;
+
+	/*************************************************************************
+	Function: setup()
+	Purpose:  counter pins and the milliTic timer, called by circus_init()
+	**************************************************************************/
+	static void setup()
+	{
+		Counters::setup();
+		if (Counters::Pins)
+			Debounced.state = PIND & Counters::Pins;	// count edges from here on
+		cli();
+		TCCR1A = 0;
+		TCCR1B = _BV(WGM12) | _BV(CS10);	// CTC, no prescaler
+		TCNT1 = 0;
+		OCR1A = 20598;						// 20599 cycles = 1 milliTic, 1024 milliTics = 1 Tic, see CTic.c
+		TIMSK1 |= _BV(OCIE1A);
+		sei();
+	}
+
+	/*************************************************************************
+	Function: milliTic()
+	Purpose:  body of the Timer1 compare ISR
+	**************************************************************************/
+	static inline void milliTic()
+	{
+		uint16_t now = ++MilliTics;
+
+		if (Counters::Pins && !(now & (Config::DebounceTime / DEBOUNCE_SAMPLES - 1))) {
+			uint8_t flipped = debouncePort(&Debounced, PIND & Counters::Pins);
+			if (flipped)
+				Counters::count(debounceEdges(&Debounced, flipped, Counters::Rise, Counters::Fall));
+		}
+		if (!(now & 0x03ff)) {
+			Tic++;
+			if (TimerCount && !Tic)		// midnight
+				_timersRun = Timers::TimerBits;
+		}
+		circusMilliTic();
+		OCR1A = _milliTicReload;			// slewed and trimmed by Circus.c's TIME_SYNC
+	}
+
+	/*************************************************************************
+	Function: timerControl()
+	Purpose:  run the timers that are due, called from yield()
+	**************************************************************************/
+	static inline void timerControl()
+	{
+		uint8_t done = Timers::timer(_timersRun);
+		if (done) {
+			uint8_t sreg = SREG;
+			cli();
+			_timersRun &= ~done;
+			SREG = sreg;
+		}
+	}
+
+	/*************************************************************************
+	Function: event()
+	Purpose:  run the timer an EVENTS event names, called from yield()
+	**************************************************************************/
+	static inline void event(uint8_t action)
+	{
+		Timers::event(action);
+	}
+
+	static volatile uint16_t MilliTics;	// 1024 per Tic
+	static Debounce_Port Debounced;		// Counters::Pins, only touched by the ISR
+};
+
+template <class Config> volatile uint16_t CircusNode<Config>::MilliTics;
+template <class Config> Debounce_Port CircusNode<Config>::Debounced;
+
+// everything Circus.c expects from the sketch, for the node Config describes
+#define CIRCUS_NODE(Config) \
+	const uint8_t NID = Config::Nid; \
+	const uint32_t BAUD = Config::Baud; \
+	const uint8_t DEBOUNCE_TIME = 0;	/* CircusNode debounces, not circus_init() */ \
+	const uint8_t DEBOUNCE_PIN = 0; \
+	const uint8_t DEBOUNCE_PULLUP = 0; \
+	const uint8_t TIMERS = CircusNode<Config>::TimerCount; \
+	void (* const TIMER_1)(uint8_t) = 0; \
+	void (* const TIMER_2)(uint8_t) = 0; \
+	void (* const TIMER_3)(uint8_t) = 0; \
+	void (* const TIMER_4)(uint8_t) = 0; \
+	volatile uint8_t _timersRun; \
+	void timerControl(void) { CircusNode<Config>::timerControl(); } \
+	void circusEvent(uint8_t action) { CircusNode<Config>::event(action); } \
+	void setupTic(void) { CircusNode<Config>::setup(); } \
+	ISR(TIMER1_COMPA_vect) { CircusNode<Config>::milliTic(); }
@@ -0,0 +1,255 @@
+/* Circus wire format, shared by the node code (Circus.c) and the host tools in extras/
+Doesn't depend on Arduino.h.
+
+Token structure:
+0x00:	Low byte of int data
+0x01:	High byte of int data
+0x02:	targetID, R/W, 3bit registerID
+0x03:	crc
+
+Extended tokens (frames):
+An address byte of 0x00 - 0x07 would be a broadcast "get", which has no use since every node
+would try to answer, so those 8 values select an extended token instead.  Bytes 0 and 1 carry
+the frame's parameters, bytes 2.. are a body whose length follows from bytes 0-2, and a single
+crc-8 over everything before it ends the frame.  A frame never changes length as it goes around
+the ring.  Nodes built before extended tokens forward 4 byte frames (EXT_IDLE) unchanged, but
+frames with a body need every node on the ring to understand them.
+
+EXT_BLOCK, read or write several registers of one node in one lap:
+0x00:	number of registers, 1-8, plus BLOCK_DIAG for the diagnostics page, BLOCK_HIGH for a gather
+		or BLOCK_ACK for a group store
+0x01:	targetID, R/W, first registerID (same layout as a token's address byte)
+0x02:	EXT_BLOCK
+...		2 bytes per register, low byte first.  Stores replace these with the previous values,
+		gets fill them in, both only at the addressed node.
+last:	crc
+Errors are reported the same way as for tokens, in byte 0x01.
+With BLOCK_DIAG the registers are the node's DIAG_ counters (Circus.c, DIAGNOSTICS) instead of its
+CDA and the addressed node sets BLOCK_DONE; storing zeros clears them.  A node without DIAGNOSTICS
+returns the frame unchanged.
+A get sent to NID 0 is a gather: one register of every node in a single lap.  Slot n belongs to
+node (n + 1) << 4, or (n + 9) << 4 with BLOCK_HIGH, and every node with a slot fills in its own
+value as the frame passes; so two frames cover a ring of 15.  Slots of nodes that aren't there
+come back as the Ringmaster sent them.  With BLOCK_DIAG it gathers one diagnostics register.
+A store sent to NID 0 with BLOCK_ACK is a group store: 2 more bytes after the registers (1-7 of
+them), low byte first, are a bitmap of the members, bit n = node n << 4.  Only the members store,
+and each clears its bit as it does, so the bits left when the frame comes back are the members
+that didn't.  A plain store to NID 0 goes to every node and nothing comes back to say so.
+
+EXT_REPORT, a change report riding on an empty frame the Ringmaster keeps sending around:
+0x00:	Low byte of the register value
+0x01:	High byte of the register value
+0x02:	EXT_REPORT
+0x03:	source, NID + registerID of the value, 0 = empty
+0x04:	crc
+A node fills the first empty report frame passing by when a watched register has changed by at
+least its threshold since the Ringmaster last saw it.  A damaged report frame is emptied with
+source REPORT_DAMAGED, the report it carried is gone.
+
+EXT_CONTROL, node settings that aren't registers:
+0x00:	CTRL_ code
+0x01:	targetID, R/W (not used), registerID, NID 0 = every node
+0x02:	EXT_CONTROL
+0x03:	Low byte of the parameter
+0x04:	High byte of the parameter
+0x05:	crc
+The addressed node replaces the parameter with the previous setting.  Errors as for EXT_BLOCK.
+
+Read-modify-write of a register (Circus.c REGISTER_OPS), CTRL_SET_BITS, CTRL_CLEAR_BITS, CTRL_ADD
+and CTRL_CAS: the node applies the parameter to the register with interrupts off, so nothing the
+node does itself comes in between, and replies with the previous value and CTRL_DONE set in byte 0.
+CTRL_CAS is 2 bytes longer, the value the register has to hold for the store comes after the
+parameter:
+0x05:	Low byte of the expected value
+0x06:	High byte of the expected value
+0x07:	crc
+A node without REGISTER_OPS, or the halves of a COUNTER_32, return the frame unchanged.  NID 0 does
+it on every node and comes back as it went.
+
+Register pages (Circus.c PAGES), CTRL_PAGE: the parameter is the page registers 1 - 6 of every token,
+block frame and gather come from now on, 0 = the CDA; registers 0 and 7 are the same on every
+page.  The node replies with the page it had and CTRL_DONE set in byte 0.  A node without that page
+returns the frame unchanged and stays on its page.  The page holds until the next CTRL_PAGE or a
+reset, so the Ringmaster lets the replies for the node come back before selecting another page and
+doesn't send the node anything more until the CTRL_PAGE frame is back.  Register operations on a
+page are refused.
+
+Changing the ring's baud rate (CTRL_BAUD_CHECK, CTRL_BAUD), the parameter is the rate / 100:
+1.	CTRL_BAUD_CHECK to NID 0, every node that can't run the rate within BAUD_MAX_ERROR (CircusBaud.h)
+	clears the parameter.  It comes back unchanged if the whole ring can switch.
+2.	Let the ring run empty, then send CTRL_BAUD to NID 0 on its own.  Each node forwards it at the
+	old rate and switches once its transmitter is idle.
+3.	When it is back switch the Ringmaster, keep the line idle for IDLE_BYTES byte times at the new
+	rate (DEADTIME milliTics with IDLE_BYTES 0) and a loop() pass of the slowest node, and go on at
+	the new rate.
+Anything else on the ring during step 2 is lost, and so is the ring if the CTRL_BAUD frame is.
+
+EXT_BRIDGE, a token for a node on a sub-ring behind a bridge node (Circus.c, CIRCUS_BRIDGE):
+0x00:	targetID, R/W, registerID on the sub-ring (a plain token's address byte)
+0x01:	bridge NID, R/W (not used), registerID (not used)
+0x02:	EXT_BRIDGE
+0x03:	Low byte of int data
+0x04:	High byte of int data
+0x05:	BRIDGE_ status, the Ringmaster sends BRIDGE_PENDING
+0x06:	crc
+The bridge is the Ringmaster of its sub-ring: it sends bytes 3, 4, 0 there as a plain 4 byte token,
+so the sub-ring nodes don't need to know about bridges, and holds the frame until the token is back.
+Then it copies the reply into bytes 3, 4 and 0 (an error reply changes byte 0 as it would a token's
+address byte), sets the status and forwards the frame.  Errors on the way to the bridge as for
+EXT_BLOCK.  A bridge holds up everything behind a frame that waits for its sub-ring, see
+CircusMaster's bridgeWindow.
+
+EXT_TIME, the Ringmaster's clock for every node (Circus.c, TIME_SYNC):
+0x00:	Low byte of the time into the Tic, in 1/65536 Tic (about 20 microseconds)
+0x01:	High byte
+0x02:	EXT_TIME
+0x03:	Low byte of the Tic
+0x04:	High byte of the Tic
+0x05:	Low byte of the delay, in 8 microsecond steps
+0x06:	High byte of the delay
+0x07:	crc
+The time is the Ringmaster's as the first byte starts out.  Every node adds the time from the start
+of the frame's first byte coming in to the start of its first byte going out to the delay, so a
+node knows the Ringmaster's time as the frame reached it.  A damaged frame is forwarded as it is.
+
+EXT_LATENCY, the node's last forwarding times (Circus.c, LATENCY_SAMPLES):
+0x00:	number of samples, 1-3, the addressed node sets LATENCY_DONE
+0x01:	targetID, R/W, registerID (not used); a store clears the samples once they are in the frame
+0x02:	EXT_LATENCY
+0x03:	Low byte of the frames the node has sampled so far, wraps
+0x04:	High byte
+...		4 bytes per sample, newest first: microseconds from the first byte to the last byte of a frame
+		coming in, then from its last byte in to its first byte out, both low byte first
+last:	crc
+Frames cut through (CUT_THROUGH) aren't sampled, they go out before they are in.  A node without
+LATENCY_SAMPLES returns the frame unchanged.  Errors as for EXT_BLOCK.
+
+EXT_EVENT, the node's scheduled events (Circus.c, EVENTS):
+0x00:	EVENT_ code
+0x01:	targetID, R/W (not used), registerID (not used), NID 0 = every node
+0x02:	EXT_EVENT
+0x03:	event id, 1-255, adding an id the node has replaces it; EVENT_REMOVE id 0 = all of them
+0x04:	action, passed to the sketch's circusEvent()
+0x05:	Low byte of the Tic it is due at
+0x06:	High byte
+0x07:	Low byte of the parameter: Tics between runs (EVENT_EVERY), days (EVENT_DAYS, bit n = a day
+		number that is n mod 7) or the day number (EVENT_DAY)
+0x08:	High byte
+0x09:	crc
+An event is first due the next time Tic reaches 0x05-0x06, today if it is still ahead, else tomorrow.
+The addressed node replaces the code with EVENT_OK, EVENT_FULL or EVENT_NONE and the parameter with
+the number of events it holds; a node without EVENTS returns the frame unchanged.  Errors as for
+EXT_BLOCK.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// crc8 of every frame starts from this, crc8 returns zero if fed zeros (Circus.c: CRCSEED)
+#define TOKEN_CRC_SEED	0x88
+
+// address/command byte
+#define TOKEN_NID_MASK	0xF0
+#define TOKEN_STORE		0x08
+#define TOKEN_REG_MASK	0x07
+
+// Errors are returned by exclusive or-ing the error code with the register nibble changing target node to current node
+#define BUFFER_ERROR 0x0B	// no longer sent, a full fifo drops the token and counts it in _tokenOverflows
+#define CRC_ERROR 0x0C
+#define  UART_ERROR 0x0D	// no longer sent, framing and overrun errors are counted on the diagnostics page
+
+// extended token types, the whole address byte
+#define EXT_IDLE	0x00	// empty 4 byte frame
+#define EXT_BLOCK	0x01
+#define EXT_REPORT	0x02
+#define EXT_EVENT	0x03
+#define EXT_LATENCY	0x04
+#define EXT_CONTROL	0x05
+#define EXT_BRIDGE	0x06
+#define EXT_TIME	0x07
+
+#define REPORT_DAMAGED	0x08	// EXT_REPORT source after a crc error
+#define BLOCK_COUNT		0x0f	// EXT_BLOCK byte 0, number of registers
+#define BLOCK_HIGH		0x10	// EXT_BLOCK byte 0, a gather's slots start at node 0x90
+#define BLOCK_ACK		0x20	// EXT_BLOCK byte 0, a group store, the members bitmap follows the registers
+#define BLOCK_DIAG		0x40	// EXT_BLOCK byte 0, the diagnostics page instead of the CDA
+#define BLOCK_DONE		0x80	// EXT_BLOCK byte 0, the addressed node has answered from its diagnostics page
+#define LATENCY_DONE	0x80	// EXT_LATENCY byte 0, the addressed node has filled in its samples
+
+// EXT_BRIDGE status
+#define BRIDGE_PENDING	0x00	// hasn't been through its bridge, it comes back like that if there is none
+#define BRIDGE_OK		0x01	// bytes 0, 3 and 4 are the sub-ring's reply
+#define BRIDGE_LOST		0x02	// nothing came back from the sub-ring within BRIDGE_TIMEOUT
+#define BRIDGE_DAMAGED	0x03	// the reply failed its crc at the bridge
+#define BRIDGE_ERROR	0x04	// a sub-ring node answered with an error, byte 0 holds its address byte
+
+// diagnostics page registers, counts since the node started or the Ringmaster stored them, they wrap
+#define DIAG_FRAMES		0	// tokens and frames received whole, every ring
+#define DIAG_ANSWERED	1	// tokens and frames this node answered or changed
+#define DIAG_CRC		2	// crc failures, cut-through tokens aren't checked
+#define DIAG_FRAMING	3	// bytes with a framing error (FE0), the stop bit was missing
+#define DIAG_OVERRUNS	4	// bytes after a lost one (DOR0), the RX ISR came too late
+#define DIAG_RESYNCS	5	// frames cut short by the line going quiet, IDLE_BYTES or DEADTIME
+#define DIAG_LATENCY	6	// _maxForwardLatency, 0 unless built with MEASURE_LATENCY
+#define DIAG_OVERFLOWS	7	// _tokenOverflows, tokens dropped because a fifo was full
+
+// EXT_CONTROL codes
+#define CTRL_WATCH		0x01	// parameter = bitmask of watched registers, bit n = register n
+#define CTRL_THRESHOLD	0x02	// parameter = smallest change of the register that is reported, 0 = any change
+#define CTRL_BAUD_CHECK	0x03	// parameter = baud / 100, cleared by nodes that can't run it
+#define CTRL_BAUD		0x04	// parameter = baud / 100, nodes switch once the frame has left them
+#define CTRL_SET_BITS	0x05	// register |= parameter
+#define CTRL_CLEAR_BITS	0x06	// register &= ~parameter
+#define CTRL_ADD		0x07	// register += parameter, two's complement
+#define CTRL_CAS		0x08	// register = parameter if it holds the value in bytes 5 - 6, 8 byte frame
+#define CTRL_PAGE		0x09	// parameter = register page of registers 1 - 6, 0 = the CDA
+#define CTRL_DONE		0x80	// EXT_CONTROL byte 0, the addressed node has done the register operation or CTRL_PAGE
+
+// EXT_EVENT codes, the Ringmaster's and the addressed node's reply
+#define EVENT_ONCE		0x01	// run once
+#define EVENT_EVERY		0x02	// run every parameter Tics, 1 - 65535
+#define EVENT_DAYS		0x03	// run once a day on the days in the parameter
+#define EVENT_REMOVE	0x04	// drop the event
+#define EVENT_DAY		0x05	// today's day number is the parameter, id, action and Tic aren't used
+#define EVENT_OK		0x80	// done
+#define EVENT_FULL		0x81	// no room for another event
+#define EVENT_NONE		0x82	// no event with that id, or not a code the node knows
+
+#define IS_EXTENDED(addr) (!((addr) & (TOKEN_NID_MASK | TOKEN_STORE)))
+
+// largest frame any node has to buffer: EXT_BLOCK with 8 registers
+#define FRAME_MAX	20
+
+#define TIME_LEN	8		// EXT_TIME frame
+#define TIME_DELAY_US	8	// microseconds per step of the EXT_TIME delay
+#define EVENT_LEN	10		// EXT_EVENT frame
+
+/* Length of the frame starting with bytes b0, b1, addr.  A corrupted header can announce a silly
+   length, anything that doesn't fit FRAME_MAX is given 4 bytes; the crc then fails and the node
+   reports it like any damaged token. */
+static inline uint8_t frameLength(uint8_t b0, uint8_t b1, uint8_t addr)
+{
+	(void)b1;
+	switch (addr) {
+	case EXT_BLOCK:
+		if ((b0 & BLOCK_COUNT) >= 1 && (b0 & BLOCK_COUNT) <= ((b0 & BLOCK_ACK) ? 7 : 8))
+			return 4 + 2 * (b0 & BLOCK_COUNT) + ((b0 & BLOCK_ACK) ? 2 : 0);
+		break;
+	case EXT_REPORT:
+		return 5;
+	case EXT_EVENT:
+		return EVENT_LEN;
+	case EXT_LATENCY:
+		if ((b0 & 0x7f) >= 1 && (b0 & 0x7f) <= 3)
+			return 6 + 4 * (b0 & 0x7f);
+		break;
+	case EXT_CONTROL:
+		return (b0 & ~CTRL_DONE) == CTRL_CAS ? 8 : 6;
+	case EXT_BRIDGE:
+		return 7;
+	case EXT_TIME:
+		return TIME_LEN;
+	}
+	return 4;
+}
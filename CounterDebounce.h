@@ -1,19 +1,64 @@
+/* Debounce for up to 8 pins of one port at once, shared by CTic.c and CircusNode.h
+
+Every pin has a 2 bit counter, kept "vertically": bit 0 of all 8 counters in one byte, bit 1 in
+another.  A sample that differs from a pin's debounced state counts it up, one that agrees resets
+it, and after 4 differing samples in a row the pin's state flips.  So a whole port is debounced
+with a handful of byte wide operations per sample, no matter how many of its pins are in use.
+
+The caller samples every DEBOUNCE_TIME / 4 milliTics, so a pin has to hold a new level for about
+DEBOUNCE_TIME milliTics before it counts:
+
+	static Debounce_Port debounced;
+	uint8_t flipped = debouncePort(&debounced, PIND & mask);
+	uint8_t counted = debounceEdges(&debounced, flipped, rise, fall);	// rise/fall: masks of pins
+	if (counted & _BV(5)) CIRCUS_COUNTER++;
+*/
+
+/* Naming Conventions
+* global variables: _camelCase
+* Macro variables: StartCaps	used for macros that simplify long variable names
+* Structures & Unions Start_Caps
+* Macro constants: ALLCAPS
+*/
+
 #pragma once
 
-#include <digitalWriteFast.h>
-#include <Circus.h>
+#include <stdint.h>
+
+#define DEBOUNCE_SAMPLES 4		// agreeing samples before a pin flips, what the 2 bit counters count to
+
+typedef struct {
+	uint8_t state;		// debounced level of every pin
+	uint8_t count0;		// bit 0 of every pin's counter
+	uint8_t count1;		// bit 1
+} Debounce_Port;
 
-#ifdef __cplusplus
-extern "C" {
-#endif
+/*************************************************************************
+Function: debouncePort()
+Purpose:  feed one sample of the port to the 8 counters
+Input:    the port's pins, masked to the ones being debounced
+Returns:  the pins whose debounced state flipped with this sample
+**************************************************************************/
+static inline uint8_t debouncePort(Debounce_Port *d, uint8_t sample)
+{
+	uint8_t delta = sample ^ d->state;		// pins that disagree with their debounced state
+	uint8_t flipped;
 
-void setupCounterDebounce(uint8_t pin, uint8_t pullUp, uint8_t mode){
-	debounce = debounce;
-	_counterPin = pin;
-	pinModeFast(pin, INPUT);
-	digitalWriteFast(pin, pullUp);
+	d->count1 = (d->count1 ^ d->count0) & delta;	// count up where they disagree, reset where they don't
+	d->count0 = ~d->count0 & delta;
+	flipped = delta & ~(d->count0 | d->count1);		// wrapped 3 -> 0, the 4th sample in a row
+	d->state ^= flipped;
+	return flipped;
 }
 
-#ifdef __cplusplus
+/*************************************************************************
+Function: debounceEdges()
+Purpose:  the flipped pins that count
+Input:    flipped: from debouncePort(), rise/fall: pins that count going
+          high/low (a pin in both counts every change)
+Returns:  mask of pins to count
+**************************************************************************/
+static inline uint8_t debounceEdges(const Debounce_Port *d, uint8_t flipped, uint8_t rise, uint8_t fall)
+{
+	return flipped & ((d->state & rise) | (~d->state & fall));
 }
-#endif
@@ -10,7 +10,11 @@ extern "C" {
 #endif
 
 void ISR0() {
+#ifdef COUNTER_32
+	_counter32++;		// Circus.c built with COUNTER_32 as well
+#else
 	CIRCUS_COUNTER++;
+#endif
 }
 
 void setupCounterISR(uint8_t pin, uint8_t pullUp, uint8_t mode){
@@ -0,0 +1,31 @@
+/* A pump controller node described at compile time with CircusNode.h
+ *
+ * Timer 1 switches the pump on at the Tic in CDA[1], timer 2 off at the Tic in CDA[2], both only
+ * while the Ringmaster has their bits set in CDA[0].  A flow meter on pin 5 is debounced and counted
+ * into CDA[5] (CIRCUS_COUNTER), a rain gauge on INT0 (pin 2) into CDA[4].
+ */
+
+#include <Circus.h>
+#include <CircusNode.h>
+
+#define PUMP_PIN 7
+
+static void pumpOn(uint8_t timer)  { digitalWrite(PUMP_PIN, HIGH); }
+static void pumpOff(uint8_t timer) { digitalWrite(PUMP_PIN, LOW); }
+
+struct Pump : CircusNodeDefaults {
+	static const uint8_t Nid = 0x30;
+	static const uint32_t Baud = 9600;
+	static const uint8_t DebounceTime = 16;
+	typedef CircusList<CircusTimer<1, pumpOn>, CircusTimer<2, pumpOff> > Timers;
+	typedef CircusList<CircusDebounce<5, DEBOUNCE_HIGH, 5, true>, CircusCounter<2, FALLING, 4, true> > Counters;
+};
+
+CIRCUS_NODE(Pump)
+
+void setup() {
+	pinMode(PUMP_PIN, OUTPUT);
+}
+
+void loop() {
+}
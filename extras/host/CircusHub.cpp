@@ -0,0 +1,157 @@
+/*************************************************************************
+Title:    CircusHub - one ringmaster for several rings
+File:     extras/host/CircusHub.cpp
+Software: Linux, g++ (C++17)
+License:  GNU General Public License Version 2.0
+
+    See CircusHub.h.
+*************************************************************************/
+
+#include "CircusHub.h"
+
+#include <algorithm>
+
+namespace circus {
+
+CircusHub::CircusHub(const std::vector<Transport *> &rings, const MasterConfig &config)
+{
+	for (size_t r = 0; r < rings.size(); r++) {
+		MasterConfig c = config;
+		c.ring = (uint8_t)r;
+		if (config.onUpdate) {
+			// updates from a sub-ring go out under the sub-ring's number
+			std::function<void(const RegisterUpdate &)> user = config.onUpdate;
+			c.onUpdate = [this, user](const RegisterUpdate &u) {
+				RegisterUpdate v = u;
+				if (u.bridge) {
+					std::lock_guard<std::mutex> lock(_mutex);
+					for (size_t k = 0; k < _routes.size(); k++)
+						if (_routes[k].master == u.ring && _routes[k].bridge == u.bridge)
+							v.ring = (uint8_t)k;
+					v.bridge = 0;
+				}
+				user(v);
+			};
+		}
+		_routes.push_back({r, 0});
+		_rings.emplace_back(new CircusMaster(*rings[r], c));
+	}
+}
+
+size_t CircusHub::size() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _routes.size();
+}
+
+size_t CircusHub::addBridge(size_t parent, uint8_t bridge)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	if (parent >= _routes.size() || _routes[parent].bridge)
+		throw std::out_of_range("addBridge: the parent has to be a ring of the hub, bridges don't nest");
+	if (!(bridge & TOKEN_NID_MASK))
+		throw std::invalid_argument("addBridge: the bridge is a node, not NID 0");
+	_routes.push_back({parent, (uint8_t)(bridge & TOKEN_NID_MASK)});
+	return _routes.size() - 1;
+}
+
+CircusHub::Route CircusHub::route(size_t r) const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _routes.at(r);
+}
+
+CircusMaster &CircusHub::ring(size_t r)
+{
+	return *_rings[route(r).master];
+}
+
+CircusMaster &CircusHub::direct(size_t r)
+{
+	Route to = route(r);
+	if (to.bridge)
+		throw std::invalid_argument("only plain tokens go through bridges");
+	return *_rings[to.master];
+}
+
+std::future<uint16_t> CircusHub::read(size_t r, uint8_t nid, uint8_t reg)
+{
+	Route to = route(r);
+	CircusMaster &m = *_rings[to.master];
+	return to.bridge ? m.bridgedRead(to.bridge, nid, reg) : m.read(nid, reg);
+}
+
+std::future<uint16_t> CircusHub::write(size_t r, uint8_t nid, uint8_t reg, uint16_t value)
+{
+	Route to = route(r);
+	CircusMaster &m = *_rings[to.master];
+	return to.bridge ? m.bridgedWrite(to.bridge, nid, reg, value) : m.write(nid, reg, value);
+}
+
+std::future<uint32_t> CircusHub::readCounter(size_t r, uint8_t nid, uint8_t reg)
+{
+	Route to = route(r);
+	CircusMaster &m = *_rings[to.master];
+	if (!to.bridge)
+		return m.readCounter(nid, reg);
+	// no blocks through a bridge: the low half latches the count, the high half is read once it's in
+	std::future<uint16_t> low = m.bridgedRead(to.bridge, nid, reg);
+	return std::async(std::launch::deferred, [&m, to, nid, reg, low = std::move(low)]() mutable {
+		uint16_t lo = low.get();
+		return (uint32_t)m.bridgedRead(to.bridge, nid, (uint8_t)(reg + 1)).get() << 16 | lo;
+	});
+}
+
+void CircusHub::hold(bool on)
+{
+	for (auto &m : _rings) m->hold(on);
+}
+
+void CircusHub::drain()
+{
+	for (auto &m : _rings) m->drain();
+}
+
+void CircusHub::changeBaud(uint32_t baud)
+{
+	// changeBaud() blocks for a few laps, switch the rings side by side
+	std::vector<std::future<void>> done;
+	for (auto &m : _rings) {
+		CircusMaster *master = m.get();
+		done.push_back(std::async(std::launch::async, [master, baud] { master->changeBaud(baud); }));
+	}
+	for (auto &f : done) f.wait();
+	for (auto &f : done) f.get();
+}
+
+std::vector<std::future<int32_t>> CircusHub::timeHack()
+{
+	std::vector<std::future<int32_t>> lags;
+	for (auto &m : _rings) lags.push_back(m->timeHack());
+	return lags;
+}
+
+MasterStats CircusHub::stats() const
+{
+	MasterStats sum;
+	for (auto &m : _rings) {
+		MasterStats s = m->stats();
+		sum.requests += s.requests;
+		sum.completed += s.completed;
+		sum.failed += s.failed;
+		sum.sent += s.sent;
+		sum.retries += s.retries;
+		sum.timeouts += s.timeouts;
+		sum.lost += s.lost;
+		sum.errorReplies += s.errorReplies;
+		sum.badFrames += s.badFrames;
+		sum.resyncs += s.resyncs;
+		sum.bytesSent += s.bytesSent;
+		sum.reports += s.reports;
+		sum.damagedReports += s.damagedReports;
+		sum.lastReplyUs = std::max(sum.lastReplyUs, s.lastReplyUs);
+	}
+	return sum;
+}
+
+} // namespace circus
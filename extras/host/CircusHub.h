@@ -0,0 +1,106 @@
+/*************************************************************************
+Title:    CircusHub - one ringmaster for several rings
+File:     extras/host/CircusHub.h
+Software: Linux, g++ (C++17)
+License:  GNU General Public License Version 2.0
+
+DESCRIPTION:
+    A Three Ring Circus: one CircusMaster per ring, each with its own
+    worker thread and window, so the rings run side by side and a hub of
+    3 rings moves 3 times the registers of one.  Requests are addressed by
+    (ring, nid, reg) and go to that ring's queue; calls that cover every
+    ring (hold, drain, changeBaud, stats) act on all of them at once.
+
+    The ring number is passed on in MasterConfig::ring, so onUpdate and
+    onReport hooks shared by all rings can tell them apart
+    (RegisterUpdate::ring).
+
+    Sub-rings behind a bridge node (EXT_BRIDGE) get ring numbers of their
+    own from addBridge(), after the rings the hub was built with; their
+    requests travel on the parent ring's CircusMaster.  onUpdate sees them
+    with the sub-ring's number and bridge 0, as if it were a ring of its
+    own.  Blocks, EXT_TIME, EXT_EVENT, EXT_LATENCY, the read-modify-writes and pages don't
+    go through bridges.
+
+USAGE:
+    circus::SerialTransport a("/dev/ttyUSB0", 9600), b("/dev/ttyUSB1", 9600);
+    circus::CircusHub hub({&a, &b});
+    hub.read(1, 0x30, 2).get();			// ring 1, node 0x30, register 2
+    size_t sub = hub.addBridge(0, 0x10);	// node 0x10 of ring 0 bridges to a sub-ring
+    hub.read(sub, 0x30, 2).get();			// node 0x30 on that sub-ring
+*************************************************************************/
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "CircusMaster.h"
+
+namespace circus {
+
+class CircusHub {
+public:
+	explicit CircusHub(const std::vector<Transport *> &rings, const MasterConfig &config = MasterConfig());
+
+	size_t size() const;					// rings, sub-rings included
+	CircusMaster &ring(size_t r);			// the ringmaster ring r's frames go through
+	size_t addBridge(size_t parent, uint8_t bridge);	// ring number of the sub-ring behind node bridge
+
+	std::future<uint16_t> read(size_t r, uint8_t nid, uint8_t reg);
+	std::future<uint16_t> write(size_t r, uint8_t nid, uint8_t reg, uint16_t value);
+	std::future<std::vector<uint16_t>> readBlock(size_t r, uint8_t nid, uint8_t reg, uint8_t count)
+		{ return direct(r).readBlock(nid, reg, count); }
+	std::future<std::vector<uint16_t>> writeBlock(size_t r, uint8_t nid, uint8_t reg, const std::vector<uint16_t> &values)
+		{ return direct(r).writeBlock(nid, reg, values); }
+	std::future<std::vector<uint16_t>> gather(size_t r, uint8_t reg, uint8_t count = 15)
+		{ return direct(r).gather(reg, count); }
+	std::future<uint16_t> writeGroup(size_t r, uint16_t members, uint8_t reg, const std::vector<uint16_t> &values)
+		{ return direct(r).writeGroup(members, reg, values); }
+	std::future<uint32_t> readCounter(size_t r, uint8_t nid, uint8_t reg);	// two reads on a sub-ring
+	std::future<uint16_t> scheduleOnce(size_t r, uint8_t nid, uint8_t id, uint8_t action, uint16_t tic)
+		{ return direct(r).scheduleOnce(nid, id, action, tic); }
+	std::future<uint16_t> scheduleEvery(size_t r, uint8_t nid, uint8_t id, uint8_t action, uint16_t tic, uint16_t tics)
+		{ return direct(r).scheduleEvery(nid, id, action, tic, tics); }
+	std::future<uint16_t> scheduleDays(size_t r, uint8_t nid, uint8_t id, uint8_t action, uint16_t tic, uint8_t days)
+		{ return direct(r).scheduleDays(nid, id, action, tic, days); }
+	std::future<uint16_t> unschedule(size_t r, uint8_t nid, uint8_t id) { return direct(r).unschedule(nid, id); }
+	std::future<uint16_t> setDay(size_t r, uint8_t nid, uint16_t day) { return direct(r).setDay(nid, day); }
+	std::future<uint16_t> setBits(size_t r, uint8_t nid, uint8_t reg, uint16_t mask)
+		{ return direct(r).setBits(nid, reg, mask); }
+	std::future<uint16_t> clearBits(size_t r, uint8_t nid, uint8_t reg, uint16_t mask)
+		{ return direct(r).clearBits(nid, reg, mask); }
+	std::future<uint16_t> add(size_t r, uint8_t nid, uint8_t reg, int16_t delta) { return direct(r).add(nid, reg, delta); }
+	std::future<uint16_t> compareAndSwap(size_t r, uint8_t nid, uint8_t reg, uint16_t expected, uint16_t value)
+		{ return direct(r).compareAndSwap(nid, reg, expected, value); }
+	std::future<uint16_t> selectPage(size_t r, uint8_t nid, uint8_t page) { return direct(r).selectPage(nid, page); }
+	std::future<std::vector<uint16_t>> readPage(size_t r, uint8_t nid, uint8_t page)
+		{ return direct(r).readPage(nid, page); }
+	std::future<std::vector<uint16_t>> writePage(size_t r, uint8_t nid, uint8_t page, uint8_t reg,
+		const std::vector<uint16_t> &values) { return direct(r).writePage(nid, page, reg, values); }
+	std::future<NodeHealth> health(size_t r, uint8_t nid, bool clear = false) { return direct(r).health(nid, clear); }
+	std::future<LatencySamples> latency(size_t r, uint8_t nid, uint8_t count = 3, bool clear = false)
+		{ return direct(r).latency(nid, count, clear); }
+
+	void hold(bool on);				// every ring, e.g. queue a poll of all of them before any starts
+	void drain();
+	void changeBaud(uint32_t baud);	// every ring at once, throws the first ring's error
+	std::vector<std::future<int32_t>> timeHack();	// every ring, not the sub-rings
+	MasterStats stats() const;		// summed over the rings, lastReplyUs is the latest
+
+private:
+	struct Route {
+		size_t master;			// index into _rings
+		uint8_t bridge;			// NID of the bridge, 0 = the ring itself
+	};
+
+	Route route(size_t r) const;
+	CircusMaster &direct(size_t r);	// throws for sub-rings
+
+	std::vector<std::unique_ptr<CircusMaster>> _rings;
+	mutable std::mutex _mutex;			// _routes, onUpdate looks them up on the worker threads
+	std::vector<Route> _routes;
+};
+
+} // namespace circus
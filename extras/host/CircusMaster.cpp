@@ -0,0 +1,1102 @@
+/*************************************************************************
+Title:    CircusMaster - host side ringmaster
+File:     extras/host/CircusMaster.cpp
+Software: Linux, g++ (C++17)
+License:  GNU General Public License Version 2.0
+
+    See CircusMaster.h.  One worker thread owns the transport; the public
+    calls only queue requests under _mutex.
+*************************************************************************/
+
+#include "CircusMaster.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include <CircusCrc.h>
+
+namespace circus {
+
+static uint8_t frameCrc(const uint8_t *frame, size_t len)
+{
+	uint8_t crc = TOKEN_CRC_SEED;
+	for (size_t i = 0; i + 1 < len; i++)
+		crc = crc8(frame[i], crc);
+	return crc;
+}
+
+static bool isErrorCode(uint8_t code)
+{
+	return code == CRC_ERROR || code == BUFFER_ERROR || code == UART_ERROR;
+}
+
+/*************************************************************************
+Class:    SerialTransport
+**************************************************************************/
+static speed_t speedFor(uint32_t baud)
+{
+	switch (baud) {
+	case 1200: return B1200;
+	case 2400: return B2400;
+	case 4800: return B4800;
+	case 9600: return B9600;
+	case 19200: return B19200;
+	case 38400: return B38400;
+	case 57600: return B57600;
+	case 115200: return B115200;
+	case 230400: return B230400;
+	case 460800: return B460800;
+	case 500000: return B500000;
+	case 1000000: return B1000000;
+	case 2000000: return B2000000;
+	}
+	throw std::invalid_argument("unsupported baud rate " + std::to_string(baud));
+}
+
+SerialTransport::SerialTransport(const std::string &path, uint32_t baud) : _baud(baud)
+{
+	speed_t speed = speedFor(baud);
+	_fd = open(path.c_str(), O_RDWR | O_NOCTTY | O_CLOEXEC);
+	if (_fd < 0)
+		throw std::runtime_error(path + ": " + strerror(errno));
+	if (isatty(_fd)) {
+		struct termios tio;
+		if (tcgetattr(_fd, &tio) == 0) {
+			cfmakeraw(&tio);
+			tio.c_cflag |= CLOCAL | CREAD;
+			tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+			tio.c_cc[VMIN] = 0;
+			tio.c_cc[VTIME] = 0;
+			cfsetispeed(&tio, speed);
+			cfsetospeed(&tio, speed);
+			tcsetattr(_fd, TCSANOW, &tio);
+			tcflush(_fd, TCIOFLUSH);
+		}
+	}
+}
+
+void SerialTransport::setBaud(uint32_t baud)
+{
+	speed_t speed = speedFor(baud);
+	struct termios tio;
+	if (isatty(_fd) && tcgetattr(_fd, &tio) == 0) {
+		tcdrain(_fd);
+		cfsetispeed(&tio, speed);
+		cfsetospeed(&tio, speed);
+		tcsetattr(_fd, TCSANOW, &tio);
+	}
+	_baud = baud;
+}
+
+SerialTransport::~SerialTransport()
+{
+	close(_fd);
+}
+
+void SerialTransport::write(const uint8_t *data, size_t len)
+{
+	while (len) {
+		ssize_t n = ::write(_fd, data, len);
+		if (n < 0) {
+			if (errno == EINTR || errno == EAGAIN) continue;
+			throw std::runtime_error(std::string("serial write: ") + strerror(errno));
+		}
+		data += n;
+		len -= (size_t)n;
+	}
+}
+
+size_t SerialTransport::read(uint8_t *buf, size_t len, uint32_t waitUs)
+{
+	struct pollfd p = {_fd, POLLIN, 0};
+	if (poll(&p, 1, (int)((waitUs + 999) / 1000)) <= 0)
+		return 0;
+	ssize_t n = ::read(_fd, buf, len);
+	return n > 0 ? (size_t)n : 0;
+}
+
+uint64_t SerialTransport::nowUs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*************************************************************************
+Class:    CircusMaster
+**************************************************************************/
+CircusMaster::CircusMaster(Transport &transport, const MasterConfig &config)
+	: _transport(transport), _config(config)
+{
+	if (!_config.window) _config.window = 1;
+	_held = _config.held;
+	std::fill(_page, _page + 16, -1);
+	_byteUs = (uint32_t)(10000000ull / _transport.baud()) + 1;
+	_worker = std::thread([this] { run(); });
+}
+
+CircusMaster::~CircusMaster()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_wake.notify_all();
+	_worker.join();
+}
+
+std::future<uint16_t> CircusMaster::read(uint8_t nid, uint8_t reg)
+{
+	if (!(nid & TOKEN_NID_MASK))
+		throw std::invalid_argument("read: NID 0 would be an extended token");
+	Request r{};
+	r.len = 4;
+	r.frame[2] = (uint8_t)((nid & TOKEN_NID_MASK) | (reg & TOKEN_REG_MASK));
+	r.frame[3] = frameCrc(r.frame, 4);
+	std::future<uint16_t> f = r.single.get_future();
+	submit(std::move(r));
+	return f;
+}
+
+std::future<uint16_t> CircusMaster::write(uint8_t nid, uint8_t reg, uint16_t value)
+{
+	Request r{};
+	r.len = 4;
+	r.frame[0] = (uint8_t)value;
+	r.frame[1] = (uint8_t)(value >> 8);
+	r.frame[2] = (uint8_t)((nid & TOKEN_NID_MASK) | TOKEN_STORE | (reg & TOKEN_REG_MASK));
+	r.frame[3] = frameCrc(r.frame, 4);
+	std::future<uint16_t> f = r.single.get_future();
+	submit(std::move(r));
+	return f;
+}
+
+std::future<uint16_t> CircusMaster::bridgedRead(uint8_t bridge, uint8_t nid, uint8_t reg)
+{
+	if (!(nid & TOKEN_NID_MASK))
+		throw std::invalid_argument("bridgedRead: NID 0 would be an extended token");
+	return bridged(bridge, (uint8_t)((nid & TOKEN_NID_MASK) | (reg & TOKEN_REG_MASK)), 0);
+}
+
+std::future<uint16_t> CircusMaster::bridgedWrite(uint8_t bridge, uint8_t nid, uint8_t reg, uint16_t value)
+{
+	return bridged(bridge, (uint8_t)((nid & TOKEN_NID_MASK) | TOKEN_STORE | (reg & TOKEN_REG_MASK)), value);
+}
+
+std::future<uint16_t> CircusMaster::bridged(uint8_t bridge, uint8_t addr, uint16_t value)
+{
+	if (!(bridge & TOKEN_NID_MASK))
+		throw std::invalid_argument("bridged: the bridge is a node, not NID 0");
+	Request r{};
+	r.len = 7;
+	r.frame[0] = addr;
+	r.frame[1] = (uint8_t)(bridge & TOKEN_NID_MASK);
+	r.frame[2] = EXT_BRIDGE;
+	r.frame[3] = (uint8_t)value;
+	r.frame[4] = (uint8_t)(value >> 8);
+	r.frame[5] = BRIDGE_PENDING;
+	r.frame[6] = frameCrc(r.frame, 7);
+	std::future<uint16_t> f = r.single.get_future();
+	submit(std::move(r));
+	return f;
+}
+
+std::future<std::vector<uint16_t>> CircusMaster::readBlock(uint8_t nid, uint8_t reg, uint8_t count)
+{
+	return block(nid, reg, std::vector<uint16_t>(count), false);
+}
+
+std::future<std::vector<uint16_t>> CircusMaster::writeBlock(uint8_t nid, uint8_t reg, const std::vector<uint16_t> &values)
+{
+	return block(nid, reg, values, true);
+}
+
+std::future<uint32_t> CircusMaster::readCounter(uint8_t nid, uint8_t reg)
+{
+	std::shared_future<std::vector<uint16_t>> halves = readBlock(nid, reg, 2);
+	return std::async(std::launch::deferred, [halves] {
+		const std::vector<uint16_t> &v = halves.get();
+		return (uint32_t)v[1] << 16 | v[0];
+	});
+}
+
+std::future<std::vector<uint16_t>> CircusMaster::gather(uint8_t reg, uint8_t count)
+{
+	if (count < 1 || count > 15)
+		throw std::invalid_argument("gather: 1 to 15 nodes");
+	if (count <= 8)
+		return gatherFrame(reg, false, count);
+	std::shared_future<std::vector<uint16_t>> low = gatherFrame(reg, false, 8);
+	std::shared_future<std::vector<uint16_t>> high = gatherFrame(reg, true, (uint8_t)(count - 8));
+	return std::async(std::launch::deferred, [low, high] {
+		std::vector<uint16_t> v = low.get();
+		const std::vector<uint16_t> &h = high.get();
+		v.insert(v.end(), h.begin(), h.end());
+		return v;
+	});
+}
+
+std::future<std::vector<uint16_t>> CircusMaster::gatherFrame(uint8_t reg, bool high, uint8_t count)
+{
+	Request r{};
+	r.len = (uint8_t)(4 + 2 * count);
+	r.frame[0] = (uint8_t)(count | (high ? BLOCK_HIGH : 0));
+	r.frame[1] = (uint8_t)(reg & TOKEN_REG_MASK);		// a get sent to NID 0
+	r.frame[2] = EXT_BLOCK;
+	r.frame[r.len - 1] = frameCrc(r.frame, r.len);
+	std::future<std::vector<uint16_t>> f = r.block.get_future();
+	submit(std::move(r));
+	return f;
+}
+
+std::future<uint16_t> CircusMaster::writeGroup(uint16_t members, uint8_t reg, const std::vector<uint16_t> &values)
+{
+	if (values.empty() || values.size() > 7)
+		throw std::invalid_argument("writeGroup: 1 to 7 registers");
+	if (!members || (members & 1))
+		throw std::invalid_argument("writeGroup: members are nodes 0x10 - 0xF0, bits 1 - 15");
+	Request r{};
+	r.len = (uint8_t)(6 + 2 * values.size());
+	r.frame[0] = (uint8_t)(values.size() | BLOCK_ACK);
+	r.frame[1] = (uint8_t)(TOKEN_STORE | (reg & TOKEN_REG_MASK));		// a store sent to NID 0
+	r.frame[2] = EXT_BLOCK;
+	for (size_t i = 0; i < values.size(); i++) {
+		r.frame[3 + 2 * i] = (uint8_t)values[i];
+		r.frame[4 + 2 * i] = (uint8_t)(values[i] >> 8);
+	}
+	r.frame[r.len - 3] = (uint8_t)members;
+	r.frame[r.len - 2] = (uint8_t)(members >> 8);
+	r.frame[r.len - 1] = frameCrc(r.frame, r.len);
+	std::future<uint16_t> f = r.single.get_future();
+	submit(std::move(r));
+	return f;
+}
+
+std::future<std::vector<uint16_t>> CircusMaster::block(uint8_t nid, uint8_t reg, const std::vector<uint16_t> &values, bool store)
+{
+	if (values.empty() || values.size() > 8)
+		throw std::invalid_argument("block: 1 to 8 registers");
+	if (!store && !(nid & TOKEN_NID_MASK))
+		throw std::invalid_argument("block: NID 0 can only store");
+	Request r{};
+	r.len = (uint8_t)(4 + 2 * values.size());
+	r.frame[0] = (uint8_t)values.size();
+	r.frame[1] = (uint8_t)((nid & TOKEN_NID_MASK) | (store ? TOKEN_STORE : 0) | (reg & TOKEN_REG_MASK));
+	r.frame[2] = EXT_BLOCK;
+	for (size_t i = 0; i < values.size(); i++) {
+		r.frame[3 + 2 * i] = (uint8_t)values[i];
+		r.frame[4 + 2 * i] = (uint8_t)(values[i] >> 8);
+	}
+	r.frame[r.len - 1] = frameCrc(r.frame, r.len);
+	std::future<std::vector<uint16_t>> f = r.block.get_future();
+	submit(std::move(r));
+	return f;
+}
+
+std::future<uint16_t> CircusMaster::watch(uint8_t nid, uint8_t mask)
+{
+	return control(CTRL_WATCH, nid, 0, mask);
+}
+
+std::future<uint16_t> CircusMaster::threshold(uint8_t nid, uint8_t reg, uint16_t change)
+{
+	return control(CTRL_THRESHOLD, nid, reg, change);
+}
+
+std::future<uint16_t> CircusMaster::setBits(uint8_t nid, uint8_t reg, uint16_t mask)
+{
+	return modify(CTRL_SET_BITS, nid, reg, mask);
+}
+
+std::future<uint16_t> CircusMaster::clearBits(uint8_t nid, uint8_t reg, uint16_t mask)
+{
+	return modify(CTRL_CLEAR_BITS, nid, reg, mask);
+}
+
+std::future<uint16_t> CircusMaster::add(uint8_t nid, uint8_t reg, int16_t delta)
+{
+	return modify(CTRL_ADD, nid, reg, (uint16_t)delta);
+}
+
+std::future<uint16_t> CircusMaster::compareAndSwap(uint8_t nid, uint8_t reg, uint16_t expected, uint16_t value)
+{
+	return modify(CTRL_CAS, nid, reg, value, expected);
+}
+
+std::future<uint16_t> CircusMaster::selectPage(uint8_t nid, uint8_t page)
+{
+	std::lock_guard<std::mutex> order(_pageOrder);
+	return control(CTRL_PAGE, nid, 0, page);
+}
+
+std::future<std::vector<uint16_t>> CircusMaster::readPage(uint8_t nid, uint8_t page)
+{
+	return paged(nid, page, 1, std::vector<uint16_t>(6), false);
+}
+
+std::future<std::vector<uint16_t>> CircusMaster::writePage(uint8_t nid, uint8_t page, uint8_t reg,
+	const std::vector<uint16_t> &values)
+{
+	return paged(nid, page, reg, values, true);
+}
+
+std::future<std::vector<uint16_t>> CircusMaster::paged(uint8_t nid, uint8_t page, uint8_t reg,
+	const std::vector<uint16_t> &values, bool store)
+{
+	if (!(nid & TOKEN_NID_MASK))
+		throw std::invalid_argument("paged: NID 0 can't be on a page the ringmaster knows");
+	if (reg < 1 || values.empty() || reg + values.size() > 7)
+		throw std::invalid_argument("paged: registers 1 - 6");
+	std::lock_guard<std::mutex> order(_pageOrder);
+	bool select;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		select = _page[nid >> 4] != page;
+	}
+	if (select) control(CTRL_PAGE, nid, 0, page);	// its failure fails the block frame too
+	return block(nid, reg, values, store);
+}
+
+std::future<int32_t> CircusMaster::timeHack()
+{
+	Request r{};
+	r.len = TIME_LEN;
+	r.frame[2] = EXT_TIME;		// the time goes in as it is sent
+	std::future<int32_t> f = r.lag.get_future();
+	submit(std::move(r));
+	return f;
+}
+
+std::future<uint16_t> CircusMaster::scheduleOnce(uint8_t nid, uint8_t id, uint8_t action, uint16_t tic)
+{
+	return event(EVENT_ONCE, nid, id, action, tic, 0);
+}
+
+std::future<uint16_t> CircusMaster::scheduleEvery(uint8_t nid, uint8_t id, uint8_t action, uint16_t tic, uint16_t tics)
+{
+	if (!tics)
+		throw std::invalid_argument("scheduleEvery: every 0 Tics");
+	return event(EVENT_EVERY, nid, id, action, tic, tics);
+}
+
+std::future<uint16_t> CircusMaster::scheduleDays(uint8_t nid, uint8_t id, uint8_t action, uint16_t tic, uint8_t days)
+{
+	if (!(days & 0x7f))
+		throw std::invalid_argument("scheduleDays: no days, bit 0 - 6");
+	return event(EVENT_DAYS, nid, id, action, tic, days & 0x7f);
+}
+
+std::future<uint16_t> CircusMaster::unschedule(uint8_t nid, uint8_t id)
+{
+	return event(EVENT_REMOVE, nid, id, 0, 0, 0);
+}
+
+std::future<uint16_t> CircusMaster::setDay(uint8_t nid, uint16_t day)
+{
+	return event(EVENT_DAY, nid, 0, 0, 0, day);
+}
+
+uint16_t CircusMaster::today()
+{
+	time_t now = time(nullptr);
+	struct tm local;
+	localtime_r(&now, &local);
+	// 4 January 1970 was a Sunday; timegm() of the local date counts whole days whatever the time zone
+	local.tm_hour = 12;
+	local.tm_min = local.tm_sec = 0;
+	return (uint16_t)(timegm(&local) / 86400 - 3);
+}
+
+std::future<NodeHealth> CircusMaster::health(uint8_t nid, bool clear)
+{
+	if (!(nid & TOKEN_NID_MASK))
+		throw std::invalid_argument("health: NID 0 can't answer");
+	Request r{};
+	r.len = 4 + 2 * 8;
+	r.frame[0] = 8 | BLOCK_DIAG;
+	r.frame[1] = (uint8_t)((nid & TOKEN_NID_MASK) | (clear ? TOKEN_STORE : 0));
+	r.frame[2] = EXT_BLOCK;
+	r.frame[r.len - 1] = frameCrc(r.frame, r.len);
+	std::future<NodeHealth> f = r.diag.get_future();
+	submit(std::move(r));
+	return f;
+}
+
+std::future<LatencySamples> CircusMaster::latency(uint8_t nid, uint8_t count, bool clear)
+{
+	if (count < 1 || count > 3)
+		throw std::invalid_argument("latency: 1 - 3 samples a frame");
+	Request r{};
+	r.len = (uint8_t)(6 + 4 * count);
+	r.frame[0] = count;
+	r.frame[1] = (uint8_t)((nid & TOKEN_NID_MASK) | (clear ? TOKEN_STORE : 0));
+	r.frame[2] = EXT_LATENCY;
+	r.frame[r.len - 1] = frameCrc(r.frame, r.len);
+	std::future<LatencySamples> f = r.samples.get_future();
+	submit(std::move(r));
+	return f;
+}
+
+std::future<uint16_t> CircusMaster::event(uint8_t code, uint8_t nid, uint8_t id, uint8_t action, uint16_t tic,
+	uint16_t param)
+{
+	Request r{};
+	r.len = EVENT_LEN;
+	r.frame[0] = code;
+	r.frame[1] = (uint8_t)(nid & TOKEN_NID_MASK);
+	r.frame[2] = EXT_EVENT;
+	r.frame[3] = id;
+	r.frame[4] = action;
+	r.frame[5] = (uint8_t)tic;
+	r.frame[6] = (uint8_t)(tic >> 8);
+	r.frame[7] = (uint8_t)param;
+	r.frame[8] = (uint8_t)(param >> 8);
+	r.frame[9] = frameCrc(r.frame, EVENT_LEN);
+	std::future<uint16_t> f = r.single.get_future();
+	submit(std::move(r));
+	return f;
+}
+
+/*************************************************************************
+Function: changeBaud()
+Purpose:  ask every node, switch the ring, then see that it answers at the
+          new rate, see CircusToken.h
+**************************************************************************/
+void CircusMaster::changeBaud(uint32_t baud)
+{
+	uint16_t param = (uint16_t)(baud / 100);
+	if (baud % 100 || !param || baud / 100 > 0xffff)
+		throw std::invalid_argument("changeBaud: the rate goes on the wire in hundreds");
+	if (!control(CTRL_BAUD_CHECK, 0, 0, param).get())
+		throw CircusError(CircusError::Refused, "a node can't run " + std::to_string(baud) + " baud");
+	control(CTRL_BAUD, 0, 0, param, baud).get();
+	control(CTRL_BAUD_CHECK, 0, 0, param).get();	// a node that stayed behind breaks the ring, this times out
+}
+
+std::future<uint16_t> CircusMaster::control(uint8_t code, uint8_t nid, uint8_t reg, uint16_t param, uint32_t baud)
+{
+	Request r{};
+	r.len = 6;
+	r.baud = baud;
+	r.frame[0] = code;
+	r.frame[1] = (uint8_t)((nid & TOKEN_NID_MASK) | (reg & TOKEN_REG_MASK));
+	r.frame[2] = EXT_CONTROL;
+	r.frame[3] = (uint8_t)param;
+	r.frame[4] = (uint8_t)(param >> 8);
+	r.frame[5] = frameCrc(r.frame, 6);
+	std::future<uint16_t> f = r.single.get_future();
+	submit(std::move(r));
+	return f;
+}
+
+std::future<uint16_t> CircusMaster::modify(uint8_t code, uint8_t nid, uint8_t reg, uint16_t param, uint16_t expected)
+{
+	Request r{};
+	r.len = code == CTRL_CAS ? 8 : 6;
+	r.frame[0] = code;
+	r.frame[1] = (uint8_t)((nid & TOKEN_NID_MASK) | (reg & TOKEN_REG_MASK));
+	r.frame[2] = EXT_CONTROL;
+	r.frame[3] = (uint8_t)param;
+	r.frame[4] = (uint8_t)(param >> 8);
+	r.frame[5] = (uint8_t)expected;		// CTRL_CAS, the crc goes over it otherwise
+	r.frame[6] = (uint8_t)(expected >> 8);
+	r.frame[r.len - 1] = frameCrc(r.frame, r.len);
+	std::future<uint16_t> f = r.single.get_future();
+	submit(std::move(r));
+	return f;
+}
+
+void CircusMaster::submit(Request &&r)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_stop)
+			throw CircusError(CircusError::Stopped, "ringmaster stopped");
+		_stats.requests++;
+		if (r.isPage()) {
+			for (uint8_t n = 1; n < 16; n++)
+				if (!r.nid() || r.nid() == n << 4) _page[n] = r.frame[3];
+		}
+		_queue.push_back(std::move(r));
+	}
+	_wake.notify_one();
+}
+
+MasterStats CircusMaster::stats() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _stats;
+}
+
+void CircusMaster::hold(bool on)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_held = on;
+	}
+	_wake.notify_one();
+}
+
+void CircusMaster::drain()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	_idle.wait(lock, [this] { return _queue.empty() && _inFlight.empty(); });
+}
+
+/*************************************************************************
+Function: run()
+Purpose:  worker thread, keeps the window full and reads replies
+**************************************************************************/
+void CircusMaster::run()
+{
+	uint8_t buf[64];
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (!_stop) {
+		bool reporting = _config.reportIntervalMs && !_held;
+		if (_inFlight.empty() && (_queue.empty() || _held)) {
+			if (_queue.empty()) _idle.notify_all();
+			if (!reporting && !(_transport.simulated() && !_held)) {
+				_wake.wait(lock, [this] {
+					return _stop || (!_held && (!_queue.empty() || _config.reportIntervalMs || _transport.simulated()));
+				});
+				continue;
+			}
+		}
+		sendQueued();
+		if (reporting) sendCarrier();
+		lock.unlock();
+		size_t n = _transport.read(buf, sizeof buf, 4 * _byteUs);	// about one token time
+		lock.lock();
+		receive(buf, n);
+		checkTimeouts();
+		if (!_updates.empty()) {
+			std::vector<RegisterUpdate> updates;
+			updates.swap(_updates);
+			lock.unlock();
+			for (const RegisterUpdate &u : updates) {
+				if (_config.onUpdate) _config.onUpdate(u);
+				if (u.report && _config.onReport) _config.onReport(u.nid, u.reg, u.value);
+			}
+			lock.lock();
+		}
+	}
+	for (Request &r : _inFlight) fail(r, CircusError::Stopped);
+	for (Request &r : _queue) fail(r, CircusError::Stopped);
+	_inFlight.clear();
+	_queue.clear();
+	_idle.notify_all();
+}
+
+void CircusMaster::sendQueued()
+{
+	if (_resync && _inFlight.empty() && _carriers.empty()) {
+		_resync = false;
+		_quiet = true;
+		_holdUntilUs = _transport.nowUs() + resyncUs();
+	}
+	if (_held || _resync || _switching || _transport.nowUs() < _holdUntilUs)
+		return;
+	if (_quiet) {	// the line was idle for the whole hold, shorter than receive()'s idle line
+		_quiet = false;
+		_rxIdx = 0;
+		_rxLen = 4;
+	}
+	size_t bridged = 0;
+	for (const Request &r : _inFlight) bridged += r.isBridged();
+	uint16_t held = 0;		// bit n = a request for node n << 4 waits for a CTRL_PAGE frame, and so do the later ones
+	for (size_t i = 0; _inFlight.size() < _config.window && i < _queue.size();) {
+		Request &r = _queue[i];
+		uint8_t n = r.nid() >> 4;
+		if ((held & (n ? 1 << n : 0xffff)) || pageWait(r)) {
+			if (!n || (held |= (uint16_t)(1 << n)) == 0xfffe)
+				break;		// nothing can go past it
+			i++;
+			continue;
+		}
+		// a bridge drops what doesn't fit its fifo while it waits for the sub-ring
+		if ((bridged || r.isBridged()) && _inFlight.size() >= std::max<size_t>(_config.bridgeWindow, 1))
+			break;
+		bridged += r.isBridged();
+		r.bridged = bridged > 0;
+		if (r.baud) {
+			if (!_inFlight.empty() || !_carriers.empty())
+				break;		// CTRL_BAUD goes round on its own
+			_switching = true;
+		}
+		r.attempts++;
+		r.sentUs = _transport.nowUs();
+		r.startUs = lineFree(r.len);
+		if (r.isTime()) stampTime(r, r.startUs);
+		_transport.write(r.frame, r.len);
+		_stats.sent++;
+		_stats.bytesSent += r.len;
+		_inFlight.push_back(std::move(r));
+		_queue.erase(_queue.begin() + i);
+		if (_switching) break;
+	}
+}
+
+/*************************************************************************
+Function: pageWait()
+Purpose:  a CTRL_PAGE frame goes out once the replies for its node are
+          back, and nothing else goes to the node until it is back
+Returns:  true if r has to wait
+**************************************************************************/
+bool CircusMaster::pageWait(const Request &r) const
+{
+	for (const Request &f : _inFlight)
+		if ((r.isPage() || f.isPage()) && (!r.nid() || !f.nid() || r.nid() == f.nid()))
+			return true;
+	return false;
+}
+
+/*************************************************************************
+Function: pageLost()
+Purpose:  a CTRL_PAGE frame failed, the node may be on either page: fail
+          what is queued for it, it would reach the wrong registers
+**************************************************************************/
+void CircusMaster::pageLost(const Request &r, CircusError::Code code)
+{
+	std::vector<Request> behind;
+	for (uint8_t n = 1; n < 16; n++) {
+		if (r.nid() && r.nid() != n << 4) continue;
+		_page[n] = -1;
+		_paged |= (uint16_t)(1 << n);
+	}
+	for (size_t i = 0; i < _queue.size();) {
+		if (!r.nid() || !_queue[i].nid() || _queue[i].nid() == r.nid()) {
+			behind.push_back(std::move(_queue[i]));
+			_queue.erase(_queue.begin() + i);
+		} else {
+			i++;
+		}
+	}
+	for (Request &b : behind) fail(b, code);
+}
+
+/*************************************************************************
+Function: sendCarrier()
+Purpose:  an empty EXT_REPORT frame every reportIntervalMs for the nodes
+          to put their changes in
+**************************************************************************/
+void CircusMaster::sendCarrier()
+{
+	uint64_t now = _transport.nowUs();
+	if (_resync || _switching || now < _holdUntilUs || now < _nextCarrierUs)
+		return;
+	uint8_t frame[5] = {0, 0, EXT_REPORT, 0, 0};
+	frame[4] = frameCrc(frame, 5);
+	lineFree(5);
+	_transport.write(frame, 5);
+	_stats.bytesSent += 5;
+	_carriers.push_back(now);
+	_nextCarrierUs = now + _config.reportIntervalMs * 1000;
+}
+
+/*************************************************************************
+Function: lineFree()
+Purpose:  when a frame written now starts out, after what was written
+          before it; books its own bytes
+Input:    frame length
+Returns:  transport time its first byte starts
+**************************************************************************/
+uint64_t CircusMaster::lineFree(size_t len)
+{
+	uint64_t start = std::max(_transport.nowUs(), _txFreeUs);
+	_txFreeUs = start + len * 10000000ull / _transport.baud();
+	return start;
+}
+
+/*************************************************************************
+Function: stampTime()
+Purpose:  put the time of day at startUs into an EXT_TIME frame, in Tics
+          and 1/65536 Tics, see CircusToken.h
+**************************************************************************/
+void CircusMaster::stampTime(Request &r, uint64_t startUs)
+{
+	uint64_t now = _transport.nowUs();
+	uint64_t us;
+	if (_config.clockUs) {
+		us = _config.clockUs();
+	} else if (_transport.simulated()) {
+		us = now;
+	} else {
+		struct timespec ts;
+		struct tm local;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		localtime_r(&ts.tv_sec, &local);
+		us = ((local.tm_hour * 60ull + local.tm_min) * 60 + local.tm_sec) * 1000000 + ts.tv_nsec / 1000;
+	}
+	us = (us + startUs - now) % 86400000000ull;
+	uint32_t t = (uint32_t)(us * (4294967296.0 / 86400e6));		// 65536 Tics of 65536 parts a day
+	r.frame[0] = (uint8_t)t;
+	r.frame[1] = (uint8_t)(t >> 8);
+	r.frame[3] = (uint8_t)(t >> 16);
+	r.frame[4] = (uint8_t)(t >> 24);
+	r.frame[5] = 0;
+	r.frame[6] = 0;
+	r.frame[TIME_LEN - 1] = frameCrc(r.frame, TIME_LEN);
+}
+
+/*************************************************************************
+Function: receive()
+Purpose:  split the byte stream into frames, an idle line starts a new one
+**************************************************************************/
+void CircusMaster::receive(const uint8_t *data, size_t n)
+{
+	if (!n) return;
+	uint64_t now = _transport.nowUs();
+	// timed out frames may still be going round, misframed; the nodes only resync on an idle line
+	if (_quiet) _holdUntilUs = std::max(_holdUntilUs, now + resyncUs());
+	// usb serial adapters deliver in bursts, don't take their latency for an idle line
+	if (now - _rxLastUs > std::max<uint64_t>(3 * _byteUs, 5000)) {
+		_rxIdx = 0;
+		_rxLen = 4;
+	}
+	_rxLastUs = now;
+	for (size_t i = 0; i < n; i++) {
+		_rx[_rxIdx++] = data[i];
+		if (_rxIdx == 3) _rxLen = frameLength(_rx[0], _rx[1], _rx[2]);
+		if (_rxIdx < _rxLen) continue;
+		handleFrame(_rx, _rxLen);
+		_rxIdx = 0;
+		_rxLen = 4;
+	}
+}
+
+/*************************************************************************
+Function: handleFrame()
+Purpose:  match one reply to the oldest request it can belong to
+**************************************************************************/
+void CircusMaster::handleFrame(const uint8_t *frame, size_t len)
+{
+	if (frameCrc(frame, len) != frame[len - 1]) {
+		_stats.badFrames++;		// its request times out and is retried
+		trouble();
+		return;
+	}
+	if (len == 5 && frame[2] == EXT_REPORT) {
+		handleReport(frame);
+		return;
+	}
+	uint8_t got = len > 4 ? frame[1] : frame[2];
+	for (size_t k = 0; k < _inFlight.size(); k++) {
+		Request &r = _inFlight[k];
+		if (r.len != len || (len > 4 && r.frame[2] != frame[2])) continue;
+		uint8_t code = (uint8_t)((got ^ r.addr()) & 0x0f);
+		bool error = got != r.addr();
+		// an error reply only carries the register nibble, so it is only trusted for the oldest
+		// request; anything later has to match exactly before the ones ahead of it count as lost
+		if (error && (k || !isErrorCode(code))) continue;
+
+		if (error || k) trouble();
+
+		// the ring keeps order, everything sent before this request is gone
+		std::vector<Request> lost;
+		for (size_t i = 0; i < k; i++) lost.push_back(std::move(_inFlight[i]));
+		Request matched = std::move(_inFlight[k]);
+		_inFlight.erase(_inFlight.begin(), _inFlight.begin() + k + 1);
+
+		if (!error && matched.isBridged() && frame[5] != BRIDGE_OK) {
+			bridgeTrouble(std::move(matched), frame);
+		} else if (!error) {
+			complete(matched, frame);
+		} else {
+			_stats.errorReplies++;
+			retry(std::move(matched), code == CRC_ERROR ? CircusError::CrcError
+				: code == BUFFER_ERROR ? CircusError::BufferError : CircusError::UartError);
+		}
+		// pushed to the front of the queue, walk backwards so they keep their order
+		for (size_t i = lost.size(); i-- > 0;) {
+			_stats.lost++;
+			retry(std::move(lost[i]), CircusError::Timeout);
+		}
+		return;
+	}
+	_stats.badFrames++;
+	trouble();
+}
+
+void CircusMaster::handleReport(const uint8_t *frame)
+{
+	if (!_carriers.empty()) _carriers.pop_front();
+	if (frame[3] == REPORT_DAMAGED) {
+		_stats.damagedReports++;
+	} else if (frame[3]) {
+		_stats.reports++;
+		_updates.push_back({(uint8_t)(frame[3] & TOKEN_NID_MASK), (uint8_t)(frame[3] & TOKEN_REG_MASK),
+			(uint16_t)(frame[0] | frame[1] << 8), false, 0, true, _config.ring});
+	}
+}
+
+/*************************************************************************
+Function: trouble()
+Purpose:  a frame went missing or came back damaged, resync the ring if
+          a block frame could have been cut at the wrong length
+**************************************************************************/
+void CircusMaster::trouble()
+{
+	if (_resync) return;
+	if (!_carriers.empty()) {
+		_resync = true;
+		_stats.resyncs++;
+		return;
+	}
+	for (const Request &r : _inFlight) {
+		if (r.len > 4) {
+			_resync = true;
+			_stats.resyncs++;
+			return;
+		}
+	}
+}
+
+void CircusMaster::complete(Request &r, const uint8_t *frame)
+{
+	if (r.isBlock()) {
+		std::vector<uint16_t> values(frame[0] & BLOCK_COUNT);
+		for (size_t i = 0; i < values.size(); i++) {
+			values[i] = (uint16_t)(frame[3 + 2 * i] | frame[4 + 2 * i] << 8);
+			update(r.frame[1], (uint8_t)(r.frame[1] + i), &r.frame[3 + 2 * i], values[i]);
+		}
+		r.block.set_value(std::move(values));
+	} else if (r.isGather()) {
+		uint8_t first = (frame[0] & BLOCK_HIGH) ? 9 : 1;
+		std::vector<uint16_t> values(frame[0] & BLOCK_COUNT);
+		for (size_t i = 0; i < values.size(); i++) {
+			values[i] = (uint16_t)(frame[3 + 2 * i] | frame[4 + 2 * i] << 8);
+			update((uint8_t)((first + i) << 4), r.frame[1], &r.frame[3 + 2 * i], values[i]);
+		}
+		r.block.set_value(std::move(values));
+	} else if (r.isGroup()) {
+		uint16_t members = (uint16_t)(r.frame[r.len - 3] | r.frame[r.len - 2] << 8);
+		uint16_t acked = members & ~(frame[r.len - 3] | frame[r.len - 2] << 8);
+		for (uint8_t n = 1; n < 16 && _config.onUpdate; n++) {
+			if (!(acked & (1 << n))) continue;
+			bool paged = _paged & (1 << n);
+			for (size_t i = 0; i < (size_t)(r.frame[0] & BLOCK_COUNT); i++) {
+				uint16_t value = (uint16_t)(r.frame[3 + 2 * i] | r.frame[4 + 2 * i] << 8);
+				uint8_t reg = (uint8_t)((r.frame[1] + i) & TOKEN_REG_MASK);
+				if (paged && reg && reg < 7) continue;
+				_updates.push_back({(uint8_t)(n << 4), reg, value, true, value,
+					false, _config.ring, 0, true});
+			}
+		}
+		r.single.set_value(acked);
+	} else if (r.isTime()) {
+		// its first byte started back in len byte times ago, the nodes say it took start + delay
+		uint64_t back = _transport.nowUs() - r.len * 10000000ull / _transport.baud();
+		uint64_t delay = (uint64_t)(frame[5] | frame[6] << 8) * TIME_DELAY_US;
+		r.lag.set_value((int32_t)((int64_t)back - (int64_t)(r.startUs + delay)));
+	} else if (r.isHealth()) {
+		if (!(frame[0] & BLOCK_DONE)) {
+			fail(r, CircusError::Refused);		// no node at that NID keeps counters
+			return;
+		}
+		uint16_t v[8];
+		for (size_t i = 0; i < 8; i++)
+			v[i] = (uint16_t)(frame[3 + 2 * i] | frame[4 + 2 * i] << 8);
+		r.diag.set_value({v[DIAG_FRAMES], v[DIAG_ANSWERED], v[DIAG_CRC], v[DIAG_FRAMING], v[DIAG_OVERRUNS],
+			v[DIAG_RESYNCS], v[DIAG_LATENCY], v[DIAG_OVERFLOWS]});
+	} else if (r.isLatency()) {
+		if (!(frame[0] & LATENCY_DONE)) {
+			fail(r, CircusError::Refused);		// no node at that NID keeps samples
+			return;
+		}
+		LatencySamples got;
+		got.taken = (uint16_t)(frame[3] | frame[4] << 8);
+		for (size_t i = 0; i < (size_t)(frame[0] & 0x7f) && i < got.taken; i++)
+			got.samples.push_back({(uint16_t)(frame[5 + 4 * i] | frame[6 + 4 * i] << 8),
+				(uint16_t)(frame[7 + 4 * i] | frame[8 + 4 * i] << 8)});
+		r.samples.set_value(std::move(got));
+	} else if (r.isEvent()) {
+		if (!(r.frame[1] & TOKEN_NID_MASK)) {
+			r.single.set_value(0);		// every node, forwarded as it was
+		} else if (frame[0] != EVENT_OK) {
+			fail(r, CircusError::Refused);		// EVENT_FULL, EVENT_NONE or a node without EVENTS
+			return;
+		} else {
+			r.single.set_value((uint16_t)(frame[7] | frame[8] << 8));
+		}
+	} else if (r.isPage()) {
+		if (!(r.frame[1] & TOKEN_NID_MASK)) {
+			r.single.set_value(0);		// every node, forwarded as it was
+		} else if (!(frame[0] & CTRL_DONE)) {
+			fail(r, CircusError::Refused);		// no such page, or no PAGES
+			return;
+		} else {
+			r.single.set_value((uint16_t)(frame[3] | frame[4] << 8));
+		}
+		for (uint8_t n = 1; n < 16; n++) {
+			if (r.nid() && r.nid() != n << 4) continue;
+			if (r.frame[3]) _paged |= (uint16_t)(1 << n);
+			else _paged &= (uint16_t)~(1 << n);
+		}
+	} else if (r.isModify()) {
+		if (!(r.frame[1] & TOKEN_NID_MASK)) {
+			r.single.set_value(0);		// every node, forwarded as it was
+		} else if (!(frame[0] & CTRL_DONE)) {
+			fail(r, CircusError::Refused);		// no REGISTER_OPS, or a COUNTER_32 half
+			return;
+		} else {
+			uint16_t previous = (uint16_t)(frame[3] | frame[4] << 8);
+			uint16_t param = (uint16_t)(r.frame[3] | r.frame[4] << 8);
+			uint16_t value = r.frame[0] == CTRL_SET_BITS ? previous | param
+				: r.frame[0] == CTRL_CLEAR_BITS ? previous & ~param
+				: r.frame[0] == CTRL_ADD ? (uint16_t)(previous + param)
+				: previous == (uint16_t)(r.frame[5] | r.frame[6] << 8) ? param : previous;
+			uint8_t now[2] = {(uint8_t)value, (uint8_t)(value >> 8)};
+			update((uint8_t)(r.frame[1] | TOKEN_STORE), r.frame[1], now, previous);
+			r.single.set_value(previous);
+		}
+	} else if (r.isBridged()) {
+		uint16_t reply = (uint16_t)(frame[3] | frame[4] << 8);
+		update(r.frame[0], r.frame[0], &r.frame[3], reply, r.frame[1]);
+		r.single.set_value(reply);
+	} else if (r.len > 4) {
+		if (r.baud) {	// every node has seen it, give the last ones time to switch
+			_transport.setBaud(r.baud);
+			_byteUs = (uint32_t)(10000000ull / r.baud) + 1;
+			_holdUntilUs = _transport.nowUs() + _config.resyncMs * 1000;
+			_switching = false;
+		}
+		r.single.set_value((uint16_t)(frame[3] | frame[4] << 8));	// EXT_CONTROL
+	} else {
+		uint16_t reply = (uint16_t)(frame[0] | frame[1] << 8);
+		update(r.frame[2], r.frame[2], r.frame, reply);
+		r.single.set_value(reply);
+	}
+	_stats.completed++;
+	_stats.lastReplyUs = _transport.nowUs();
+}
+
+/*************************************************************************
+Function: update()
+Purpose:  queue what a reply says about one register for onUpdate
+Input:    address byte of the request, register (low 3 bits), the data
+          that was sent, the reply
+**************************************************************************/
+void CircusMaster::update(uint8_t addr, uint8_t reg, const uint8_t *sent, uint16_t reply, uint8_t bridge)
+{
+	if (!_config.onUpdate) return;
+	reg &= TOKEN_REG_MASK;
+	if (!bridge && reg && reg < 7 && (_paged & ((addr & TOKEN_NID_MASK) ? 1 << (addr >> 4) : 0xfffe)))
+		return;		// a page's, not the CDA's
+	RegisterUpdate u = {(uint8_t)(addr & TOKEN_NID_MASK), (uint8_t)(reg & TOKEN_REG_MASK), reply, false, 0, false,
+		_config.ring, bridge};
+	if (addr & TOKEN_STORE) {
+		u.store = true;
+		u.previous = reply;
+		u.value = (uint16_t)(sent[0] | sent[1] << 8);
+	}
+	_updates.push_back(u);
+}
+
+/*************************************************************************
+Function: bridgeTrouble()
+Purpose:  an EXT_BRIDGE frame made it round the ring but not through its
+          sub-ring, the status says why
+**************************************************************************/
+void CircusMaster::bridgeTrouble(Request &&r, const uint8_t *frame)
+{
+	uint8_t code = (uint8_t)((frame[0] ^ r.frame[0]) & 0x0f);
+	switch (frame[5]) {
+	case BRIDGE_PENDING:		// went all the way round, nobody at that NID bridges
+		fail(r, CircusError::NoBridge);
+		break;
+	case BRIDGE_LOST:
+		_stats.timeouts++;
+		retry(std::move(r), CircusError::Timeout);
+		break;
+	case BRIDGE_ERROR:			// a sub-ring node's error reply, the code is in the address byte as usual
+		_stats.errorReplies++;
+		retry(std::move(r), code == BUFFER_ERROR ? CircusError::BufferError
+			: code == UART_ERROR ? CircusError::UartError : CircusError::CrcError);
+		break;
+	default:					// BRIDGE_DAMAGED
+		_stats.errorReplies++;
+		retry(std::move(r), CircusError::CrcError);
+		break;
+	}
+}
+
+void CircusMaster::retry(Request &&r, CircusError::Code why)
+{
+	if (r.baud) _switching = false;
+	if (r.attempts > _config.retries || r.baud) {	// a lost CTRL_BAUD may have moved part of the ring already
+		fail(r, why);
+		return;
+	}
+	_stats.retries++;
+	_queue.push_front(std::move(r));
+}
+
+void CircusMaster::fail(Request &r, CircusError::Code code)
+{
+	static const char *const what[] = {"timeout", "CRC_ERROR reply", "BUFFER_ERROR reply", "UART_ERROR reply",
+		"ringmaster stopped", "refused", "no bridge"};
+	char msg[64];
+	snprintf(msg, sizeof msg, "%s for address 0x%02X", what[code], r.addr());
+	std::exception_ptr e = std::make_exception_ptr(CircusError(code, msg));
+	if (r.isBlock() || r.isGather()) r.block.set_exception(e);
+	else if (r.isTime()) r.lag.set_exception(e);
+	else if (r.isLatency()) r.samples.set_exception(e);
+	else if (r.isHealth()) r.diag.set_exception(e);
+	else r.single.set_exception(e);
+	_stats.failed++;
+	if (r.isPage() && !_stop) pageLost(r, code);
+}
+
+void CircusMaster::checkTimeouts()
+{
+	uint64_t now = _transport.nowUs();
+	// a report frame is only ever late by the frames sent after it, anything older is gone
+	while (!_carriers.empty() && now - _carriers.front() > timeoutUs(5)) {
+		_carriers.pop_front();
+		trouble();
+	}
+	while (!_inFlight.empty() && now - _inFlight.front().sentUs > timeoutUs(_inFlight.front().len, _inFlight.front().bridged)) {
+		trouble();
+		Request r = std::move(_inFlight.front());
+		_inFlight.pop_front();
+		_stats.timeouts++;
+		retry(std::move(r), CircusError::Timeout);
+	}
+}
+
+/*************************************************************************
+Function: resyncUs()
+Purpose:  how long the line has to be idle after trouble for every node
+          to start framing afresh
+**************************************************************************/
+uint64_t CircusMaster::resyncUs() const
+{
+	return _config.resyncBytes ? _config.resyncBytes * (uint64_t)_byteUs : _config.resyncMs * 1000ull;
+}
+
+/*************************************************************************
+Function: timeoutUs()
+Purpose:  how long an attempt may take: the frames queued ahead of it in
+          the window, two laps of store and forward, plus some slack for
+          busy nodes
+**************************************************************************/
+uint64_t CircusMaster::timeoutUs(size_t len, bool bridged) const
+{
+	if (_config.timeoutMs)
+		return (uint64_t)_config.timeoutMs * 1000;
+	uint64_t lap = (uint64_t)(_config.nodes + 1) * (len * _byteUs + 2000);
+	uint64_t wait = 2 * lap + _config.window * FRAME_MAX * (uint64_t)_byteUs + 20000;
+	if (bridged)	// a bridge answers by itself once its sub-ring has had its time
+		wait += (uint64_t)_config.bridgeWindow * _config.bridgeTimeoutMs * 1000;
+	return wait;
+}
+
+} // namespace circus
@@ -0,0 +1,375 @@
+/*************************************************************************
+Title:    CircusMaster - host side ringmaster
+File:     extras/host/CircusMaster.h
+Software: Linux, g++ (C++17)
+License:  GNU General Public License Version 2.0
+
+DESCRIPTION:
+    Drives a Circus ring from a PC: read()/write() queue a request and
+    return a future, a worker thread keeps up to MasterConfig::window
+    requests on the ring, matches every reply to its request by address
+    byte and retries requests that come back with CRC_ERROR/BUFFER_ERROR/
+    UART_ERROR or never come back.
+
+    A damaged length byte in a block frame leaves the nodes framing at the
+    wrong offset until their input is idle for IDLE_BYTES byte times
+    (Circus.c).  After any trouble while block frames are on the ring the
+    ringmaster stops sending, lets the ring run empty and idles the line
+    for resyncBytes byte times before going on.
+
+    Change reports: watch() tells a node which registers to report and
+    threshold() how much one has to change first.  With reportIntervalMs
+    set the ringmaster sends an empty EXT_REPORT frame that often, nodes
+    fill it with a changed register and MasterConfig::onReport is called
+    with it from the worker thread.  A report lost on the ring is not repeated by the
+    node, only counted in MasterStats::damagedReports when a node saw it
+    go, so read watched registers now and then anyway.
+
+    The ring is first in first out, so a reply that matches a later
+    request means every request sent before it was lost; those are
+    retried right away instead of waiting for their timeout.  Retried
+    requests go out ahead of anything still queued but behind what is
+    already on the ring, so two writes to the same register should wait
+    for each other if their order matters.
+
+    Bridges: bridgedRead()/bridgedWrite() reach a node on the sub-ring
+    behind a bridge node (EXT_BRIDGE, see CircusToken.h).  The bridge holds
+    the frame, and everything behind it, until the sub-ring has answered, so
+    while one is out no more than bridgeWindow frames go on the ring; that
+    is as many as the bridge can hold.  CircusHub gives every sub-ring a
+    ring number of its own.
+
+    changeBaud() moves the ring and the transport to another rate, e.g.
+    from 9600 to 250000 after power up; the nodes come up at their
+    sketch's BAUD again after a reset.
+
+    timeHack() sends the time of day (MasterConfig::clockUs) round in an
+    EXT_TIME frame, stamped for the moment its first byte starts out.  The
+    nodes take the ring's delay out and slew their clocks to it (Circus.c,
+    TIME_SYNC); after two of them they have their crystal's drift too, so a
+    few a day keep them within a milliTic.  A USB serial adapter's latency
+    isn't known and makes every node late by it.
+
+    scheduleOnce()/scheduleEvery()/scheduleDays() give a node built with
+    EVENTS an event to run at a Tic, unschedule() takes it away again.
+    Days are day numbers the node counts on from setDay() at midnight,
+    setDay(0, today()) makes bit 0 of scheduleDays()' days Sunday.
+
+    Register pages (Circus.c PAGES): selectPage() moves registers 1 - 6
+    of a node to one of its pages, readPage()/writePage() select the page
+    first if the node isn't known to be on it.  A CTRL_PAGE frame waits
+    until the replies for its node are back, and the requests for that
+    node queued after it wait until it is; the other nodes' requests go
+    past them.  If it fails so does everything queued for the node after
+    it.  Paged registers aren't passed to onUpdate.  A node comes back on
+    page 0 after a reset, which this ringmaster doesn't see.
+
+    latency() reads how long the last frames took to come into a node
+    and how long it held them before forwarding, from the node's own
+    micros(); read often enough, that is the node's processing time and
+    jitter with the ring in use.
+
+    The wire side is a Transport: SerialTransport for a serial port or a
+    pty (socat pty pairs are handy for testing), SimTransport (see
+    SimTransport.h) for a simulated ring.
+
+USAGE:
+    circus::SerialTransport port("/dev/ttyUSB0", 9600);
+    circus::CircusMaster master(port);
+    std::future<uint16_t> r = master.read(0x10, 3);
+    master.write(0x20, 1, 500).get();	// returns the previous value
+    uint16_t v = r.get();				// throws CircusError on failure
+*************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <CircusToken.h>
+
+namespace circus {
+
+/*************************************************************************
+Class:    Transport
+Purpose:  byte pipe to the ring plus the clock timeouts are measured on
+**************************************************************************/
+class Transport {
+public:
+	virtual ~Transport() {}
+	virtual void write(const uint8_t *data, size_t len) = 0;
+	virtual size_t read(uint8_t *buf, size_t len, uint32_t waitUs) = 0;	// 0 if nothing arrived within waitUs
+	virtual uint64_t nowUs() = 0;
+	virtual uint32_t baud() const = 0;
+	virtual bool simulated() const { return false; }	// time only moves in read(), keep calling it when idle
+	virtual void setBaud(uint32_t baud) { (void)baud; throw std::runtime_error("transport can't change its baud rate"); }
+};
+
+class SerialTransport : public Transport {
+public:
+	SerialTransport(const std::string &path, uint32_t baud);	// 8-N-1 raw, termios is skipped for non ttys
+	~SerialTransport();
+
+	void write(const uint8_t *data, size_t len) override;
+	size_t read(uint8_t *buf, size_t len, uint32_t waitUs) override;
+	uint64_t nowUs() override;
+	uint32_t baud() const override { return _baud; }
+	void setBaud(uint32_t baud) override;		// after what was written has gone out
+
+private:
+	int _fd;
+	uint32_t _baud;
+};
+
+class CircusError : public std::runtime_error {
+public:
+	enum Code { Timeout, CrcError, BufferError, UartError, Stopped, Refused, NoBridge };
+	CircusError(Code code, const std::string &what) : std::runtime_error(what), code(code) {}
+	const Code code;
+};
+
+// a register value the ringmaster learned from a reply or a change report
+struct RegisterUpdate {
+	uint8_t nid;			// 0 = a broadcast store, every node
+	uint8_t reg;
+	uint16_t value;			// what the register holds now
+	bool store;				// written by this ringmaster, previous is the value it replaced
+	uint16_t previous;
+	bool report;			// from an EXT_REPORT frame
+	uint8_t ring;			// MasterConfig::ring of the ringmaster that saw it
+	uint8_t bridge;			// NID of the bridge whose sub-ring the node is on, 0 = on the ring itself
+	bool group;				// a group store the node acked, previous isn't known and is value
+};
+
+// one frame through a node, EXT_LATENCY
+struct LatencySample {
+	uint16_t rxUs;		// first byte to last byte in
+	uint16_t holdUs;	// last byte in to first byte out
+};
+
+struct LatencySamples {
+	uint16_t taken;		// frames the node has sampled since it started or was cleared, wraps
+	std::vector<LatencySample> samples;		// newest first
+};
+
+// a node's diagnostics page (Circus.c DIAGNOSTICS, DIAG_ in CircusToken.h), 16 bit counts that wrap
+struct NodeHealth {
+	uint16_t frames;		// received whole
+	uint16_t answered;
+	uint16_t crcErrors;
+	uint16_t framingErrors;
+	uint16_t overruns;
+	uint16_t resyncs;		// cut short by a quiet line
+	uint16_t maxLatencyUs;	// _maxForwardLatency, 0 unless measured
+	uint16_t overflows;		// _tokenOverflows
+};
+
+struct MasterConfig {
+	size_t window = 16;			// requests on the ring at once, one lap of 15 nodes holds 16 tokens at 9600 baud
+	unsigned retries = 3;		// extra attempts after an error reply or a timeout
+	uint32_t timeoutMs = 0;		// per attempt, 0 = worked out from nodes, window and baud
+	uint8_t nodes = 15;			// ring size, only used for the default timeout
+	uint32_t resyncBytes = 8;	// idle byte times after trouble with block frames, twice the nodes' IDLE_BYTES
+	uint32_t resyncMs = 10;		// idle line after CTRL_BAUD, and after trouble if resyncBytes is 0 (IDLE_BYTES 0 nodes)
+	uint32_t reportIntervalMs = 0;	// send an empty report frame this often, 0 = no change reports
+	// called from the worker thread for every report, must not block; may queue requests
+	std::function<void(uint8_t nid, uint8_t reg, uint16_t value)> onReport;
+	// every register value replies and reports show, same rules as onReport
+	std::function<void(const RegisterUpdate &)> onUpdate;
+	size_t bridgeWindow = 4;	// frames on the ring while an EXT_BRIDGE frame is, the bridges' TOKEN_FIFO
+	uint32_t bridgeTimeoutMs = 130;	// longest a bridge waits for its sub-ring, BRIDGE_TIMEOUT milliTics
+	bool held = false;			// start as if hold(true) had been called
+	uint8_t ring = 0;			// passed on in RegisterUpdate::ring, see CircusHub
+	// microseconds since midnight for timeHack(), not set = the local time, a simulated ring's clock from midnight
+	std::function<uint64_t()> clockUs;
+};
+
+struct MasterStats {
+	uint64_t requests = 0;		// read()/write() calls
+	uint64_t completed = 0;		// futures fulfilled with a value
+	uint64_t failed = 0;		// futures given a CircusError
+	uint64_t sent = 0;			// frames put on the ring, retries included
+	uint64_t retries = 0;
+	uint64_t timeouts = 0;
+	uint64_t lost = 0;			// skipped over by a later reply
+	uint64_t errorReplies = 0;	// CRC_ERROR/BUFFER_ERROR/UART_ERROR from a node
+	uint64_t badFrames = 0;		// bad crc or unmatched, at the ringmaster
+	uint64_t resyncs = 0;
+	uint64_t bytesSent = 0;
+	uint64_t reports = 0;		// filled report frames that came back
+	uint64_t damagedReports = 0;	// emptied by a node after a crc error
+	uint64_t lastReplyUs = 0;	// transport time of the last completed request
+};
+
+class CircusMaster {
+public:
+	explicit CircusMaster(Transport &transport, const MasterConfig &config = MasterConfig());
+	~CircusMaster();		// fails whatever is still queued with CircusError::Stopped
+
+	std::future<uint16_t> read(uint8_t nid, uint8_t reg);
+	std::future<uint16_t> write(uint8_t nid, uint8_t reg, uint16_t value);	// yields the previous value
+
+	// EXT_BLOCK frames, count consecutive registers (wrapping after 7) in one lap
+	std::future<std::vector<uint16_t>> readBlock(uint8_t nid, uint8_t reg, uint8_t count);
+	std::future<std::vector<uint16_t>> writeBlock(uint8_t nid, uint8_t reg, const std::vector<uint16_t> &values);
+	// a 32 bit counter, low half at reg (Circus.c COUNTER_32); one block frame, so both halves are the same count
+	std::future<uint32_t> readCounter(uint8_t nid, uint8_t reg);
+	// EXT_BLOCK gather, register reg of nodes 0x10 up to count (1 - 15) in one lap, two frames past 8 nodes;
+	// a node that isn't there reads 0
+	std::future<std::vector<uint16_t>> gather(uint8_t reg, uint8_t count = 15);
+	// EXT_BLOCK group store, values into registers from reg on of the nodes in members (bit n = node n << 4,
+	// 1 - 7 registers) in one lap; yields the members that stored them
+	std::future<uint16_t> writeGroup(uint16_t members, uint8_t reg, const std::vector<uint16_t> &values);
+
+	// EXT_BRIDGE, a node on the sub-ring behind the bridge node; NoBridge if there is no bridge at that NID
+	std::future<uint16_t> bridgedRead(uint8_t bridge, uint8_t nid, uint8_t reg);
+	std::future<uint16_t> bridgedWrite(uint8_t bridge, uint8_t nid, uint8_t reg, uint16_t value);
+
+	// EXT_CONTROL, both yield the previous setting; NID 0 sets every node and yields value
+	std::future<uint16_t> watch(uint8_t nid, uint8_t mask);		// bit n = report register n
+	std::future<uint16_t> threshold(uint8_t nid, uint8_t reg, uint16_t change);	// 0 = any change
+
+	// EXT_CONTROL read-modify-write of one register (Circus.c REGISTER_OPS), one lap and done in one go at
+	// the node; all yield the previous value, so compareAndSwap() stored value if it yields expected.
+	// Refused if the node can't; NID 0 = every node, yields 0
+	std::future<uint16_t> setBits(uint8_t nid, uint8_t reg, uint16_t mask);
+	std::future<uint16_t> clearBits(uint8_t nid, uint8_t reg, uint16_t mask);
+	std::future<uint16_t> add(uint8_t nid, uint8_t reg, int16_t delta);
+	std::future<uint16_t> compareAndSwap(uint8_t nid, uint8_t reg, uint16_t expected, uint16_t value);
+
+	// EXT_CONTROL CTRL_PAGE (Circus.c PAGES), registers 1 - 6 of the node are page's from then on, 0 = the CDA;
+	// yields the page it had.  Refused if the node has no such page.  NID 0 = every node, yields 0
+	std::future<uint16_t> selectPage(uint8_t nid, uint8_t page);
+	// registers 1 - 6 of a page in one block frame, behind a CTRL_PAGE frame unless the node is on it already
+	std::future<std::vector<uint16_t>> readPage(uint8_t nid, uint8_t page);
+	std::future<std::vector<uint16_t>> writePage(uint8_t nid, uint8_t page, uint8_t reg, const std::vector<uint16_t> &values);
+
+	// EXT_TIME, every node sets its clock from clockUs; yields how many microseconds later the frame came
+	// back than its delay says, about what the last node is off by
+	std::future<int32_t> timeHack();
+
+	// EXT_EVENT (Circus.c EVENTS): the node runs action when Tic next reaches tic, then never again, every
+	// tics Tics or on the days in days (bit n = day numbers that are n mod 7).  Yield how many events the
+	// node holds; Refused if it is full, has no such event or no EVENTS.  NID 0 = every node, yields 0
+	std::future<uint16_t> scheduleOnce(uint8_t nid, uint8_t id, uint8_t action, uint16_t tic);
+	std::future<uint16_t> scheduleEvery(uint8_t nid, uint8_t id, uint8_t action, uint16_t tic, uint16_t tics);
+	std::future<uint16_t> scheduleDays(uint8_t nid, uint8_t id, uint8_t action, uint16_t tic, uint8_t days);
+	std::future<uint16_t> unschedule(uint8_t nid, uint8_t id);		// id 0 = all of them
+	std::future<uint16_t> setDay(uint8_t nid, uint16_t day);		// the day number scheduleDays() goes by
+	static uint16_t today();		// local days since Sunday 4 January 1970, bit 0 of days is Sunday
+
+	// EXT_BLOCK of the diagnostics page, clear stores zeros in the same lap.  Refused if the node has no
+	// DIAGNOSTICS
+	std::future<NodeHealth> health(uint8_t nid, bool clear = false);
+
+	// EXT_LATENCY (Circus.c LATENCY_SAMPLES), the newest count (1 - 3) frames the node forwarded; clear starts
+	// its samples and _maxForwardLatency over.  Refused if the node doesn't keep samples
+	std::future<LatencySamples> latency(uint8_t nid, uint8_t count = 3, bool clear = false);
+
+	// moves the whole ring to another baud rate (CTRL_BAUD_CHECK, CTRL_BAUD) and checks it is back;
+	// blocks until then, throws CircusError::Refused if a node can't run it and nothing changed
+	void changeBaud(uint32_t baud);
+
+	MasterStats stats() const;
+	void drain();			// wait until every request so far has completed or failed
+	void hold(bool on);		// keep new frames off the ring while on, e.g. to queue a poll as one burst
+
+private:
+	struct Request {
+		uint8_t frame[FRAME_MAX];
+		uint8_t len;
+		unsigned attempts;
+		uint64_t sentUs;
+		uint64_t startUs;		// EXT_TIME, when its first byte started out
+		uint32_t baud;			// CTRL_BAUD, goes out alone and the transport follows once it is back
+		bool bridged;			// sent with an EXT_BRIDGE frame ahead of it or is one, may wait for a sub-ring
+		std::promise<uint16_t> single;
+		std::promise<std::vector<uint16_t>> block;
+		std::promise<int32_t> lag;
+		std::promise<LatencySamples> samples;
+		std::promise<NodeHealth> diag;
+
+		bool isBlock() const
+			{ return frame[2] == EXT_BLOCK && len > 4 && !(frame[0] & (BLOCK_DIAG | BLOCK_ACK)) && !isGather(); }
+		bool isGroup() const { return frame[2] == EXT_BLOCK && len > 4 && (frame[0] & BLOCK_ACK); }
+		bool isGather() const { return frame[2] == EXT_BLOCK && len > 4 && !(frame[1] & (TOKEN_NID_MASK | TOKEN_STORE)); }
+		bool isHealth() const { return frame[2] == EXT_BLOCK && len > 4 && (frame[0] & BLOCK_DIAG); }
+		bool isTime() const { return frame[2] == EXT_TIME && len > 4; }
+		bool isEvent() const { return frame[2] == EXT_EVENT && len > 4; }
+		bool isLatency() const { return frame[2] == EXT_LATENCY && len > 4; }
+		bool isBridged() const { return frame[2] == EXT_BRIDGE && len > 4; }
+		bool isModify() const
+			{ return frame[2] == EXT_CONTROL && len > 4 && frame[0] >= CTRL_SET_BITS && frame[0] <= CTRL_CAS; }
+		bool isPage() const { return frame[2] == EXT_CONTROL && len > 4 && frame[0] == CTRL_PAGE; }
+		uint8_t addr() const { return len > 4 ? frame[1] : frame[2]; }	// the byte errors are reported in
+		uint8_t nid() const { return isTime() ? 0 : addr() & TOKEN_NID_MASK; }	// the node it goes to, 0 = every node
+	};
+
+	std::future<std::vector<uint16_t>> block(uint8_t nid, uint8_t reg, const std::vector<uint16_t> &values, bool store);
+	std::future<std::vector<uint16_t>> gatherFrame(uint8_t reg, bool high, uint8_t count);
+	std::future<uint16_t> control(uint8_t code, uint8_t nid, uint8_t reg, uint16_t param, uint32_t baud = 0);
+	std::future<uint16_t> modify(uint8_t code, uint8_t nid, uint8_t reg, uint16_t param, uint16_t expected = 0);
+	std::future<std::vector<uint16_t>> paged(uint8_t nid, uint8_t page, uint8_t reg, const std::vector<uint16_t> &values,
+		bool store);
+	std::future<uint16_t> event(uint8_t code, uint8_t nid, uint8_t id, uint8_t action, uint16_t tic, uint16_t param);
+	std::future<uint16_t> bridged(uint8_t bridge, uint8_t addr, uint16_t value);
+	void submit(Request &&r);
+	void run();
+	void sendQueued();
+	bool pageWait(const Request &r) const;
+	void pageLost(const Request &r, CircusError::Code code);
+	void receive(const uint8_t *data, size_t n);
+	void handleFrame(const uint8_t *frame, size_t len);
+	void handleReport(const uint8_t *frame);
+	void sendCarrier();
+	uint64_t lineFree(size_t len);
+	void stampTime(Request &r, uint64_t startUs);
+	void complete(Request &r, const uint8_t *frame);
+	void update(uint8_t addr, uint8_t reg, const uint8_t *sent, uint16_t reply, uint8_t bridge = 0);
+	void bridgeTrouble(Request &&r, const uint8_t *frame);
+	void retry(Request &&r, CircusError::Code why);
+	void fail(Request &r, CircusError::Code code);
+	void checkTimeouts();
+	void trouble();
+	uint64_t timeoutUs(size_t len, bool bridged = false) const;
+	uint64_t resyncUs() const;
+
+	Transport &_transport;
+	MasterConfig _config;
+	uint32_t _byteUs;
+
+	mutable std::mutex _mutex;
+	std::condition_variable _wake, _idle;
+	std::deque<Request> _queue;			// waiting for a slot in the window
+	std::deque<Request> _inFlight;		// oldest first, the order the ring returns them in
+	MasterStats _stats;
+	bool _stop = false;
+	bool _held = false;
+	bool _resync = false;				// hold new frames until the ring is empty and idle
+	bool _quiet = false;				// in the hold after _resync, bytes coming in put it off
+	bool _switching = false;			// a CTRL_BAUD frame is on the ring, nothing else may be
+	uint64_t _holdUntilUs = 0;
+	uint64_t _txFreeUs = 0;				// when the bytes written so far are out on the line
+	std::deque<uint64_t> _carriers;		// send times of the report frames on the ring
+	uint64_t _nextCarrierUs = 0;
+	std::vector<RegisterUpdate> _updates;	// handed to onUpdate/onReport outside the lock
+	std::mutex _pageOrder;				// a CTRL_PAGE frame and the requests it is for go in together
+	int16_t _page[16];					// page of every node after what was queued so far, -1 = not known
+	uint16_t _paged = 0;				// bit n = node n << 4 may be on a page, its registers 1 - 6 aren't updates
+
+	uint8_t _rx[FRAME_MAX];
+	size_t _rxIdx = 0, _rxLen = 4;
+	uint64_t _rxLastUs = 0;
+
+	std::thread _worker;
+};
+
+} // namespace circus
@@ -0,0 +1,115 @@
+/*************************************************************************
+Title:    RegisterMirror - ringmaster side copy of every node's registers
+File:     extras/host/CircusMirror.cpp
+Software: Linux, g++ (C++17)
+License:  GNU General Public License Version 2.0
+
+    See CircusMirror.h.
+*************************************************************************/
+
+#include "CircusMirror.h"
+
+namespace circus {
+
+RegisterMirror::RegisterMirror(Transport &transport, MasterConfig config, uint32_t maxAgeTics)
+	: _transport(transport)
+{
+	for (auto &node : _maxAge)
+		for (uint32_t &age : node) age = maxAgeTics;
+	std::function<void(const RegisterUpdate &)> user = config.onUpdate;
+	config.onUpdate = [this, user](const RegisterUpdate &u) {
+		apply(u);
+		if (user) user(u);
+	};
+	_master.reset(new CircusMaster(transport, config));
+}
+
+RegisterMirror::~RegisterMirror()
+{
+	_master.reset();
+}
+
+std::future<uint16_t> RegisterMirror::read(uint8_t nid, uint8_t reg)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		const MirrorEntry &e = entry(nid, reg);
+		uint32_t maxAge = _maxAge[(nid >> 4) & 0x0f][reg & 7];
+		if (e.valid && !e.writes && maxAge && nowTics() - e.updated <= maxAge) {
+			_stats.hits++;
+			std::promise<uint16_t> p;
+			p.set_value(e.value);
+			return p.get_future();
+		}
+		_stats.misses++;
+	}
+	return _master->read(nid, reg);		// the reply updates the copy through apply()
+}
+
+std::future<uint16_t> RegisterMirror::write(uint8_t nid, uint8_t reg, uint16_t value)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		for (uint8_t n = 1; n < 16; n++)
+			if (!(nid & TOKEN_NID_MASK) || n == nid >> 4) _entries[n][reg & 7].writes++;
+	}
+	return _master->write(nid, reg, value);
+}
+
+void RegisterMirror::setMaxAge(uint8_t nid, uint8_t reg, uint32_t tics)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	for (uint8_t n = 1; n < 16; n++)
+		if (!(nid & TOKEN_NID_MASK) || n == nid >> 4) _maxAge[n][reg & 7] = tics;
+}
+
+void RegisterMirror::invalidate(uint8_t nid, uint8_t reg)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	for (uint8_t n = 1; n < 16; n++)
+		if (!(nid & TOKEN_NID_MASK) || n == nid >> 4) _entries[n][reg & 7] = MirrorEntry();
+}
+
+MirrorEntry RegisterMirror::peek(uint8_t nid, uint8_t reg) const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _entries[(nid >> 4) & 0x0f][reg & 7];
+}
+
+uint32_t RegisterMirror::nowTics() const
+{
+	return (uint32_t)(_transport.nowUs() * 8 / MILLITIC_US_X8);
+}
+
+MirrorStats RegisterMirror::stats() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _stats;
+}
+
+/*************************************************************************
+Function: apply()
+Purpose:  take one register value from the ringmaster's worker thread
+**************************************************************************/
+void RegisterMirror::apply(const RegisterUpdate &u)
+{
+	if (u.bridge)
+		return;				// a node behind a bridge, not one of this ring's
+	std::lock_guard<std::mutex> lock(_mutex);
+	uint32_t now = nowTics();
+	for (uint8_t n = 1; n < 16; n++) {
+		if (u.nid ? n != u.nid >> 4 : !u.store)
+			continue;		// a broadcast can only have been a store
+		MirrorEntry &e = _entries[n][u.reg];
+		if (u.store && u.nid && !u.group && e.valid && u.previous != e.value)
+			_stats.overwritten++;
+		if (u.store && e.writes)
+			e.writes--;
+		e.value = u.value;
+		e.updated = now;
+		e.valid = true;
+		_stats.updates++;
+	}
+}
+
+} // namespace circus
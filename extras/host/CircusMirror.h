@@ -0,0 +1,88 @@
+/*************************************************************************
+Title:    RegisterMirror - ringmaster side copy of every node's registers
+File:     extras/host/CircusMirror.h
+Software: Linux, g++ (C++17)
+License:  GNU General Public License Version 2.0
+
+DESCRIPTION:
+    Keeps the 8 registers (Circus_Data_Array) of all 15 nodes in memory on
+    top of a CircusMaster.  Every reply updates the copy: gets with the
+    value read, stores with the value written (the previous value a store
+    returns is checked against the copy, a difference means the node or
+    another ringmaster changed it meanwhile), block frames register by
+    register and change reports as they come in.
+
+    read() answers from memory while the copy is younger than the
+    register's max age and goes around the ring otherwise; write() always
+    goes to the ring and the copy follows the reply, reads of the register
+    go to the ring while the store is out (after a failed store until the
+    next one gets through, or invalidate()).  Ages are counted in
+    milliTics (CTic.c: Timer1 compare 20599 at 16 MHz, 1.2875 ms) on the
+    transport's clock.
+
+    Watching registers with change reports (CircusMaster::watch) keeps
+    the copy current without any reads; a max age still catches reports
+    lost on the ring.
+
+USAGE:
+    circus::RegisterMirror mirror(port, config, 800);	// about a second
+    mirror.read(0x10, 5).get();		// from the ring
+    mirror.read(0x10, 5).get();		// from memory
+*************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+#include <future>
+#include <memory>
+#include <mutex>
+
+#include "CircusMaster.h"
+
+namespace circus {
+
+static const uint32_t MILLITIC_US_X8 = 10300;		// 1.2875 ms * 8, keeps the conversion in integers
+
+struct MirrorEntry {
+	uint16_t value = 0;
+	uint32_t updated = 0;		// milliTic of the last reply or report
+	bool valid = false;
+	uint8_t writes = 0;			// stores on the ring, reads bypass the copy until they're back
+};
+
+struct MirrorStats {
+	uint64_t hits = 0;			// reads answered from memory
+	uint64_t misses = 0;		// reads that went to the ring
+	uint64_t updates = 0;		// register values taken from replies and reports
+	uint64_t overwritten = 0;	// stores that found something other than the copy
+};
+
+class RegisterMirror {
+public:
+	RegisterMirror(Transport &transport, MasterConfig config = MasterConfig(), uint32_t maxAgeTics = 800);
+	~RegisterMirror();
+
+	CircusMaster &master() { return *_master; }
+
+	std::future<uint16_t> read(uint8_t nid, uint8_t reg);
+	std::future<uint16_t> write(uint8_t nid, uint8_t reg, uint16_t value);	// yields the previous value
+
+	void setMaxAge(uint8_t nid, uint8_t reg, uint32_t tics);	// NID 0 = every node, 0 = never from memory
+	void invalidate(uint8_t nid, uint8_t reg);		// NID 0 = every node
+	MirrorEntry peek(uint8_t nid, uint8_t reg) const;
+	uint32_t nowTics() const;
+	MirrorStats stats() const;
+
+private:
+	void apply(const RegisterUpdate &u);
+	MirrorEntry &entry(uint8_t nid, uint8_t reg) { return _entries[(nid >> 4) & 0x0f][reg & 7]; }
+
+	Transport &_transport;
+	mutable std::mutex _mutex;
+	MirrorEntry _entries[16][8];		// by NID >> 4, row 0 unused
+	uint32_t _maxAge[16][8];
+	MirrorStats _stats;
+	std::unique_ptr<CircusMaster> _master;	// last, its worker calls apply() until it is gone
+};
+
+} // namespace circus
@@ -0,0 +1,488 @@
+/*************************************************************************
+Title:    Circus ring simulator
+File:     extras/host/CircusSim.cpp
+Software: Linux, g++ (C++17)
+License:  GNU General Public License Version 2.0
+
+    See CircusSim.h for what is and isn't modelled.
+
+    Every node is a private copy of circusnode.so opened RTLD_LOCAL, so the
+    statics in Circus.c (Token, RxIdx, TxIdx, ...) exist once per node just
+    like they would on separate chips.
+*************************************************************************/
+
+#include "CircusSim.h"
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+
+#ifndef _BV
+#define _BV(bit) (1 << (bit))
+#endif
+
+namespace circus {
+
+// bit positions, must match hal/Arduino.h
+enum : uint8_t {
+	RXC = 7, UDRE = 5, FE = 4, DOR = 3, U2X = 1,	// UCSR0A
+	RXCIE = 7, UDRIE = 5							// UCSR0B
+};
+
+// receiver sampling tolerance for 8-N-1, the stop bit is sampled 9.5 bit times after the start edge
+static const double BAUD_TOLERANCE = 0.045;
+
+/*************************************************************************
+Class:    SimNode
+Purpose:  one loaded node image plus the USART state around it
+**************************************************************************/
+class SimNode {
+public:
+	SimNode(Ring &ring, uint8_t nid, const std::string &path);
+	~SimNode();
+
+	void start();
+	void receive(uint8_t uart, uint8_t data, bool framingError);
+	void service();
+	void txDone(uint8_t uart);
+	void milliTic();
+	void loopPass();
+	uint64_t localCycles() const { return (uint64_t)(_ring._now * _clockRate); }	// the node's own clock
+	double baud(uint8_t uart = 0) const;
+	uint16_t ubrr(uint8_t uart = 0) const { return (uint16_t)((*_uart[uart].ubrrh << 8) | *_uart[uart].ubrrl); }
+
+	template <typename T> T *sym(const char *name) {
+		void *p = dlsym(_handle, name);
+		if (!p) throw std::runtime_error(std::string("circusnode.so: missing symbol ") + name);
+		return reinterpret_cast<T *>(p);
+	}
+
+	Ring &_ring;
+	uint8_t _nidValue;
+	void *_handle;
+
+	uint8_t *_nid;
+	uint32_t *_baud;
+	uint64_t *_cycles;
+	uint8_t *_ticRuns;
+	volatile uint16_t *_maxForwardLatency;		// null unless the image was built with MEASURE_LATENCY
+	volatile uint32_t *_counter32;				// null unless it was built with COUNTER_32
+	Circus_Data_Array *_cda;
+	void (*_yield)(void);
+	void (*_initVariant)(void);
+	uint16_t (*_simMilliTic)(void);
+	uint8_t (*_crc8)(uint8_t, uint8_t);
+	const uint8_t *_crcSeed;
+
+	// USART0 is the node's ring, a bridge image also has the USART1 ISRs for its sub-ring
+	struct RxEntry { uint8_t data; uint8_t flags; };
+	struct Uart {
+		volatile uint8_t *ucsra, *ucsrb, *ubrrh, *ubrrl;
+		volatile uint16_t *udr;
+		void (*rxIsr)(void) = nullptr;
+		void (*udreIsr)(void) = nullptr;
+		SimNode *next = nullptr;		// where the TX line goes, nullptr = the ringmaster
+		uint8_t nextUart = 0;
+		std::deque<RxEntry> rxFifo;
+		bool udrFull = false;
+		uint8_t udrData = 0;
+		bool shifting = false;
+		uint64_t txHoldUntil = 0;
+	};
+	Uart _uart[2];
+	bool _yieldPending = false;
+	uint64_t _loopPhase = 0;
+	size_t _index = 0;					// in Ring::_nodes
+	double _clockRate = 1.0;			// node cycles per ring cycle
+	uint64_t _milliTicAt = 0;			// node cycles at the next milliTic
+
+	// hop latency on USART0: pair the first byte of every received frame with the first byte of every sent frame
+	struct FrameCounter {
+		uint8_t idx = 0, len = 4, hdr[2] = {0, 0};
+		bool add(uint8_t data)		// true if data starts a frame
+		{
+			bool first = !idx;
+			if (idx < 2) hdr[idx] = data;
+			else if (idx == 2) len = frameLength(hdr[0], hdr[1], data);
+			if (++idx >= len) { idx = 0; len = 4; }
+			return first;
+		}
+	};
+	FrameCounter _in, _out;
+	uint64_t _lastRx = 0;
+	std::deque<uint64_t> _tokenIn;
+	HopStats _stats;
+
+private:
+	bool serviceUart(uint8_t u, uint64_t now);
+	void holdTx(const bool (&was)[2], uint64_t cycles);
+};
+
+SimNode::SimNode(Ring &ring, uint8_t nid, const std::string &path) : _ring(ring), _nidValue(nid)
+{
+	_handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+	if (!_handle)
+		throw std::runtime_error(dlerror());
+	_nid = sym<uint8_t>("NID");
+	_baud = sym<uint32_t>("BAUD");
+	_uart[0].ucsra = sym<volatile uint8_t>("UCSR0A");
+	_uart[0].ucsrb = sym<volatile uint8_t>("UCSR0B");
+	_uart[0].ubrrh = sym<volatile uint8_t>("UBRR0H");
+	_uart[0].ubrrl = sym<volatile uint8_t>("UBRR0L");
+	_uart[0].udr = sym<volatile uint16_t>("_simUdr");
+	_uart[0].rxIsr = (void (*)(void))dlsym(_handle, "USART_RX_vect");
+	_uart[0].udreIsr = (void (*)(void))dlsym(_handle, "USART_UDRE_vect");
+	_uart[1].ucsra = sym<volatile uint8_t>("UCSR1A");
+	_uart[1].ucsrb = sym<volatile uint8_t>("UCSR1B");
+	_uart[1].ubrrh = sym<volatile uint8_t>("UBRR1H");
+	_uart[1].ubrrl = sym<volatile uint8_t>("UBRR1L");
+	_uart[1].udr = sym<volatile uint16_t>("_simUdr1");
+	_uart[1].rxIsr = (void (*)(void))dlsym(_handle, "USART1_RX_vect");
+	_uart[1].udreIsr = (void (*)(void))dlsym(_handle, "USART1_UDRE_vect");
+	_cycles = sym<uint64_t>("_simCycles");
+	_ticRuns = sym<uint8_t>("_simTicRuns");
+	_maxForwardLatency = (volatile uint16_t *)dlsym(_handle, "_maxForwardLatency");
+	_counter32 = (volatile uint32_t *)dlsym(_handle, "_counter32");
+	_cda = sym<Circus_Data_Array>("CDA");
+	_crcSeed = sym<const uint8_t>("CRCSEED");
+	_yield = (void (*)(void))dlsym(_handle, "yield");
+	_initVariant = (void (*)(void))dlsym(_handle, "initVariant");
+	_simMilliTic = (uint16_t (*)(void))dlsym(_handle, "simMilliTic");
+	_crc8 = (uint8_t (*)(uint8_t, uint8_t))dlsym(_handle, "crc8");
+	if (!_uart[0].rxIsr || !_uart[0].udreIsr || !_yield || !_initVariant || !_simMilliTic || !_crc8)
+		throw std::runtime_error("circusnode.so: missing entry point");
+}
+
+SimNode::~SimNode()
+{
+	if (_handle) dlclose(_handle);
+}
+
+void SimNode::start()
+{
+	const SimConfig &c = _ring._config;
+	*_nid = _nidValue;
+	*_baud = c.baud;
+	*_ticRuns = c.ticRuns;
+	if (c.clockPpm)
+		_clockRate = 1.0 + std::uniform_real_distribution<double>(-c.clockPpm, c.clockPpm)(_ring._rng) * 1e-6;
+	*_cycles = localCycles();
+	_initVariant();
+	// known register contents so the ringmaster can check replies: high byte NID, low byte register
+	for (uint8_t r = 0; r < 8; r++)
+		_cda->uintD[r] = (uint16_t)((*_nid << 8) | r);
+
+	std::uniform_int_distribution<uint64_t> phase(0, c.milliTicCycles - 1);
+	_milliTicAt = phase(_ring._rng);
+	_ring.at((uint64_t)std::ceil(_milliTicAt / _clockRate), [this] { milliTic(); });
+	_loopPhase = std::uniform_int_distribution<uint64_t>(0, c.loopCycles)(_ring._rng);
+}
+
+double SimNode::baud(uint8_t uart) const
+{
+	return _ring._config.fCpu / (((*_uart[uart].ucsra & _BV(U2X)) ? 8.0 : 16.0) * (ubrr(uart) + 1));
+}
+
+void SimNode::receive(uint8_t u, uint8_t data, bool framingError)
+{
+	Uart &uart = _uart[u];
+	uint64_t now = _ring._now;
+
+	if (!uart.rxIsr) return;		// nothing listening on this USART
+	if (!u) {
+		uint64_t byteTime = _ring.byteCycles(baud());
+		if (now - _lastRx > 3 * byteTime && !uart.shifting && !uart.udrFull && !(*uart.ucsrb & _BV(UDRIE))) {
+			// line was idle and nothing is queued for transmit, token boundaries line up again
+			_tokenIn.clear();
+			_in = _out = FrameCounter();
+		}
+		_lastRx = now;
+		if (_in.add(data))
+			_tokenIn.push_back(now - byteTime);
+		if (framingError) _stats.framingErrors++;
+	}
+
+	if (uart.rxFifo.size() >= 2) {		// third byte finished in the shift register, it is lost
+		uart.rxFifo.back().flags |= _BV(DOR);
+		if (!u) _stats.overruns++;
+	} else {
+		uart.rxFifo.push_back({data, (uint8_t)(framingError ? _BV(FE) : 0)});
+	}
+	service();
+}
+
+void SimNode::service()
+{
+	uint64_t now = _ring._now;
+	for (int guard = 0; guard < 16; guard++) {
+		bool progress = serviceUart(0, now);
+		if (_uart[1].rxIsr) progress |= serviceUart(1, now);
+		if (!progress) break;
+	}
+}
+
+// one round of one USART's ISRs and shift register, true if anything moved
+bool SimNode::serviceUart(uint8_t u, uint64_t now)
+{
+	Uart &uart = _uart[u];
+	bool progress = false;
+
+	if ((*uart.ucsrb & _BV(RXCIE)) && !uart.rxFifo.empty()) {
+		RxEntry e = uart.rxFifo.front();
+		uart.rxFifo.pop_front();
+		*uart.ucsra = (*uart.ucsra & _BV(U2X)) | _BV(RXC) | e.flags | (uart.udrFull ? 0 : _BV(UDRE));
+		*uart.udr = 0x100 | e.data;
+		*_cycles = localCycles();
+		bool was[2] = {(bool)(*_uart[0].ucsrb & _BV(UDRIE)), (bool)(*_uart[1].ucsrb & _BV(UDRIE))};
+		uart.rxIsr();
+		progress = true;
+		// the ISR queued bytes for transmit (cut-through or PROCESS_IN_ISR), they go out when it returns
+		holdTx(was, _ring._config.isrCycles);
+		if (!_yieldPending) {
+			// yield() runs at the end of the loop() pass in progress
+			const SimConfig &c = _ring._config;
+			uint64_t pass = c.loopCycles;
+			uint64_t next = now + pass - (now + _loopPhase) % pass;
+			if (c.loopJitter)
+				next += std::uniform_int_distribution<uint64_t>(0, c.loopJitter)(_ring._rng);
+			_yieldPending = true;
+			_ring.at(next, [this] { loopPass(); });
+		}
+	} else if ((*uart.ucsrb & _BV(UDRIE)) && !uart.udrFull && now >= uart.txHoldUntil) {
+		*uart.ucsra = (*uart.ucsra & _BV(U2X)) | _BV(UDRE);
+		*uart.udr = 0x100;
+		*_cycles = localCycles();
+		uart.udreIsr();
+		if (*uart.udr < 0x100) {
+			uart.udrFull = true;
+			uart.udrData = (uint8_t)*uart.udr;
+			progress = true;
+		}
+	}
+	if (uart.udrFull && !uart.shifting) {
+		uart.udrFull = false;
+		uart.shifting = true;
+		if (!u && _out.add(uart.udrData) && !_tokenIn.empty()) {
+			uint64_t hop = now - _tokenIn.front();
+			_tokenIn.pop_front();
+			_stats.tokens++;
+			_stats.totalCycles += hop;
+			if (hop > _stats.maxCycles) _stats.maxCycles = hop;
+		}
+		uint8_t data = uart.udrData;
+		double b = baud(u);
+		SimNode *next = uart.next;
+		uint8_t nextUart = uart.nextUart;
+		_ring.at(now + _ring.byteCycles(b), [this, u] { txDone(u); });
+		_ring.at(now + _ring.byteCycles(b), [this, next, nextUart, data, b] { _ring.deliver(next, nextUart, data, b); });
+		progress = true;
+	}
+	return progress;
+}
+
+// a USART whose UDRE interrupt was just enabled starts transmitting once the code that did it is done
+void SimNode::holdTx(const bool (&was)[2], uint64_t cycles)
+{
+	for (uint8_t u = 0; u < 2; u++) {
+		if (!was[u] && (*_uart[u].ucsrb & _BV(UDRIE))) {
+			_uart[u].txHoldUntil = _ring._now + cycles;
+			_ring.at(_uart[u].txHoldUntil, [this] { service(); });
+		}
+	}
+}
+
+void SimNode::txDone(uint8_t uart)
+{
+	_uart[uart].shifting = false;
+	service();
+}
+
+void SimNode::milliTic()
+{
+	uint16_t tic = _cda->uintD[7];
+	*_cycles = _milliTicAt;
+	_milliTicAt += _simMilliTic() + 1u;
+	_ring.at((uint64_t)std::ceil(_milliTicAt / _clockRate), [this] { milliTic(); });
+	if (_cda->uintD[7] != tic && _ring.onTic)
+		_ring.onTic(_index, _cda->uintD[7]);
+	if (!_yieldPending)
+		loopPass();		// loop() keeps calling yield() on an idle node too, once a milliTic is often enough
+}
+
+void SimNode::loopPass()
+{
+	_yieldPending = false;
+	bool was[2] = {(bool)(*_uart[0].ucsrb & _BV(UDRIE)), (bool)(*_uart[1].ucsrb & _BV(UDRIE))};
+	*_cycles = localCycles();
+	_yield();
+	// Circus() just queued a token, the first byte goes out once processing is done
+	holdTx(was, _ring._config.procCycles);
+	service();
+}
+
+/*************************************************************************
+Class:    Ring
+**************************************************************************/
+static std::string readImage(const std::string &path)
+{
+	std::ifstream src(path, std::ios::binary);
+	if (!src)
+		throw std::runtime_error("cannot open " + path);
+	return std::string((std::istreambuf_iterator<char>(src)), std::istreambuf_iterator<char>());
+}
+
+Ring::Ring(const SimConfig &config) : _config(config), _rng(config.seed), _masterBaud(config.baud)
+{
+	if (_config.nodes < 1 || _config.nodes > 15)
+		throw std::runtime_error("a ring holds 1 to 15 nodes");
+	if (_config.bridges > _config.nodes || (_config.bridges && (_config.subNodes < 1 || _config.subNodes > 15)))
+		throw std::runtime_error("bridges have to be on the ring and their sub-rings hold 1 to 15 nodes");
+
+	// dlopen() hands back the already loaded copy for a path it has seen, so each node gets its own file
+	char dir[] = "/tmp/circussim.XXXXXX";
+	if (!mkdtemp(dir))
+		throw std::runtime_error("mkdtemp failed");
+	_tmpDir = dir;
+	std::string image = readImage(_config.image);
+	std::string bridgeImage = _config.bridges ? readImage(_config.bridgeImage) : std::string();
+
+	auto load = [this](const std::string &image, uint8_t nid) {
+		std::string path = _tmpDir + "/node" + std::to_string(_nodes.size() + 1) + ".so";
+		std::ofstream(path, std::ios::binary).write(image.data(), image.size());
+		_nodes.emplace_back(new SimNode(*this, nid, path));
+		_nodes.back()->_index = _nodes.size() - 1;
+		unlink(path.c_str());
+		return _nodes.back().get();
+	};
+	for (size_t i = 0; i < _config.nodes; i++)
+		load(i < _config.bridges ? bridgeImage : image, (uint8_t)((i + 1) << 4));
+	for (size_t i = 0; i < _config.nodes; i++)
+		_nodes[i]->_uart[0].next = i + 1 < _config.nodes ? _nodes[i + 1].get() : nullptr;
+	for (size_t b = 0; b < _config.bridges; b++) {
+		SimNode *bridge = _nodes[b].get();
+		if (!bridge->_uart[1].rxIsr)
+			throw std::runtime_error(_config.bridgeImage + " isn't built with CIRCUS_BRIDGE 1");
+		SimNode *prev = bridge;
+		uint8_t prevUart = 1;
+		for (size_t i = 0; i < _config.subNodes; i++) {
+			SimNode *n = load(image, (uint8_t)((i + 1) << 4));
+			prev->_uart[prevUart].next = n;
+			prev->_uart[prevUart].nextUart = 0;
+			prev = n;
+			prevUart = 0;
+		}
+		prev->_uart[0].next = bridge;		// the sub-ring ends at its ringmaster
+		prev->_uart[0].nextUart = 1;
+	}
+	rmdir(_tmpDir.c_str());
+	for (auto &n : _nodes)
+		n->start();
+}
+
+size_t Ring::subNode(size_t bridge, size_t i) const
+{
+	if (bridge >= _config.bridges || i >= _config.subNodes)
+		throw std::out_of_range("no such sub-ring node");
+	return _config.nodes + bridge * _config.subNodes + i;
+}
+
+Ring::~Ring() = default;
+
+void Ring::at(uint64_t when, std::function<void()> action)
+{
+	_events.push({when < _now ? _now : when, _seq++, std::move(action)});
+}
+
+bool Ring::step()
+{
+	if (_events.empty()) return false;
+	Event e = _events.top();
+	_events.pop();
+	_now = e.when;
+	e.action();
+	return true;
+}
+
+void Ring::runUntil(uint64_t when)
+{
+	while (!_events.empty() && _events.top().when <= when)
+		step();
+	if (_now < when) _now = when;
+}
+
+void Ring::masterSend(const uint8_t *data, size_t len)
+{
+	_masterTx.insert(_masterTx.end(), data, data + len);
+	if (!_masterShifting)
+		masterShiftNext();
+}
+
+void Ring::masterShiftNext()
+{
+	if (_masterTx.empty()) {
+		_masterShifting = false;
+		return;
+	}
+	uint8_t data = _masterTx.front();
+	_masterTx.pop_front();
+	_masterShifting = true;
+	double b = _masterBaud;
+	at(_now + byteCycles(b), [this, data, b] {
+		deliver(_nodes[0].get(), 0, data, b);
+		masterShiftNext();
+	});
+}
+
+void Ring::deliver(SimNode *to, uint8_t uart, uint8_t data, double senderBaud)
+{
+	double rxBaud = to ? to->baud(uart) : _masterBaud;
+	bool fe = std::fabs(senderBaud / rxBaud - 1.0) > BAUD_TOLERANCE;
+	if (fe)
+		data = (uint8_t)_rng();
+	double ber = to && to->_index == (size_t)_config.badLink ? _config.badLinkBer : _config.ber;
+	if (ber > 0) {
+		std::bernoulli_distribution flip(ber);
+		for (int bit = 0; bit < 10; bit++) {
+			if (!flip(_rng)) continue;
+			if (bit == 0 || bit == 9) fe = true;	// start or stop bit
+			else data ^= (uint8_t)(1 << (bit - 1));
+		}
+	}
+	if (to)
+		to->receive(uart, data, fe);
+	else if (onMasterRx)
+		onMasterRx(data, fe);
+}
+
+Circus_Data_Array &Ring::cda(size_t node) { return *_nodes.at(node)->_cda; }
+uint8_t Ring::nid(size_t node) const { return *_nodes.at(node)->_nid; }
+double Ring::nodeBaud(size_t node) const { return _nodes.at(node)->baud(); }
+uint16_t Ring::nodeUbrr(size_t node) const { return _nodes.at(node)->ubrr(); }
+const HopStats &Ring::hopStats(size_t node) const { return _nodes.at(node)->_stats; }
+
+int32_t Ring::maxForwardLatencyUs(size_t node) const
+{
+	const SimNode &n = *_nodes.at(node);
+	return n._maxForwardLatency ? *n._maxForwardLatency : -1;
+}
+volatile uint32_t *Ring::counter32(size_t node) { return _nodes.at(node)->_counter32; }
+double Ring::clockPpm(size_t node) const { return (_nodes.at(node)->_clockRate - 1.0) * 1e6; }
+
+uint8_t Ring::crc8(uint8_t data, uint8_t crc) const { return _nodes.front()->_crc8(data, crc); }
+
+uint8_t Ring::frameCrc(const uint8_t *frame, size_t len) const
+{
+	uint8_t crc = *_nodes.front()->_crcSeed;
+	for (size_t i = 0; i + 1 < len; i++)
+		crc = crc8(frame[i], crc);
+	return crc;
+}
+
+uint8_t Ring::tokenCrc(const uint8_t *token) const { return frameCrc(token, 4); }
+
+} // namespace circus
@@ -0,0 +1,149 @@
+/*************************************************************************
+Title:    Circus ring simulator
+File:     extras/host/CircusSim.h
+Software: Linux, g++ (C++17)
+License:  GNU General Public License Version 2.0
+
+DESCRIPTION:
+    Discrete event simulation of one Circus ring: a ringmaster plus up to 15
+    nodes running the real Circus.c (compiled into circusnode.so, see
+    SimNode.c).  Time is kept in CPU cycles of the node clock (F_CPU).
+
+    With SimConfig::bridges the first nodes are bridges instead
+    (circusnode-bridge.so, CIRCUS_BRIDGE 1): each is the ringmaster of a
+    sub-ring of subNodes plain nodes on its USART1.  The sub-rings are part
+    of the same simulation and run on the same clock.
+
+    What is modelled:
+      - each UART byte (start + 8 data + stop bits) takes 10 bit times at the
+        baud rate the node's own circus_init() programmed into UBRR0/U2X0,
+        so baud rate error shows up as framing errors and skew
+      - the AVR USART: 2 byte receive FIFO with overrun, UDR + shift register
+        on transmit, RXCIE/UDRIE gating of the two ISRs
+      - the Arduino main loop: yield() runs between loop() passes, so a
+        completed token waits for the end of the current pass; an idle
+        node gets a yield() every milliTic
+      - Circus() processing time before the first byte can be re-transmitted,
+        and the RX ISR's own time when it starts a transmit
+      - the milliTic timer counting down the dead time (circusMilliTic),
+        reloaded with the node's _milliTicReload, and on request the Tic
+      - every node's crystal error (SimConfig::clockPpm), its milliTic and
+        micros() run at it
+      - random bit errors on every link
+
+    What is not: the time of the plain byte moving ISRs (a few dozen
+    cycles), interrupt latency while another ISR runs, and the crystal
+    error in the baud rates.
+*************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <Circus.h>
+#include <CircusToken.h>
+
+namespace circus {
+
+struct SimConfig {
+	uint32_t fCpu = 16000000;
+	uint32_t baud = 9600;			// ringmaster baud at the start, also written to every node's BAUD
+	uint8_t nodes = 15;				// 1 - 15, node n gets NID n << 4
+	double ber = 0.0;				// bit error rate on every link
+	int badLink = -1;				// the link into this main ring node (0 = from the ringmaster) has badLinkBer
+	double badLinkBer = 0.0;		// instead of ber
+	uint32_t loopCycles = 1600;		// length of one loop() pass, yield() runs between passes
+	uint32_t loopJitter = 0;		// random extra cycles added to each loop() pass
+	uint32_t procCycles = 800;		// Circus() time from yield() until the UDRE interrupt is enabled
+	uint32_t isrCycles = 400;		// RX ISR time when it starts a transmit itself (cut-through, PROCESS_IN_ISR)
+	uint32_t milliTicCycles = 20599;	// Timer1 compare value + 1 for the first milliTic, then the node's _milliTicReload + 1
+	double clockPpm = 0;			// every node's crystal is off by a random amount up to this, parts per million
+	bool ticRuns = false;			// count Tic (register 7) every 1024 milliTics as CTic.c does
+	uint32_t seed = 1;
+	std::string image = "./circusnode.so";
+	uint8_t bridges = 0;			// the first bridges nodes are bridges, each with a sub-ring
+	uint8_t subNodes = 15;			// 1 - 15 nodes on every sub-ring, NIDs as on the main ring
+	std::string bridgeImage = "./circusnode-bridge.so";
+};
+
+struct HopStats {
+	uint64_t tokens = 0;
+	uint64_t totalCycles = 0;
+	uint64_t maxCycles = 0;
+	uint64_t framingErrors = 0;
+	uint64_t overruns = 0;
+};
+
+class SimNode;
+
+class Ring {
+public:
+	explicit Ring(const SimConfig &config);
+	~Ring();
+
+	// ringmaster side
+	void masterSend(const uint8_t *data, size_t len);
+	bool masterTxIdle() const { return !_masterShifting && _masterTx.empty(); }
+	uint32_t masterBaud() const { return _masterBaud; }
+	void setMasterBaud(uint32_t baud) { _masterBaud = baud; }	// for bytes started from now on, nodes follow CTRL_BAUD
+	std::function<void(uint8_t data, bool framingError)> onMasterRx;
+
+	// scheduling
+	uint64_t now() const { return _now; }
+	void at(uint64_t when, std::function<void()> action);
+	bool step();						// run one event, false when the queue is empty
+	void runUntil(uint64_t when);
+
+	// inspection, node numbers below nodeCount() are on the main ring, subNode() numbers the rest
+	size_t nodeCount() const { return _config.nodes; }
+	size_t subNode(size_t bridge, size_t i) const;	// node i of a bridge's sub-ring
+	Circus_Data_Array &cda(size_t node);
+	uint8_t nid(size_t node) const;
+	double nodeBaud(size_t node) const;
+	uint16_t nodeUbrr(size_t node) const;
+	const HopStats &hopStats(size_t node) const;
+	int32_t maxForwardLatencyUs(size_t node) const;	// the node's _maxForwardLatency, -1 if not measured
+	volatile uint32_t *counter32(size_t node);		// the node's _counter32, null unless built with COUNTER_32
+	double clockPpm(size_t node) const;				// how far off the node's crystal is
+	std::function<void(size_t node, uint16_t tic)> onTic;	// a node's Tic changed, needs SimConfig::ticRuns
+	uint8_t crc8(uint8_t data, uint8_t crc) const;
+	uint8_t tokenCrc(const uint8_t *token) const;	// crc over bytes 0-2, seeded with the node's CRCSEED
+	uint8_t frameCrc(const uint8_t *frame, size_t len) const;	// crc over all but the last byte
+	const SimConfig &config() const { return _config; }
+	uint64_t byteCycles(double baud) const { return (uint64_t)(10.0 * _config.fCpu / baud + 0.5); }
+	uint64_t cycles(double seconds) const { return (uint64_t)(seconds * _config.fCpu + 0.5); }
+	double seconds(uint64_t cycles) const { return (double)cycles / _config.fCpu; }
+
+private:
+	friend class SimNode;
+
+	struct Event {
+		uint64_t when;
+		uint64_t seq;
+		std::function<void()> action;
+		bool operator<(const Event &o) const { return when != o.when ? when > o.when : seq > o.seq; }
+	};
+
+	void deliver(SimNode *to, uint8_t uart, uint8_t data, double senderBaud);	// to == nullptr is the ringmaster
+	void masterShiftNext();
+
+	SimConfig _config;
+	uint64_t _now = 0;
+	uint64_t _seq = 0;
+	std::priority_queue<Event> _events;
+	std::mt19937_64 _rng;
+	uint32_t _masterBaud;
+	std::string _tmpDir;
+	std::vector<std::unique_ptr<SimNode>> _nodes;	// main ring, then the sub-rings one after the other
+	std::deque<uint8_t> _masterTx;
+	bool _masterShifting = false;
+};
+
+} // namespace circus
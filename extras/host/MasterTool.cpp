@@ -0,0 +1,1235 @@
+/*************************************************************************
+Title:    circusmaster - command line ringmaster
+File:     extras/host/MasterTool.cpp
+Software: Linux, g++ (C++17)
+License:  GNU General Public License Version 2.0
+
+USAGE:
+    circusmaster [options] command
+      --port PATH      serial port or pty of the ring, repeat for every ring of a hub
+      --sim            use a simulated ring instead (see ringsim for the model)
+      --ring R         ring of a hub that read/write/readblock go to (0)
+      --baud B         baud rate (9600)
+      --window N       requests in flight (16)
+      --retries N      retries per request (3)
+      --timeout-ms X   per attempt, 0 = automatic (0)
+      --resync-bytes N idle byte times after trouble with block frames, 0 =
+                       10 ms for nodes built with IDLE_BYTES 0 (8)
+      --switch-to B    move the ring to baud rate B before the command
+      --bridges N      the first N nodes of every ring are bridges (0); their
+                       sub-rings get the hub's next ring numbers, ring by ring
+      --sub-nodes N    nodes on every sub-ring (15)
+      simulated ring only:
+      --rings N        rings on the hub, each its own simulation (1)
+      --nodes N        nodes in the ring (15)
+      --ber X          bit error rate on every link (0)
+      --loop-us X      length of one loop() pass on the nodes (100)
+      --seed N         random seed (1)
+      --image PATH     node library to load (./circusnode.so)
+      --ppm X          every node's crystal is off by up to X parts per million (0)
+      --bad-link N     the link into node N (0 = from the ringmaster) has
+      --bad-ber X      bit error rate X instead of --ber
+
+    commands:
+      read NID REG             print the register
+      write NID REG VALUE      store VALUE, print the previous value
+      baud B                   move the ring to baud rate B (the nodes' BAUD
+                               after a reset)
+      readblock NID REG COUNT  print COUNT registers from one EXT_BLOCK frame
+      readcounter NID REG      print the 32 bit counter with its low half at REG
+                               (a node built with COUNTER_32)
+      gather REG [COUNT]       print register REG of nodes 0x10 up to COUNT (15),
+                               one slot a node in EXT_BLOCK frames sent to NID 0
+      setbits NID REG MASK     set the bits of MASK in a register in one lap
+      clearbits NID REG MASK   clear them
+      add NID REG DELTA        add DELTA (may be negative) to a register
+      cas NID REG EXPECTED VALUE
+                               store VALUE if the register holds EXPECTED; all
+                               four print the previous value (REGISTER_OPS)
+      page NID PAGE            select a register page (PAGES) for registers 1 - 6,
+                               0 = the CDA; print the page the node was on
+      readpage NID PAGE        print registers 1 - 6 of a page
+      writegroup MEMBERS REG VALUE ...
+                               store the VALUEs from REG on in the nodes of
+                               MEMBERS (bit n = node n << 4) with one group
+                               store, print the members that acked it
+      timehack                 set every node's clock from this computer's time
+                               of day (EXT_TIME), print how late each ring's
+                               frame came back against its delay, microseconds
+      schedule NID ID ACTION TIC [every TICS | days MASK]
+                               give a node built with EVENTS event ID: run
+                               ACTION when Tic next reaches TIC, then never
+                               again, every TICS Tics or on the days in MASK
+                               (bit 0 = Sunday after "day"); print how many
+                               events the node holds
+      unschedule NID ID        drop event ID, 0 = all of them
+      day NID [DAY]            set the day number (0 = every node) to DAY or
+                               today's, days since Sunday 4 January 1970
+      health NID [clear]       print the diagnostics page of a node built with
+                               DIAGNOSTICS, clear stores zeros in the same lap
+      latency NID [COUNT]      print how many frames a node built with
+                               LATENCY_SAMPLES has sampled, then its newest
+                               COUNT (3) samples: microseconds to receive the
+                               frame and to hold it before forwarding
+      poll N [BLOCK]           read N registers of every node of every ring and
+                               sub-ring round robin, BLOCK registers per frame
+                               (plain tokens if left out, no sub-rings), and
+                               report throughput
+        --name S / --min-tps X   BENCH line name, exit 1 below X registers/s
+      report SECONDS RATE [THRESHOLD]
+                               simulated ring only: every node's CIRCUS_COUNTER
+                               counts RATE events/s at random, the ringmaster
+                               watches it and mirrors it from change reports
+        --report-ms X            one empty report frame every X ms (20)
+      mirror SECONDS RATE MAXAGE_MS
+                               simulated ring only: RATE reads/s of random
+                               registers through a RegisterMirror that answers
+                               from memory for MAXAGE_MS; the counters count
+                               once a second so stale answers show up
+      meter SECONDS RATE EVERY simulated ring only, --image ./circusnode-count.so:
+                               every node's 32 bit counter counts RATE pulses/s
+                               at random, the ringmaster reads it and its
+                               pulses per Tic every EVERY seconds
+      sweep N                  simulated ring only: read every node's
+                               CIRCUS_COUNTER N times one token a lap, N times
+                               all tokens at once and N times with gather
+                               frames; prints how long a sweep took and its bytes
+      groupwrite N             simulated ring only: N times set register 3 of
+                               every node and make sure they all have it, with a
+                               broadcast token and a read of every node, then
+                               with group stores resent to the nodes that didn't
+                               ack; prints how long a round took and its bytes
+      toggle SECONDS RATE      simulated ring only: the nodes count RATE times/s
+                               in the high byte of register 0 while the
+                               ringmaster flips a timer bit in its low byte, with
+                               a get and a store, then with setbits/clearbits;
+                               prints how many of the nodes' counts were lost
+      pages N                  simulated ring only, --image ./circusnode-pages.so:
+                               N times read 18 values of every node beyond its
+                               registers as commands answered in register 6,
+                               then N times from 3 register pages; prints how
+                               long a round took and its bytes
+      clock HOURS PERDAY       simulated ring only: the nodes count Tics on their
+                               own crystals (--ppm), PERDAY EXT_TIME frames a day
+                               keep them on the ringmaster's clock; reports how
+                               far their Tics are off before and after the drift
+                               is known
+      events MINUTES           simulated ring only, --image ./circusnode-events.so:
+                               every node gets 16 events a few minutes before
+                               midnight; counts their runs against the Tics
+      cablecheck SECONDS RATE  simulated ring only: RATE random reads/s, then
+                               every node's diagnostics page; names the link
+                               the errors start on (see --bad-link)
+      jitter SECONDS RATE      simulated ring only: RATE random reads/s while
+                               EXT_LATENCY frames read every node's newest
+                               samples round robin; prints how long the nodes
+                               held frames and a histogram of it
+
+    NIDs are written the way Circus.h defines them: 0x10 is the first node.
+*************************************************************************/
+
+#include "CircusHub.h"
+#include "CircusMaster.h"
+#include "CircusMirror.h"
+#include "SimTransport.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace circus;
+
+static void usage()
+{
+	fprintf(stderr, "usage: circusmaster (--port PATH ... | --sim) [--ring R] [--baud B] [--window N] [--retries N]\n"
+		"                    [--timeout-ms X] [--resync-bytes N] [--switch-to B] [--bridges N] [--sub-nodes N]\n"
+		"                    [--rings N] [--nodes N] [--ber X] [--bad-link N] [--bad-ber X] [--loop-us X] [--seed N]\n"
+		"                    [--image PATH] [--ppm X] [--name S] [--min-tps X] [--report-ms X]\n"
+		"                    read NID REG | write NID REG VALUE | baud B | readblock NID REG COUNT | readcounter NID REG\n"
+		"                    setbits NID REG MASK | clearbits NID REG MASK | add NID REG DELTA | cas NID REG EXPECTED VALUE\n"
+		"                    gather REG [COUNT] | writegroup MEMBERS REG VALUE ... | page NID PAGE | readpage NID PAGE\n"
+		"                    timehack | poll N [BLOCK]\n"
+		"                    report SECONDS RATE [THRESHOLD] | mirror SECONDS RATE MAXAGE_MS\n"
+		"                    schedule NID ID ACTION TIC [every TICS | days MASK] | unschedule NID ID | day NID [DAY]\n"
+		"                    health NID [clear] | latency NID [COUNT] | meter SECONDS RATE EVERY | clock HOURS PERDAY\n"
+		"                    events MINUTES | jitter SECONDS RATE | cablecheck SECONDS RATE | sweep N | groupwrite N\n"
+		"                    toggle SECONDS RATE | pages N\n");
+	exit(2);
+}
+
+static unsigned num(const char *s)
+{
+	return (unsigned)strtoul(s, 0, 0);
+}
+
+static int poll(CircusHub &hub, const std::vector<std::unique_ptr<Transport>> &transports,
+	const std::vector<unsigned> &nodes, unsigned count, unsigned block, const std::string &name, double minTps)
+{
+	const size_t rings = block ? transports.size() : hub.size();
+	hub.hold(true);			// queue the whole poll before the rings start moving
+	std::vector<uint64_t> start;
+	for (auto &t : transports) start.push_back(t->nowUs());
+	std::vector<std::future<uint16_t>> single;
+	std::vector<std::future<std::vector<uint16_t>>> blocks;
+	for (unsigned i = 0; i < count; i += block ? block : 1) {
+		unsigned request = i / (block ? block : 1);
+		size_t r = request % rings;
+		unsigned k = (unsigned)(request / rings);
+		uint8_t nid = (uint8_t)((k % nodes[r] + 1) << 4);
+		uint8_t reg = (uint8_t)(k / nodes[r] * (block ? block : 1) % 8);
+		if (block) blocks.push_back(hub.readBlock(r, nid, reg, (uint8_t)block));
+		else single.push_back(hub.read(r, nid, reg));
+	}
+	hub.hold(false);
+	hub.drain();
+	MasterStats s = hub.stats();
+	double seconds = 0;		// the rings run side by side, the slowest one counts
+	for (size_t r = 0; r < transports.size(); r++)	// a simulated ring keeps running after the last reply
+		seconds = std::max(seconds, (hub.ring(r).stats().lastReplyUs - start[r]) / 1e6);
+
+	uint64_t ok = 0;
+	for (auto &f : single) {
+		try { f.get(); ok++; } catch (const CircusError &) {}
+	}
+	for (auto &f : blocks) {
+		try { ok += f.get().size(); } catch (const CircusError &) {}
+	}
+	double tps = seconds > 0 ? ok / seconds : 0;
+	printf("registers:  %u read on %zu ring%s, %llu ok in %.2f s, %.1f registers/s\n", count, rings, rings > 1 ? "s" : "",
+		(unsigned long long)ok, seconds, tps);
+	printf("frames:     sent %llu  retries %llu  timeouts %llu  lost %llu  error replies %llu  bad %llu  resyncs %llu  failed %llu\n",
+		(unsigned long long)s.sent, (unsigned long long)s.retries, (unsigned long long)s.timeouts,
+		(unsigned long long)s.lost, (unsigned long long)s.errorReplies, (unsigned long long)s.badFrames, (unsigned long long)s.resyncs,
+		(unsigned long long)s.failed);
+	printf("BENCH %s tok_s=%.1f retries=%llu failed=%llu\n", name.c_str(), tps,
+		(unsigned long long)s.retries, (unsigned long long)s.failed);
+	if (minTps > 0 && tps < minTps) {
+		fprintf(stderr, "%s: %.1f registers/s is below the baseline of %.1f\n", name.c_str(), tps, minTps);
+		return 1;
+	}
+	return s.failed ? 1 : 0;
+}
+
+/*************************************************************************
+Function: report()
+Purpose:  change report scenario, the counters change in ring events so
+          everything touching the ring runs on the master's worker thread
+**************************************************************************/
+static int report(Ring &ring, Transport &transport, MasterConfig config, double seconds, double rate, uint16_t threshold,
+	const std::string &name)
+{
+	const size_t nodes = ring.nodeCount();
+	const uint8_t REG = 5;		// CIRCUS_COUNTER
+	const uint64_t start = ring.cycles(3.0);	// after subscribing
+	const uint64_t end = start + ring.cycles(seconds);
+	std::vector<uint16_t> mirror(nodes);
+	std::vector<uint64_t> pendingSince(nodes);		// first change the mirror hasn't seen, 0 = none
+	uint64_t changes = 0, samples = 0, latencyTotal = 0, latencyMax = 0;
+	std::mt19937_64 rng(ring.config().seed);
+	std::exponential_distribution<double> gap(rate);
+
+	for (size_t n = 0; n < nodes; n++) {
+		for (double t = gap(rng); t < seconds; t += gap(rng)) {
+			ring.at(start + ring.cycles(t), [&, n] {
+				ring.cda(n).uintD[REG]++;
+				changes++;
+				if (!pendingSince[n]) pendingSince[n] = ring.now();
+			});
+		}
+	}
+	std::promise<void> done;
+	CircusMaster *running = nullptr;
+	uint64_t bytesAtStart = 0, bytesAtEnd = 0;
+	ring.at(start, [&] { bytesAtStart = running->stats().bytesSent; });
+	ring.at(end + ring.cycles(1.0), [&] {	// a second for the last reports
+		bytesAtEnd = running->stats().bytesSent;
+		done.set_value();
+	});
+
+	config.reportIntervalMs = config.reportIntervalMs ? config.reportIntervalMs : 20;
+	config.held = true;		// queue the setup in one go, the simulated time it takes doesn't depend on thread scheduling
+	config.onReport = [&](uint8_t nid, uint8_t reg, uint16_t value) {
+		size_t n = (nid >> 4) - 1;
+		if (reg != REG || n >= nodes) return;
+		mirror[n] = value;
+		if (pendingSince[n]) {
+			uint64_t latency = ring.now() - pendingSince[n];
+			latencyTotal += latency;
+			if (latency > latencyMax) latencyMax = latency;
+			samples++;
+			pendingSince[n] = value == ring.cda(n).uintD[REG] ? 0 : ring.now();
+		}
+	};
+	CircusMaster master(transport, config);
+	running = &master;
+	std::vector<std::future<uint16_t>> setup, values;
+	for (size_t n = 0; n < nodes; n++) {
+		setup.push_back(master.watch(ring.nid(n), 1 << REG));
+		if (threshold) setup.push_back(master.threshold(ring.nid(n), REG, threshold));
+		values.push_back(master.read(ring.nid(n), REG));
+	}
+	master.hold(false);
+	for (auto &f : setup) f.get();
+	for (size_t n = 0; n < nodes; n++)
+		mirror[n] = values[n].get();
+	done.get_future().wait();
+
+	MasterStats s = master.stats();
+	size_t stale = 0;
+	for (size_t n = 0; n < nodes; n++) {
+		int diff = (int16_t)(ring.cda(n).uintD[REG] - mirror[n]);
+		if (std::abs(diff) > (threshold ? threshold - 1 : 0)) stale++;
+	}
+	double bytesPerS = (bytesAtEnd - bytesAtStart) / (seconds + 1.0);
+	double pollPerS = nodes * 4 * 1000.0 / config.reportIntervalMs;
+	printf("changes:    %llu counts on %zu nodes in %.0f s, %llu reports, %llu damaged\n", (unsigned long long)changes,
+		nodes, seconds, (unsigned long long)s.reports, (unsigned long long)s.damagedReports);
+	printf("latency:    mean %.1f ms  max %.1f ms  (%llu samples), %zu mirrors off at the end\n",
+		samples ? ring.seconds(latencyTotal / samples) * 1e3 : 0.0, ring.seconds(latencyMax) * 1e3,
+		(unsigned long long)samples, stale);
+	printf("traffic:    %.0f bytes/s with a report frame every %u ms, polling %zu registers as often: %.0f bytes/s (%.1fx)\n",
+		bytesPerS, config.reportIntervalMs, nodes, pollPerS, bytesPerS > 0 ? pollPerS / bytesPerS : 0.0);
+	printf("BENCH %s reports=%llu latency_ms=%.1f bytes_s=%.0f poll_bytes_s=%.0f stale=%zu\n", name.c_str(),
+		(unsigned long long)s.reports, samples ? ring.seconds(latencyTotal / samples) * 1e3 : 0.0, bytesPerS,
+		pollPerS, stale);
+	return stale ? 1 : 0;
+}
+
+/*************************************************************************
+Function: mirror()
+Purpose:  read-through cache scenario, reads are issued from ring events
+          on the master's worker thread like the counter changes
+**************************************************************************/
+static int mirror(Ring &ring, Transport &transport, MasterConfig config, double seconds, double rate, double maxAgeMs,
+	const std::string &name)
+{
+	const size_t nodes = ring.nodeCount();
+	const uint8_t COUNTER_REG = 5;
+	const uint64_t end = ring.cycles(seconds);
+	std::mt19937_64 rng(ring.config().seed);
+	std::exponential_distribution<double> gap(rate);
+	std::uniform_int_distribution<size_t> pickNode(0, nodes - 1);
+	std::uniform_int_distribution<int> pickReg(1, 6);
+	uint64_t reads = 0, fromMemory = 0, stale = 0;
+	RegisterMirror *cache = nullptr;
+	std::vector<std::future<uint16_t>> waiting;
+
+	for (size_t n = 0; n < nodes; n++)
+		for (double t = 1.0; t < seconds; t += 1.0)
+			ring.at(ring.cycles(t), [&ring, n] { ring.cda(n).uintD[COUNTER_REG]++; });
+	for (double t = gap(rng); t < seconds; t += gap(rng)) {
+		size_t n = pickNode(rng);
+		uint8_t reg = (uint8_t)pickReg(rng);
+		ring.at(ring.cycles(t), [&, n, reg] {
+			std::future<uint16_t> f = cache->read(ring.nid(n), reg);
+			reads++;
+			if (f.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+				fromMemory++;
+				if (f.get() != ring.cda(n).uintD[reg]) stale++;
+			} else {
+				waiting.push_back(std::move(f));
+			}
+		});
+	}
+	std::promise<void> done;
+	ring.at(end + ring.cycles(1.0), [&] { done.set_value(); });
+
+	config.held = true;		// the ring's read events use cache, don't let them run before it's set
+	RegisterMirror m(transport, config, (uint32_t)(maxAgeMs * 8000 / MILLITIC_US_X8));
+	cache = &m;
+	m.master().hold(false);
+	done.get_future().wait();
+
+	MasterStats s = m.master().stats();
+	MirrorStats ms = m.stats();
+	printf("reads:      %llu in %.0f s, %llu from memory (%.1f%%), %llu of those behind the node\n",
+		(unsigned long long)reads, seconds, (unsigned long long)fromMemory, reads ? 100.0 * fromMemory / reads : 0.0,
+		(unsigned long long)stale);
+	printf("ring:       %llu frames, %.0f bytes/s instead of %.0f bytes/s, mirror updates %llu\n",
+		(unsigned long long)s.sent, s.bytesSent / seconds, reads * 4 / seconds, (unsigned long long)ms.updates);
+	printf("BENCH %s reads=%llu hit_rate=%.3f stale=%llu bytes_s=%.0f\n", name.c_str(), (unsigned long long)reads,
+		reads ? (double)fromMemory / reads : 0.0, (unsigned long long)stale, s.bytesSent / seconds);
+	return s.failed ? 1 : 0;
+}
+
+/*************************************************************************
+Function: meter()
+Purpose:  32 bit counter scenario, the counts run past 16 bits and every
+          read has to be one count, not halves of two
+**************************************************************************/
+static int meter(Ring &ring, Transport &transport, MasterConfig config, double seconds, double rate, double every,
+	const std::string &name)
+{
+	const size_t nodes = ring.nodeCount();
+	const uint8_t COUNT_REG = 5, RATE_REG = 4;		// circusnode-count.so
+	const double ticS = ring.seconds(1024ull * ring.config().milliTicCycles);
+	struct Reading {
+		uint32_t before, after;		// the node's count when the read went out and a second later
+		std::future<uint32_t> count;
+		std::future<uint16_t> perTic;
+	};
+	std::vector<std::vector<Reading>> readings(nodes);
+	std::mt19937_64 rng(ring.config().seed);
+	std::exponential_distribution<double> gap(rate);
+	CircusMaster *master = nullptr;
+
+	for (size_t n = 0; n < nodes; n++)
+		if (!ring.counter32(n))
+			throw std::runtime_error("meter: the node image has no COUNTER_32, use --image ./circusnode-count.so");
+	// every pulse schedules the next one, the queue stays short however many there are
+	std::function<void(size_t)> pulse = [&](size_t n) {
+		(*ring.counter32(n))++;
+		uint64_t next = ring.now() + ring.cycles(gap(rng));
+		if (next < ring.cycles(seconds)) ring.at(next, [&pulse, n] { pulse(n); });
+	};
+	for (size_t n = 0; n < nodes; n++)
+		ring.at(ring.cycles(gap(rng)), [&pulse, n] { pulse(n); });
+	for (double t = every; t < seconds; t += every) {
+		ring.at(ring.cycles(t), [&] {
+			for (size_t n = 0; n < nodes; n++) {
+				readings[n].push_back({*ring.counter32(n), 0, master->readCounter(ring.nid(n), COUNT_REG),
+					master->read(ring.nid(n), RATE_REG)});
+				size_t k = readings[n].size() - 1;
+				ring.at(ring.now() + ring.cycles(1.0), [&, n, k] { readings[n][k].after = *ring.counter32(n); });
+			}
+		});
+	}
+	std::promise<void> done;
+	ring.at(ring.cycles(seconds + 1.0), [&] { done.set_value(); });
+
+	config.held = true;		// same for master
+	CircusMaster m(transport, config);
+	master = &m;
+	m.hold(false);
+	done.get_future().wait();
+
+	uint64_t reads = 0, torn = 0, rateSamples = 0;
+	double perTicTotal = 0;
+	uint32_t largest = 0;
+	for (auto &node : readings) {
+		for (auto &r : node) {
+			uint32_t count = r.count.get();
+			uint16_t perTic = r.perTic.get();
+			reads++;
+			if (count < r.before || count > r.after) torn++;
+			if (r.before > (uint32_t)(rate * ticS)) {	// a whole Tic of pulses behind it
+				perTicTotal += perTic;
+				rateSamples++;
+			}
+			largest = std::max(largest, count);
+		}
+	}
+	MasterStats s = m.stats();
+	double measured = rateSamples ? perTicTotal / rateSamples / ticS : 0.0;
+	printf("counts:     %llu reads of %zu counters up to %u, %llu not between the count before and after\n",
+		(unsigned long long)reads, nodes, largest, (unsigned long long)torn);
+	printf("rate:       %.1f pulses/s from the pulses per Tic register, %.1f counted; 16 bits wrap every %.0f s\n",
+		measured, rate, 65536.0 / rate);
+	printf("ring:       %llu frames, %.0f bytes/s\n", (unsigned long long)s.sent, s.bytesSent / seconds);
+	printf("BENCH %s reads=%llu torn=%llu rate_pps=%.1f bytes_s=%.0f\n", name.c_str(), (unsigned long long)reads,
+		(unsigned long long)torn, measured, s.bytesSent / seconds);
+	return torn || s.failed ? 1 : 0;
+}
+
+/*************************************************************************
+Function: sweep()
+Purpose:  meter-reading sweep, CIRCUS_COUNTER of every node: one token a
+          lap, all the tokens at once, and gather frames
+**************************************************************************/
+static int sweep(Ring &ring, Transport &transport, MasterConfig config, unsigned sweeps, const std::string &name)
+{
+	const size_t nodes = ring.nodeCount();
+	const uint8_t COUNTER_REG = 5;
+	uint64_t wrong = 0;
+
+	for (size_t n = 0; n < nodes; n++)
+		ring.cda(n).uintD[COUNTER_REG] = (uint16_t)(1000 * (n + 1));
+	config.held = true;
+	CircusMaster m(transport, config);
+	// a sweep from the first frame queued to the last reply and the bytes it put on the ring, issue() lets
+	// the frames go and checks the values
+	auto timed = [&](const std::function<void()> &issue, double &ms, double &bytes) {
+		for (unsigned i = 0; i < sweeps; i++) {
+			MasterStats before = m.stats();
+			uint64_t start = transport.nowUs();
+			issue();
+			m.drain();
+			m.hold(true);
+			MasterStats after = m.stats();
+			ms += (after.lastReplyUs - start) / 1e3 / sweeps;
+			bytes += (double)(after.bytesSent - before.bytesSent) / sweeps;
+		}
+	};
+	double lapMs = 0, lapBytes = 0, tokenMs = 0, tokenBytes = 0, gatherMs = 0, gatherBytes = 0;
+	timed([&] {
+		m.hold(false);
+		for (size_t n = 0; n < nodes; n++)
+			if (m.read(ring.nid(n), COUNTER_REG).get() != ring.cda(n).uintD[COUNTER_REG]) wrong++;
+	}, lapMs, lapBytes);
+	timed([&] {
+		std::vector<std::future<uint16_t>> reads;
+		for (size_t n = 0; n < nodes; n++)
+			reads.push_back(m.read(ring.nid(n), COUNTER_REG));
+		m.hold(false);
+		for (size_t n = 0; n < nodes; n++)
+			if (reads[n].get() != ring.cda(n).uintD[COUNTER_REG]) wrong++;
+	}, tokenMs, tokenBytes);
+	timed([&] {
+		std::future<std::vector<uint16_t>> all = m.gather(COUNTER_REG, (uint8_t)nodes);
+		m.hold(false);
+		std::vector<uint16_t> v = all.get();
+		for (size_t n = 0; n < nodes; n++)
+			if (v[n] != ring.cda(n).uintD[COUNTER_REG]) wrong++;
+	}, gatherMs, gatherBytes);
+
+	// every node holds a frame until its last byte is in, so a gather's lap grows with its length
+	MasterStats s = m.stats();
+	printf("one a lap:  %zu tokens a sweep, %.1f ms and %.0f bytes\n", nodes, lapMs, lapBytes);
+	printf("at once:    %zu tokens a sweep, %.1f ms and %.0f bytes\n", nodes, tokenMs, tokenBytes);
+	printf("gather:     %d frame%s a sweep, %.1f ms and %.0f bytes\n", nodes > 8 ? 2 : 1, nodes > 8 ? "s" : "",
+		gatherMs, gatherBytes);
+	printf("BENCH %s sweeps=%u lap_ms=%.1f token_ms=%.1f gather_ms=%.1f token_bytes=%.0f gather_bytes=%.0f wrong=%llu\n",
+		name.c_str(), sweeps, lapMs, tokenMs, gatherMs, tokenBytes, gatherBytes, (unsigned long long)wrong);
+	return wrong || s.failed || gatherMs >= lapMs || gatherBytes >= tokenBytes ? 1 : 0;
+}
+
+/*************************************************************************
+Function: groupWrite()
+Purpose:  set one register of every node and know they all have it: a
+          broadcast token and a read of every node, or a group store
+          whose acks say which nodes need it again
+**************************************************************************/
+static int groupWrite(Ring &ring, Transport &transport, MasterConfig config, unsigned rounds, const std::string &name)
+{
+	const size_t nodes = ring.nodeCount();
+	const uint8_t REG = 3;
+	uint16_t members = 0;
+	uint64_t wrong = 0, resent = 0;
+
+	for (size_t n = 0; n < nodes; n++)
+		members |= (uint16_t)(1 << (ring.nid(n) >> 4));
+	config.held = true;
+	CircusMaster m(transport, config);
+	// one round from the first frame queued to the last reply and the bytes it put on the ring, write()
+	// lets the frames go and returns once every node is known to have value
+	auto timed = [&](const std::function<void(uint16_t)> &write, uint16_t base, double &ms, double &bytes) {
+		for (unsigned i = 0; i < rounds; i++) {
+			MasterStats before = m.stats();
+			uint64_t start = transport.nowUs();
+			write((uint16_t)(base + i));
+			m.drain();
+			m.hold(true);
+			MasterStats after = m.stats();
+			ms += (after.lastReplyUs - start) / 1e3 / rounds;
+			bytes += (double)(after.bytesSent - before.bytesSent) / rounds;
+			for (size_t n = 0; n < nodes; n++)
+				if (ring.cda(n).uintD[REG] != (uint16_t)(base + i)) wrong++;
+		}
+	};
+	double readMs = 0, readBytes = 0, groupMs = 0, groupBytes = 0;
+	timed([&](uint16_t value) {
+		for (int attempt = 0; attempt < 4; attempt++) {
+			if (attempt) resent++;
+			m.write(0, REG, value);
+			std::vector<std::future<uint16_t>> reads;
+			for (size_t n = 0; n < nodes; n++)
+				reads.push_back(m.read(ring.nid(n), REG));
+			m.hold(false);
+			bool missed = false;
+			for (auto &f : reads)
+				if (f.get() != value) missed = true;
+			if (!missed) break;
+			m.hold(true);
+		}
+	}, 1000, readMs, readBytes);
+	timed([&](uint16_t value) {
+		uint16_t left = members;
+		for (int attempt = 0; attempt < 4 && left; attempt++) {
+			if (attempt) resent++;
+			std::future<uint16_t> acked = m.writeGroup(left, REG, {value});
+			m.hold(false);
+			left &= (uint16_t)~acked.get();
+			m.hold(true);
+		}
+		m.hold(false);
+	}, 2000, groupMs, groupBytes);
+
+	MasterStats s = m.stats();
+	printf("read back:  broadcast token and %zu reads a round, %.1f ms and %.0f bytes\n", nodes, readMs, readBytes);
+	printf("group:      one acked group store a round, %.1f ms and %.0f bytes\n", groupMs, groupBytes);
+	printf("BENCH %s rounds=%u readback_ms=%.1f group_ms=%.1f readback_bytes=%.0f group_bytes=%.0f resent=%llu wrong=%llu\n",
+		name.c_str(), rounds, readMs, groupMs, readBytes, groupBytes, (unsigned long long)resent,
+		(unsigned long long)wrong);
+	return wrong || s.failed || groupBytes >= readBytes ? 1 : 0;
+}
+
+/*************************************************************************
+Function: toggle()
+Purpose:  the ringmaster flips a timer enable bit in register 0 of every
+          node while the nodes count their own status byte in its high
+          half: a get and a store a lap apart, then setBits()/clearBits()
+**************************************************************************/
+static int toggle(Ring &ring, Transport &transport, MasterConfig config, double seconds, double rate,
+	const std::string &name)
+{
+	const size_t nodes = ring.nodeCount();
+	std::mt19937_64 rng(ring.config().seed);
+	std::exponential_distribution<double> gap(rate);
+	std::vector<uint8_t> counted(nodes);		// the nodes' own updates, mod 256 like the byte
+	struct Snapshot {
+		std::vector<uint8_t> counted, status;
+		std::promise<void> taken;
+	} half, end;
+
+	for (size_t n = 0; n < nodes; n++) {
+		ring.cda(n).byteD[1] = 0;
+		for (double t = gap(rng); t < seconds; t += gap(rng))
+			ring.at(ring.cycles(t), [&, n] { ring.cda(n).byteD[1]++; counted[n]++; });
+	}
+	auto snapshot = [&](Snapshot &s) {
+		s.counted = counted;
+		for (size_t n = 0; n < nodes; n++) s.status.push_back((uint8_t)ring.cda(n).byteD[1]);
+		s.taken.set_value();
+	};
+	ring.at(ring.cycles(seconds / 2), [&] { snapshot(half); });
+	ring.at(ring.cycles(seconds + 1.0), [&] { snapshot(end); });
+
+	config.held = true;
+	CircusMaster m(transport, config);
+	m.hold(false);
+	bool on = false;
+	unsigned rounds[2] = {0, 0};
+	double ms[2] = {0, 0};
+	// one round flips the bit on every node, from the first frame to the last reply
+	auto round = [&](int rmw) {
+		on = !on;
+		uint64_t start = transport.nowUs();
+		if (!rmw) {
+			std::vector<std::future<uint16_t>> reads, writes;
+			for (size_t n = 0; n < nodes; n++) reads.push_back(m.read(ring.nid(n), 0));
+			for (size_t n = 0; n < nodes; n++)
+				writes.push_back(m.write(ring.nid(n), 0, (uint16_t)((reads[n].get() & ~1) | on)));
+			for (auto &f : writes) f.get();
+		} else {
+			std::vector<std::future<uint16_t>> ops;
+			for (size_t n = 0; n < nodes; n++)
+				ops.push_back(on ? m.setBits(ring.nid(n), 0, 1) : m.clearBits(ring.nid(n), 0, 1));
+			for (auto &f : ops) f.get();
+		}
+		ms[rmw] += (m.stats().lastReplyUs - start) / 1e3;
+		rounds[rmw]++;
+	};
+	while (transport.nowUs() < (uint64_t)((seconds / 2 - 0.5) * 1e6)) round(0);
+	half.taken.get_future().wait();
+	while (transport.nowUs() < (uint64_t)(seconds * 1e6)) round(1);
+	end.taken.get_future().wait();
+
+	unsigned lost[2] = {0, 0}, wrong = 0;
+	for (size_t n = 0; n < nodes; n++) {
+		lost[0] += (uint8_t)(half.counted[n] - half.status[n]);
+		lost[1] += (uint8_t)((end.counted[n] - half.counted[n]) - (end.status[n] - half.status[n]));
+		if ((ring.cda(n).byteD[0] & 1) != on) wrong++;
+	}
+	MasterStats s = m.stats();
+	printf("get+store:  %u rounds, %.1f ms each, %u of the nodes' own updates lost\n", rounds[0],
+		rounds[0] ? ms[0] / rounds[0] : 0.0, lost[0]);
+	printf("set/clear:  %u rounds, %.1f ms each, %u lost\n", rounds[1], rounds[1] ? ms[1] / rounds[1] : 0.0, lost[1]);
+	printf("BENCH %s rounds=%u store_ms=%.1f store_lost=%u rmw_ms=%.1f rmw_lost=%u wrong=%u\n", name.c_str(),
+		rounds[0] + rounds[1], rounds[0] ? ms[0] / rounds[0] : 0.0, lost[0], rounds[1] ? ms[1] / rounds[1] : 0.0,
+		lost[1], wrong);
+	return lost[1] || wrong || s.failed ? 1 : 0;
+}
+
+/*************************************************************************
+Function: pages()
+Purpose:  18 values of every node besides its registers (SimNode.c):
+          commands in _cmdStat answered in register 6, then read straight
+          from 3 register pages, a block frame each
+**************************************************************************/
+static int pages(Ring &ring, Transport &transport, MasterConfig config, unsigned rounds, const std::string &name)
+{
+	const size_t nodes = ring.nodeCount();
+	uint64_t wrong = 0;
+	// value k of a node, register k % 6 + 1 of page k / 6 + 1; page 2 is constants, the others say whose they are
+	auto expected = [&](size_t n, unsigned k) {
+		unsigned page = k / 6 + 1, reg = k % 6 + 1;
+		return (uint16_t)(page == 2 ? 0x20 | reg : ring.nid(n) << 8 | page << 4 | reg);
+	};
+
+	config.held = true;
+	CircusMaster m(transport, config);
+	for (size_t n = 0; n < nodes; n++) {		// page 1 is variables, fill them
+		std::vector<uint16_t> values;
+		for (unsigned k = 0; k < 6; k++) values.push_back(expected(n, k));
+		m.writePage(ring.nid(n), 1, 1, values);
+	}
+	m.selectPage(0, 0);		// the commands answer in the CDA's register 6
+	m.hold(false);
+	m.drain();
+	m.hold(true);
+	// one round from the first frame queued to the last reply and the bytes it put on the ring, issue()
+	// lets the frames go and checks the values
+	auto timed = [&](const std::function<void()> &issue, double &ms, double &bytes) {
+		for (unsigned i = 0; i < rounds; i++) {
+			MasterStats before = m.stats();
+			uint64_t start = transport.nowUs();
+			issue();
+			m.drain();
+			m.hold(true);
+			MasterStats after = m.stats();
+			ms += (after.lastReplyUs - start) / 1e3 / rounds;
+			bytes += (double)(after.bytesSent - before.bytesSent) / rounds;
+		}
+	};
+	double commandMs = 0, commandBytes = 0, pageMs = 0, pageBytes = 0;
+	timed([&] {
+		// newCmd and the value's number, the simulated nodes' loop() has answered before the read gets there
+		std::vector<std::future<uint16_t>> reads;
+		for (size_t n = 0; n < nodes; n++) {
+			for (unsigned k = 0; k < 18; k++) {
+				m.write(ring.nid(n), 0, (uint16_t)(k << 8 | 0x10));
+				reads.push_back(m.read(ring.nid(n), 6));
+			}
+		}
+		m.hold(false);
+		for (size_t i = 0; i < reads.size(); i++)
+			if (reads[i].get() != expected(i / 18, (unsigned)(i % 18))) wrong++;
+	}, commandMs, commandBytes);
+	timed([&] {
+		std::vector<std::future<std::vector<uint16_t>>> reads;
+		for (size_t n = 0; n < nodes; n++)
+			for (uint8_t page = 1; page <= 3; page++) reads.push_back(m.readPage(ring.nid(n), page));
+		m.hold(false);
+		for (size_t i = 0; i < reads.size(); i++) {
+			std::vector<uint16_t> v = reads[i].get();
+			for (unsigned r = 0; r < 6; r++)
+				if (v[r] != expected(i / 3, (unsigned)(i % 3 * 6 + r))) wrong++;
+		}
+	}, pageMs, pageBytes);
+
+	// back on the CDA, register 6 holds the last command's answer again
+	m.selectPage(0, 0);
+	m.hold(false);
+	for (size_t n = 0; n < nodes; n++)
+		if (m.read(ring.nid(n), 6).get() != expected(n, 17)) wrong++;
+
+	MasterStats s = m.stats();
+	printf("commands:   %zu stores and reads of register 6 a round, %.1f ms and %.0f bytes\n", 36 * nodes, commandMs,
+		commandBytes);
+	printf("pages:      %zu page selects and block frames a round, %.1f ms and %.0f bytes\n", 6 * nodes, pageMs,
+		pageBytes);
+	printf("BENCH %s rounds=%u command_ms=%.1f page_ms=%.1f command_bytes=%.0f page_bytes=%.0f wrong=%llu\n",
+		name.c_str(), rounds, commandMs, pageMs, commandBytes, pageBytes, (unsigned long long)wrong);
+	return wrong || s.failed || pageMs >= commandMs || pageBytes >= commandBytes ? 1 : 0;
+}
+
+/*************************************************************************
+Function: timeSync()
+Purpose:  time sync scenario, every node's Tic boundaries against the
+          ringmaster's Tics; the simulation starts at midnight
+**************************************************************************/
+static int timeSync(Ring &ring, Transport &transport, MasterConfig config, double hours, double perDay,
+	const std::string &name)
+{
+	const size_t nodes = ring.nodeCount();
+	const double ticS = 86400.0 / 65536, milliTicS = ticS / 1024;
+	const double every = 86400.0 / perDay, settle = 20.0;	// half a Tic slews in about 16 s
+	const double end = hours * 3600;
+	std::vector<double> hacks;
+	std::vector<std::future<int32_t>> lags;
+	std::vector<uint16_t> last(nodes);
+	std::map<uint16_t, std::pair<double, double>> trimmed;	// Tic: earliest and latest node
+	double untrimmed = 0, worst = 0;
+	uint64_t steps = 0;
+	CircusMaster *master = nullptr;
+
+	for (double t = 0; t < end; t += every) {
+		hacks.push_back(t);
+		if (t > 0)		// the first one is queued before the ring starts
+			ring.at(ring.cycles(t), [&] { lags.push_back(master->timeHack()); });
+	}
+	if (hacks.size() < 2)
+		throw std::runtime_error("clock: PERDAY too few for HOURS, it takes two frames to learn the drift");
+	ring.onTic = [&](size_t n, uint16_t tic) {
+		double t = ring.seconds(ring.now());
+		double off = std::remainder(t - tic * ticS, 86400.0);
+		if (t > 1 && tic != (uint16_t)(last[n] + 1))
+			steps++;
+		last[n] = tic;
+		if (t > hacks[1] + settle) {
+			worst = std::max(worst, std::fabs(off));
+			auto k = trimmed.emplace(tic, std::make_pair(off, off)).first;
+			k->second.first = std::min(k->second.first, off);
+			k->second.second = std::max(k->second.second, off);
+		} else if (t > settle) {
+			untrimmed = std::max(untrimmed, std::fabs(off));
+		}
+	};
+	std::promise<void> done;
+	ring.at(ring.cycles(end), [&] { done.set_value(); });
+
+	config.held = true;
+	CircusMaster m(transport, config);
+	master = &m;
+	lags.push_back(m.timeHack());
+	m.hold(false);
+	done.get_future().wait();
+
+	double spread = 0, ppm = 0;
+	for (auto &k : trimmed) spread = std::max(spread, k.second.second - k.second.first);
+	for (size_t n = 0; n < nodes; n++) ppm = std::max(ppm, std::fabs(ring.clockPpm(n)));
+	int32_t lag = 0;
+	for (auto &f : lags) {
+		try {
+			int32_t l = f.get();
+			if (std::abs(l) > std::abs(lag)) lag = l;
+		} catch (const CircusError &) {}
+	}
+	printf("clock:      %zu nodes, crystals off by up to %.1f ppm, %zu EXT_TIME frames in %.1f h, one every %.1f h\n",
+		nodes, ppm, hacks.size(), hours, every / 3600);
+	printf("untrimmed:  Tics up to %.1f ms off the ringmaster's before the drift was known\n", untrimmed * 1e3);
+	printf("trimmed:    up to %.3f ms off, %.3f ms between nodes (a milliTic is %.3f ms), %llu Tics stepped\n",
+		worst * 1e3, spread * 1e3, milliTicS * 1e3, (unsigned long long)steps);
+	printf("ring:       the frames came back at most %d us off their delay\n", lag);
+	printf("BENCH %s max_ms=%.3f spread_ms=%.3f untrimmed_ms=%.1f steps=%llu lag_us=%d\n", name.c_str(), worst * 1e3,
+		spread * 1e3, untrimmed * 1e3, (unsigned long long)steps, lag);
+	return worst > milliTicS || steps || m.stats().failed ? 1 : 0;
+}
+
+/*************************************************************************
+Function: events()
+Purpose:  scheduled events scenario, every node gets a full set of events
+          a few minutes before midnight; counts their runs against what
+          the Tics that went by call for
+**************************************************************************/
+static int events(Ring &ring, Transport &transport, MasterConfig config, double minutes, const std::string &name)
+{
+	const size_t nodes = ring.nodeCount();
+	const double ticS = 86400.0 / 65536;
+	const uint16_t start = (uint16_t)-300, day = 20000;		// 6.6 minutes before midnight on a Monday
+	const double ticsRun = minutes * 60 / ticS;
+	const uint16_t every[] = {37, 50, 64, 91, 128, 150, 200, 311};
+	struct Planned {
+		uint8_t action;
+		std::vector<double> runs;		// Tics after start
+	};
+	std::vector<Planned> plan;
+	std::vector<std::vector<std::future<uint16_t>>> replies(nodes);
+	std::vector<std::future<uint16_t>> extra, removed;
+
+	for (size_t k = 0; k < 8; k++) {
+		Planned p{1, {}};
+		for (double x = 10 + k; x < ticsRun + 3; x += every[k]) p.runs.push_back(x);
+		plan.push_back(p);
+	}
+	plan.push_back({2, {20}});				// once, later today
+	plan.push_back({2, {100}});
+	plan.push_back({2, {}});				// once, its Tic has gone by today
+	plan.push_back({2, {330}});				// once, after midnight
+	plan.push_back({3, {360}});				// tomorrow only
+	plan.push_back({3, {}});				// today only, next week
+	plan.push_back({3, {380}});				// every day, gone by today
+	for (size_t n = 0; n < nodes; n++)
+		ring.cda(n).uintD[7] = start;
+
+	config.held = true;
+	CircusMaster m(transport, config);
+	std::vector<std::future<uint16_t>> setup;
+	m.setDay(0, day);
+	for (size_t n = 0; n < nodes; n++) {
+		uint8_t nid = ring.nid(n);
+		for (uint8_t k = 0; k < 8; k++)
+			replies[n].push_back(m.scheduleEvery(nid, (uint8_t)(1 + k), 1, (uint16_t)(start + 10 + k), every[k]));
+		replies[n].push_back(m.scheduleOnce(nid, 9, 2, (uint16_t)(start + 20)));
+		replies[n].push_back(m.scheduleOnce(nid, 10, 2, (uint16_t)(start + 100)));
+		replies[n].push_back(m.scheduleOnce(nid, 11, 2, (uint16_t)(start - 50)));
+		replies[n].push_back(m.scheduleOnce(nid, 12, 2, 30));
+		replies[n].push_back(m.scheduleDays(nid, 13, 3, 60, 1 << (day + 1) % 7));
+		replies[n].push_back(m.scheduleDays(nid, 14, 3, 70, 1 << day % 7));
+		replies[n].push_back(m.scheduleDays(nid, 15, 3, 80, 0x7f));
+		replies[n].push_back(m.scheduleOnce(nid, 16, 4, (uint16_t)(start + 40)));
+		extra.push_back(m.scheduleOnce(nid, 17, 4, (uint16_t)(start + 40)));		// one too many
+		removed.push_back(m.unschedule(nid, 16));
+	}
+	std::promise<void> done;
+	ring.at(ring.cycles(minutes * 60), [&] { done.set_value(); });
+	m.hold(false);
+	done.get_future().wait();
+
+	uint64_t refused = 0, setupFailed = 0, ran = 0, wrong = 0, removedRan = 0;
+	for (size_t n = 0; n < nodes; n++) {
+		for (auto &f : replies[n]) {
+			try { f.get(); } catch (const CircusError &) { setupFailed++; }
+		}
+		try { extra[n].get(); } catch (const CircusError &e) { refused += e.code == CircusError::Refused; }
+		try { removed[n].get(); } catch (const CircusError &) { setupFailed++; }
+	}
+	if (setupFailed == nodes * (replies[0].size() + 1))
+		throw std::runtime_error("events: the nodes have no EVENTS, use --image ./circusnode-events.so");
+	// the nodes' Tics started anywhere in a Tic, so the runs 2 Tics either side of the end may or may not be in
+	size_t expected = 0, maybe = 0;
+	for (uint8_t action = 1; action <= 3; action++) {
+		size_t lo = 0, hi = 0;
+		for (const Planned &p : plan)
+			for (double x : p.runs)
+				if (p.action == action) {
+					lo += x < ticsRun - 2;
+					hi += x < ticsRun + 2;
+				}
+		for (size_t n = 0; n < nodes; n++) {
+			uint16_t got = (uint16_t)(ring.cda(n).uintD[action] - ((ring.nid(n) << 8) | action));
+			ran += got;
+			wrong += got < lo || got > hi;
+		}
+		expected += lo * nodes;
+		maybe += (hi - lo) * nodes;
+	}
+	for (size_t n = 0; n < nodes; n++)
+		removedRan += (uint16_t)(ring.cda(n).uintD[4] - ((ring.nid(n) << 8) | 4));
+
+	printf("events:     %zu nodes, 16 events each, %.0f Tics (%.0f min) from 300 Tics before midnight\n", nodes, ticsRun,
+		minutes);
+	printf("ran:        %llu runs, %zu expected (%zu more at the end may be), %llu counts off, %llu removed ones ran\n",
+		(unsigned long long)ran, expected, maybe, (unsigned long long)wrong, (unsigned long long)removedRan);
+	printf("full:       %llu of %zu full nodes refused a 17th event, %llu setup frames failed\n",
+		(unsigned long long)refused, nodes, (unsigned long long)setupFailed);
+	printf("BENCH %s ran=%llu expected=%zu wrong=%llu refused=%llu\n", name.c_str(), (unsigned long long)ran, expected,
+		(unsigned long long)(wrong + removedRan), (unsigned long long)refused);
+	return wrong || removedRan || setupFailed || refused != nodes ? 1 : 0;
+}
+
+/*************************************************************************
+Function: cableCheck()
+Purpose:  random reads go round a ring with one bad link, then every
+          node's diagnostics page shows which node receives the errors
+**************************************************************************/
+static int cableCheck(Ring &ring, Transport &transport, MasterConfig config, double seconds, double rate,
+	const std::string &name)
+{
+	const size_t nodes = ring.nodeCount();
+	std::mt19937_64 rng(ring.config().seed);
+	std::exponential_distribution<double> gap(rate);
+	std::uniform_int_distribution<size_t> pickNode(0, nodes - 1);
+	std::uniform_int_distribution<int> pickReg(1, 6);
+	CircusMaster *master = nullptr;
+	std::vector<std::future<uint16_t>> reads;
+
+	for (double t = gap(rng); t < seconds; t += gap(rng)) {
+		size_t n = pickNode(rng);
+		uint8_t reg = (uint8_t)pickReg(rng);
+		ring.at(ring.cycles(t), [&, n, reg] { reads.push_back(master->read(ring.nid(n), reg)); });
+	}
+	std::promise<void> done;
+	ring.at(ring.cycles(seconds + 1.0), [&] { done.set_value(); });
+
+	config.held = true;
+	config.retries = 10;		// the scrape has to get through the bad link as well
+	CircusMaster m(transport, config);
+	master = &m;
+	m.hold(false);
+	done.get_future().wait();
+	uint64_t failed = 0;
+	for (auto &f : reads) {
+		try { f.get(); } catch (const CircusError &) { failed++; }
+	}
+
+	// a bad link shows up at the node after it, the frames it mangled are answered there with an error;
+	// cut-through tokens go on before their crc is checked and count again further on, so look for the
+	// node whose count jumps over the one before it
+	std::vector<NodeHealth> pages;
+	for (size_t n = 0; n < nodes; n++)
+		pages.push_back(m.health(ring.nid(n), true).get());
+	printf("node  frames  answered  crc  framing  overruns  resyncs  latency_us  overflows\n");
+	size_t worst = 0;
+	int32_t worstJump = 0;
+	uint32_t errors = 0, before = 0;
+	for (size_t n = 0; n < nodes; n++) {
+		const NodeHealth &h = pages[n];
+		uint32_t e = (uint32_t)h.crcErrors + h.framingErrors + h.resyncs;
+		printf("0x%02X  %6u  %8u  %3u  %7u  %8u  %7u  %10u  %9u\n", ring.nid(n), h.frames, h.answered, h.crcErrors,
+			h.framingErrors, h.overruns, h.resyncs, h.maxLatencyUs, h.overflows);
+		errors += e;
+		if ((int32_t)(e - before) > worstJump) {
+			worstJump = (int32_t)(e - before);
+			worst = n;
+		}
+		before = e;
+	}
+	int found = worstJump ? (int)worst : -1;
+	if (found < 0)
+		printf("links:      no errors at the nodes\n");
+	else if (!found)
+		printf("links:      %u errors, most on the link from the ringmaster into 0x%02X\n", errors, ring.nid(0));
+	else
+		printf("links:      %u errors, most on the link from 0x%02X into 0x%02X\n", errors, ring.nid(worst - 1),
+			ring.nid(worst));
+	printf("BENCH %s reads=%zu failed=%llu errors=%u bad_link=%d found=%d\n", name.c_str(), reads.size(),
+		(unsigned long long)failed, errors, ring.config().badLink, found);
+	return failed || (ring.config().badLink >= 0 && found != ring.config().badLink) ? 1 : 0;
+}
+
+/*************************************************************************
+Function: jitter()
+Purpose:  random reads keep the ring busy, EXT_LATENCY frames read the
+          nodes' newest samples round robin; how long the nodes hold a
+          frame and how much that moves
+**************************************************************************/
+static int jitter(Ring &ring, Transport &transport, MasterConfig config, double seconds, double rate,
+	const std::string &name)
+{
+	const size_t nodes = ring.nodeCount();
+	const double every = 0.1;		// one EXT_LATENCY frame every 100 ms
+	std::mt19937_64 rng(ring.config().seed);
+	std::exponential_distribution<double> gap(rate);
+	std::uniform_int_distribution<size_t> pickNode(0, nodes - 1);
+	std::uniform_int_distribution<int> pickReg(1, 6);
+	CircusMaster *master = nullptr;
+	std::vector<std::future<uint16_t>> reads;
+	std::vector<std::pair<size_t, std::future<LatencySamples>>> polls;
+
+	for (double t = gap(rng); t < seconds; t += gap(rng)) {
+		size_t n = pickNode(rng);
+		uint8_t reg = (uint8_t)pickReg(rng);
+		ring.at(ring.cycles(t), [&, n, reg] { reads.push_back(master->read(ring.nid(n), reg)); });
+	}
+	size_t k = 0;
+	for (double t = every; t < seconds; t += every, k++) {
+		size_t n = k % nodes;
+		ring.at(ring.cycles(t), [&, n] { polls.emplace_back(n, master->latency(ring.nid(n))); });
+	}
+	std::promise<void> done;
+	ring.at(ring.cycles(seconds + 1.0), [&] { done.set_value(); });
+
+	config.held = true;
+	CircusMaster m(transport, config);
+	master = &m;
+	m.hold(false);
+	done.get_future().wait();
+
+	uint64_t failed = 0, refused = 0, over = 0;
+	std::vector<uint16_t> hold, rx;
+	std::vector<uint16_t> nodeMax(nodes);
+	for (auto &p : polls) {
+		try {
+			for (const LatencySample &x : p.second.get().samples) {
+				hold.push_back(x.holdUs);
+				rx.push_back(x.rxUs);
+				nodeMax[p.first] = std::max(nodeMax[p.first], x.holdUs);
+			}
+		} catch (const CircusError &e) {
+			refused += e.code == CircusError::Refused;
+			failed++;
+		}
+	}
+	if (!polls.empty() && refused == polls.size())
+		throw std::runtime_error("jitter: the nodes keep no LATENCY_SAMPLES");
+	for (auto &f : reads) {
+		try { f.get(); } catch (const CircusError &) { failed++; }
+	}
+	// the samples are some of the frames the node forwarded, _maxForwardLatency saw all of them
+	for (size_t n = 0; n < nodes; n++)
+		over += ring.maxForwardLatencyUs(n) >= 0 && nodeMax[n] > ring.maxForwardLatencyUs(n);
+	if (hold.empty()) throw std::runtime_error("jitter: no samples");
+	std::sort(hold.begin(), hold.end());
+	std::sort(rx.begin(), rx.end());
+	auto at = [](const std::vector<uint16_t> &v, double q) { return v[(size_t)(q * (v.size() - 1))]; };
+
+	printf("samples:    %zu from %zu EXT_LATENCY frames, %zu reads in %.0f s\n", hold.size(), polls.size(), reads.size(),
+		seconds);
+	printf("hold:       p50 %u us, p99 %u us, max %u us, jitter (p99 - p50) %u us\n", at(hold, 0.5), at(hold, 0.99),
+		hold.back(), at(hold, 0.99) - at(hold, 0.5));
+	printf("rx:         p50 %u us, max %u us\n", at(rx, 0.5), rx.back());
+	const unsigned width = hold.back() / 8 + 1;
+	std::vector<size_t> bins(8);
+	for (uint16_t h : hold) bins[h / width]++;
+	for (size_t b = 0; b < bins.size(); b++)
+		printf("  %5u us  %6zu %s\n", (unsigned)(b * width), bins[b],
+			std::string(bins[b] * 50 / hold.size(), '#').c_str());
+	printf("BENCH %s samples=%zu p50_us=%u p99_us=%u max_us=%u jitter_us=%u over=%llu\n", name.c_str(), hold.size(),
+		at(hold, 0.5), at(hold, 0.99), hold.back(), at(hold, 0.99) - at(hold, 0.5), (unsigned long long)over);
+	return failed || over ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	SimConfig sim;
+	MasterConfig config;
+	std::vector<std::string> ports;
+	std::string name = "master";
+	unsigned rings = 1;
+	unsigned bridges = 0;
+	size_t ring = 0;
+	bool useSim = false;
+	double loopUs = 100, minTps = 0;
+	uint32_t switchTo = 0;
+	int i = 1;
+
+	for (; i < argc && !strncmp(argv[i], "--", 2); i++) {
+		const char *a = argv[i];
+		if (!strcmp(a, "--sim")) { useSim = true; continue; }
+		if (i + 1 >= argc) usage();
+		const char *v = argv[++i];
+		if (!strcmp(a, "--port")) ports.push_back(v);
+		else if (!strcmp(a, "--ring")) ring = (size_t)atoi(v);
+		else if (!strcmp(a, "--rings")) rings = (unsigned)atoi(v);
+		else if (!strcmp(a, "--baud")) sim.baud = (uint32_t)atol(v);
+		else if (!strcmp(a, "--window")) config.window = (size_t)atoi(v);
+		else if (!strcmp(a, "--retries")) config.retries = (unsigned)atoi(v);
+		else if (!strcmp(a, "--timeout-ms")) config.timeoutMs = (uint32_t)atol(v);
+		else if (!strcmp(a, "--resync-bytes")) config.resyncBytes = (uint32_t)atol(v);
+		else if (!strcmp(a, "--switch-to")) switchTo = (uint32_t)atol(v);
+		else if (!strcmp(a, "--bridges")) bridges = (unsigned)atoi(v);
+		else if (!strcmp(a, "--sub-nodes")) sim.subNodes = (uint8_t)atoi(v);
+		else if (!strcmp(a, "--nodes")) sim.nodes = (uint8_t)atoi(v);
+		else if (!strcmp(a, "--ber")) sim.ber = atof(v);
+		else if (!strcmp(a, "--bad-link")) sim.badLink = atoi(v);
+		else if (!strcmp(a, "--bad-ber")) sim.badLinkBer = atof(v);
+		else if (!strcmp(a, "--loop-us")) loopUs = atof(v);
+		else if (!strcmp(a, "--seed")) sim.seed = (uint32_t)atol(v);
+		else if (!strcmp(a, "--image")) sim.image = v;
+		else if (!strcmp(a, "--ppm")) sim.clockPpm = atof(v);
+		else if (!strcmp(a, "--name")) name = v;
+		else if (!strcmp(a, "--min-tps")) minTps = atof(v);
+		else if (!strcmp(a, "--report-ms")) config.reportIntervalMs = (uint32_t)atol(v);
+		else usage();
+	}
+	if (i >= argc || useSim == !ports.empty() || !rings || sim.badLink >= (int)sim.nodes) usage();
+	std::vector<const char *> cmd(argv + i, argv + argc);
+	sim.loopCycles = (uint32_t)(loopUs * sim.fCpu / 1e6);
+	if (!sim.loopCycles) sim.loopCycles = 1;
+	if (useSim) config.nodes = sim.nodes;
+	sim.bridges = (uint8_t)bridges;
+	sim.ticRuns = !strcmp(cmd[0], "clock") || !strcmp(cmd[0], "events");
+
+	try {
+		std::vector<std::unique_ptr<Ring>> sims;
+		std::vector<std::unique_ptr<Transport>> transports;
+		std::vector<Transport *> hubRings;
+		if (useSim) {
+			for (unsigned r = 0; r < rings; r++) {
+				SimConfig c = sim;
+				c.seed = sim.seed + r;
+				sims.emplace_back(new Ring(c));
+				transports.emplace_back(new SimTransport(*sims.back()));
+			}
+		} else {
+			for (const std::string &port : ports)
+				transports.emplace_back(new SerialTransport(port, sim.baud));
+		}
+		for (auto &t : transports) hubRings.push_back(t.get());
+		if (!strcmp(cmd[0], "report") && useSim && (cmd.size() == 3 || cmd.size() == 4))
+			return report(*sims[0], *transports[0], config, atof(cmd[1]), atof(cmd[2]),
+				(uint16_t)(cmd.size() == 4 ? num(cmd[3]) : 0), name);
+		if (!strcmp(cmd[0], "mirror") && useSim && cmd.size() == 4)
+			return mirror(*sims[0], *transports[0], config, atof(cmd[1]), atof(cmd[2]), atof(cmd[3]), name);
+		if (!strcmp(cmd[0], "meter") && useSim && cmd.size() == 4)
+			return meter(*sims[0], *transports[0], config, atof(cmd[1]), atof(cmd[2]), atof(cmd[3]), name);
+		if (!strcmp(cmd[0], "sweep") && useSim && cmd.size() == 2)
+			return sweep(*sims[0], *transports[0], config, num(cmd[1]), name);
+		if (!strcmp(cmd[0], "groupwrite") && useSim && cmd.size() == 2)
+			return groupWrite(*sims[0], *transports[0], config, num(cmd[1]), name);
+		if (!strcmp(cmd[0], "toggle") && useSim && cmd.size() == 3)
+			return toggle(*sims[0], *transports[0], config, atof(cmd[1]), atof(cmd[2]), name);
+		if (!strcmp(cmd[0], "pages") && useSim && cmd.size() == 2)
+			return pages(*sims[0], *transports[0], config, num(cmd[1]), name);
+		if (!strcmp(cmd[0], "clock") && useSim && cmd.size() == 3)
+			return timeSync(*sims[0], *transports[0], config, atof(cmd[1]), atof(cmd[2]), name);
+		if (!strcmp(cmd[0], "events") && useSim && cmd.size() == 2)
+			return events(*sims[0], *transports[0], config, atof(cmd[1]), name);
+		if (!strcmp(cmd[0], "cablecheck") && useSim && cmd.size() == 3)
+			return cableCheck(*sims[0], *transports[0], config, atof(cmd[1]), atof(cmd[2]), name);
+		if (!strcmp(cmd[0], "jitter") && useSim && cmd.size() == 3)
+			return jitter(*sims[0], *transports[0], config, atof(cmd[1]), atof(cmd[2]), name);
+		config.held = useSim;		// a simulated ring runs as soon as it isn't held, don't let it run ahead of the command
+		CircusHub hub(hubRings, config);
+		std::vector<unsigned> nodes(hubRings.size(), config.nodes);
+		for (size_t r = 0; r < hubRings.size(); r++) {
+			for (unsigned b = 0; b < bridges; b++) {
+				hub.addBridge(r, (uint8_t)((b + 1) << 4));
+				nodes.push_back(sim.subNodes);
+			}
+		}
+		if (strcmp(cmd[0], "poll") || switchTo) hub.hold(false);
+		if (switchTo) {
+			hub.changeBaud(switchTo);
+			printf("baud:       ring moved from %u to %u\n", sim.baud, switchTo);
+		}
+
+		if (!strcmp(cmd[0], "read") && cmd.size() == 3) {
+			printf("%u\n", hub.read(ring, (uint8_t)num(cmd[1]), (uint8_t)num(cmd[2])).get());
+		} else if (!strcmp(cmd[0], "write") && cmd.size() == 4) {
+			printf("%u\n", hub.write(ring, (uint8_t)num(cmd[1]), (uint8_t)num(cmd[2]), (uint16_t)num(cmd[3])).get());
+		} else if (!strcmp(cmd[0], "baud") && cmd.size() == 2) {
+			hub.changeBaud((uint32_t)atol(cmd[1]));
+			printf("baud:       ring moved to %s\n", cmd[1]);
+		} else if (!strcmp(cmd[0], "readblock") && cmd.size() == 4) {
+			for (uint16_t v : hub.readBlock(ring, (uint8_t)num(cmd[1]), (uint8_t)num(cmd[2]), (uint8_t)num(cmd[3])).get())
+				printf("%u\n", v);
+		} else if (!strcmp(cmd[0], "readcounter") && cmd.size() == 3) {
+			printf("%u\n", hub.readCounter(ring, (uint8_t)num(cmd[1]), (uint8_t)num(cmd[2])).get());
+		} else if (!strcmp(cmd[0], "gather") && (cmd.size() == 2 || cmd.size() == 3)) {
+			for (uint16_t v : hub.gather(ring, (uint8_t)num(cmd[1]), (uint8_t)(cmd.size() == 3 ? num(cmd[2]) : 15)).get())
+				printf("%u\n", v);
+		} else if (!strcmp(cmd[0], "setbits") && cmd.size() == 4) {
+			printf("%u\n", hub.setBits(ring, (uint8_t)num(cmd[1]), (uint8_t)num(cmd[2]), (uint16_t)num(cmd[3])).get());
+		} else if (!strcmp(cmd[0], "clearbits") && cmd.size() == 4) {
+			printf("%u\n", hub.clearBits(ring, (uint8_t)num(cmd[1]), (uint8_t)num(cmd[2]), (uint16_t)num(cmd[3])).get());
+		} else if (!strcmp(cmd[0], "add") && cmd.size() == 4) {
+			printf("%u\n", hub.add(ring, (uint8_t)num(cmd[1]), (uint8_t)num(cmd[2]), (int16_t)strtol(cmd[3], 0, 0)).get());
+		} else if (!strcmp(cmd[0], "cas") && cmd.size() == 5) {
+			printf("%u\n", hub.compareAndSwap(ring, (uint8_t)num(cmd[1]), (uint8_t)num(cmd[2]), (uint16_t)num(cmd[3]),
+				(uint16_t)num(cmd[4])).get());
+		} else if (!strcmp(cmd[0], "page") && cmd.size() == 3) {
+			printf("%u\n", hub.selectPage(ring, (uint8_t)num(cmd[1]), (uint8_t)num(cmd[2])).get());
+		} else if (!strcmp(cmd[0], "readpage") && cmd.size() == 3) {
+			for (uint16_t v : hub.readPage(ring, (uint8_t)num(cmd[1]), (uint8_t)num(cmd[2])).get())
+				printf("%u\n", v);
+		} else if (!strcmp(cmd[0], "writegroup") && cmd.size() >= 4) {
+			std::vector<uint16_t> values;
+			for (size_t k = 3; k < cmd.size(); k++) values.push_back((uint16_t)num(cmd[k]));
+			printf("0x%04X\n", hub.writeGroup(ring, (uint16_t)num(cmd[1]), (uint8_t)num(cmd[2]), values).get());
+		} else if (!strcmp(cmd[0], "timehack") && cmd.size() == 1) {
+			for (auto &f : hub.timeHack())
+				printf("%d\n", f.get());
+		} else if (!strcmp(cmd[0], "schedule") && (cmd.size() == 5 || cmd.size() == 7)) {
+			uint8_t nid = (uint8_t)num(cmd[1]), id = (uint8_t)num(cmd[2]), action = (uint8_t)num(cmd[3]);
+			uint16_t tic = (uint16_t)num(cmd[4]);
+			std::future<uint16_t> f;
+			if (cmd.size() == 5) f = hub.scheduleOnce(ring, nid, id, action, tic);
+			else if (!strcmp(cmd[5], "every")) f = hub.scheduleEvery(ring, nid, id, action, tic, (uint16_t)num(cmd[6]));
+			else if (!strcmp(cmd[5], "days")) f = hub.scheduleDays(ring, nid, id, action, tic, (uint8_t)num(cmd[6]));
+			else usage();
+			printf("%u\n", f.get());
+		} else if (!strcmp(cmd[0], "unschedule") && cmd.size() == 3) {
+			printf("%u\n", hub.unschedule(ring, (uint8_t)num(cmd[1]), (uint8_t)num(cmd[2])).get());
+		} else if (!strcmp(cmd[0], "day") && (cmd.size() == 2 || cmd.size() == 3)) {
+			uint16_t day = cmd.size() == 3 ? (uint16_t)num(cmd[2]) : CircusMaster::today();
+			hub.setDay(ring, (uint8_t)num(cmd[1]), day).get();
+			printf("%u\n", day);
+		} else if (!strcmp(cmd[0], "health") && (cmd.size() == 2 || (cmd.size() == 3 && !strcmp(cmd[2], "clear")))) {
+			NodeHealth h = hub.health(ring, (uint8_t)num(cmd[1]), cmd.size() == 3).get();
+			printf("frames %u answered %u crc %u framing %u overruns %u resyncs %u latency_us %u overflows %u\n",
+				h.frames, h.answered, h.crcErrors, h.framingErrors, h.overruns, h.resyncs, h.maxLatencyUs, h.overflows);
+		} else if (!strcmp(cmd[0], "latency") && (cmd.size() == 2 || cmd.size() == 3)) {
+			LatencySamples got = hub.latency(ring, (uint8_t)num(cmd[1]), (uint8_t)(cmd.size() == 3 ? num(cmd[2]) : 3)).get();
+			printf("%u\n", got.taken);
+			for (const LatencySample &x : got.samples)
+				printf("%u %u\n", x.rxUs, x.holdUs);
+		} else if (!strcmp(cmd[0], "poll") && (cmd.size() == 2 || cmd.size() == 3)) {
+			return poll(hub, transports, nodes, num(cmd[1]), cmd.size() == 3 ? num(cmd[2]) : 0, name, minTps);
+		} else {
+			usage();
+		}
+	} catch (const std::exception &e) {
+		fprintf(stderr, "circusmaster: %s\n", e.what());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,79 @@
+/*************************************************************************
+Title:    nodecheck - the CircusNode example linked with Circus.c
+File:     extras/host/NodeCheck.cpp
+Software: Linux, g++ (C++17)
+License:  GNU General Public License Version 2.0
+
+    examples/CircusNode/CircusNode.ino is compiled to an object and linked
+    with the host Circus.c and SimSilicon.c, so a symbol CIRCUS_NODE
+    defines twice or leaves out fails the build.  Then, as an Arduino core
+    would, this
+      1. calls initVariant() (circus_init(), the node's setupTic()) and
+         setup(): UBRR from the sketch's BAUD, Timer1 from CircusNode
+      2. calls the node's Timer1 compare ISR for 2 Tics while pin 5 goes
+         high 16 times with one-sample glitches in between: Tic and the
+         debounced count in CDA[5]
+      3. calls the INT0 handler the node attached: the count in CDA[4]
+      4. runs yield() with timers 1 and 2 due in turn: pump pin 7 on, off
+
+    Exits 1 if anything differs.
+*************************************************************************/
+
+#include <stdio.h>
+
+#include <Arduino.h>
+#include <Circus.h>
+
+extern "C" uint8_t _simPins[20];
+extern "C" void (*_simInterrupts[2])(void);
+
+void setup();
+
+static int failures;
+
+static void check(bool ok, const char *what)
+{
+	if (!ok) {
+		printf("nodecheck: %s\n", what);
+		failures++;
+	}
+}
+
+int main()
+{
+	PIND = 0;
+	initVariant();
+	setup();
+	check(UBRR0H == 0 && UBRR0L == 103, "UBRR isn't 103 for BAUD 9600");
+	check(TCCR1B && OCR1A == 20598 && (TIMSK1 & _BV(OCIE1A)), "Timer1 isn't running the milliTic");
+	check(_simInterrupts[0] != 0, "no INT0 handler attached");
+
+	uint16_t start = Tic;
+	for (int i = 0; i < 2048; i++) {
+		bool high = (i / 64) & 1;
+		bool glitch = !high && i % 64 >= 32 && i % 64 < 36;	// one debounce sample, DebounceTime 16
+		PIND = high || glitch ? 0x20 : 0;
+		TIMER1_COMPA_vect();
+	}
+	uint16_t tics = Tic - start;
+	uint16_t counted = CDA.uintD[5];
+	check(tics == 2, "2048 milliTics aren't 2 Tics");
+	check(counted == 16, "pin 5 didn't count 16 debounced rises");
+
+	for (int i = 0; i < 5; i++)
+		_simInterrupts[0]();
+	check(CDA.uintD[4] == 5, "INT0 didn't count into CDA[4]");
+
+	CDA.byteD[0] |= 0x03;		// timers 1 and 2 enabled
+	CDA.uintD[1] = Tic;
+	CDA.uintD[2] = Tic + 10;
+	_timersRun = 0x03;
+	yield();
+	check(_simPins[7] == HIGH && _timersRun == 0x02, "timer 1 didn't switch the pump on");
+	Tic += 10;
+	yield();
+	check(_simPins[7] == LOW && _timersRun == 0, "timer 2 didn't switch the pump off");
+
+	printf("BENCH nodecheck tics=%u counted=%u int0=%u failures=%d\n", tics, counted, CDA.uintD[4], failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,292 @@
+/*************************************************************************
+Title:    ringsim - Circus ring throughput benchmark
+File:     extras/host/RingSim.cpp
+Software: Linux, g++ (C++17)
+License:  GNU General Public License Version 2.0
+
+USAGE:
+    ringsim [options]
+      --nodes N        nodes in the ring, 1-15 (15)
+      --baud B         baud rate (9600)
+      --tokens N       tokens to send (1000)
+      --block N        read N registers per request with EXT_BLOCK frames, 0 = plain tokens (0)
+      --window N       max tokens in flight, 0 = no limit (1)
+      --gap-ms X       idle time the ringmaster leaves between tokens (0)
+      --ber X          bit error rate on every link (0)
+      --loop-us X      length of one loop() pass on the nodes (100)
+      --jitter-us X    random extra time per loop() pass (0)
+      --proc-us X      Circus() processing time (50)
+      --seed N         random seed (1)
+      --image PATH     node library to load (./circusnode.so)
+      --name S         scenario name printed on the BENCH line
+      --min-tps X      exit 1 if fewer than X valid replies per second
+
+    The ringmaster reads all 8 registers of every node round robin.  Replies
+    are matched to requests by their address byte (byte 1 of a block frame),
+    throughput counts registers read, so plain and block runs compare
+    directly; with --block every request counts as N tokens.  A request that never
+    comes back within --timeout-ms (3 lap times) is counted as lost.
+    Every request ends up as exactly one of ok, wrong (data mismatch),
+    crc_err or buf_err (error reported by a node) or lost; "bad" counts
+    frames that arrived at the ringmaster corrupted or unmatched.
+
+    Scenarios from Notes_Token_and_Registers.txt:
+      single token      --window 1
+      spaced tokens     --window 0 --gap-ms 4.2
+      back to back      --window 0
+*************************************************************************/
+
+#include "CircusSim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <deque>
+#include <stdexcept>
+#include <string>
+
+using namespace circus;
+
+struct Request {
+	uint8_t frame[FRAME_MAX];
+	uint8_t len;
+	uint16_t expect[8];
+	uint64_t sentAt;
+
+	uint8_t addr() const { return len > 4 ? frame[1] : frame[2]; }	// the byte errors are reported in
+};
+
+struct Results {
+	uint64_t sent = 0, ok = 0, wrongData = 0, crcErr = 0, bufErr = 0, bad = 0, lost = 0;
+	uint64_t rttTotal = 0, rttMax = 0, answered = 0;	// round trips are per request
+	uint64_t firstSent = 0, lastReply = 0;
+};
+
+static void usage()
+{
+	fprintf(stderr, "usage: ringsim [--nodes N] [--baud B] [--tokens N] [--block N] [--window N] [--gap-ms X] [--ber X]\n"
+		"               [--loop-us X] [--jitter-us X] [--proc-us X] [--timeout-ms X] [--seed N]\n"
+		"               [--image PATH] [--name S] [--min-tps X]\n");
+	exit(2);
+}
+
+int main(int argc, char **argv)
+{
+	SimConfig config;
+	uint64_t tokens = 1000;
+	size_t window = 1;
+	unsigned block = 0;
+	double gapMs = 0, loopUs = 100, jitterUs = 0, procUs = 50, timeoutMs = 0, minTps = 0;
+	std::string name = "ring";
+
+	for (int i = 1; i < argc; i++) {
+		const char *a = argv[i];
+		if (i + 1 >= argc) usage();
+		const char *v = argv[++i];
+		if (!strcmp(a, "--nodes")) config.nodes = (uint8_t)atoi(v);
+		else if (!strcmp(a, "--baud")) config.baud = (uint32_t)atol(v);
+		else if (!strcmp(a, "--tokens")) tokens = strtoull(v, 0, 10);
+		else if (!strcmp(a, "--block")) block = (unsigned)atoi(v);
+		else if (!strcmp(a, "--window")) window = (size_t)atoi(v);
+		else if (!strcmp(a, "--gap-ms")) gapMs = atof(v);
+		else if (!strcmp(a, "--ber")) config.ber = atof(v);
+		else if (!strcmp(a, "--loop-us")) loopUs = atof(v);
+		else if (!strcmp(a, "--jitter-us")) jitterUs = atof(v);
+		else if (!strcmp(a, "--proc-us")) procUs = atof(v);
+		else if (!strcmp(a, "--timeout-ms")) timeoutMs = atof(v);
+		else if (!strcmp(a, "--seed")) config.seed = (uint32_t)atol(v);
+		else if (!strcmp(a, "--image")) config.image = v;
+		else if (!strcmp(a, "--name")) name = v;
+		else if (!strcmp(a, "--min-tps")) minTps = atof(v);
+		else usage();
+	}
+	config.loopCycles = (uint32_t)(loopUs * config.fCpu / 1e6);
+	config.loopJitter = (uint32_t)(jitterUs * config.fCpu / 1e6);
+	config.procCycles = (uint32_t)(procUs * config.fCpu / 1e6);
+	if (!config.loopCycles) config.loopCycles = 1;
+	if (block > 8) usage();
+	const unsigned perRequest = block ? block : 1;
+
+	try {
+		Ring ring(config);
+		const size_t nodes = ring.nodeCount();
+		const uint64_t tokenCycles = (block ? 4 + 2 * block : 4) * ring.byteCycles(config.baud);
+		const uint64_t gap = ring.cycles(gapMs / 1000);
+		const uint64_t lap = (nodes + 1) * (tokenCycles + config.procCycles + config.loopCycles);
+		const uint64_t timeout = timeoutMs > 0 ? ring.cycles(timeoutMs / 1000) : 3 * lap;
+
+		std::deque<Request> pending;
+		Results res;
+		uint64_t next = 0;			// next request to build
+		uint64_t nextSendAt = 0;	// earliest start of the next token, keeps the gap
+		bool resync = false;		// a frame went missing, let the ring run dry so every node sees an idle line
+		const uint64_t resyncIdle = ring.cycles(0.010);	// enough for IDLE_BYTES 0 nodes too, DEADTIME (5) milliTics
+		uint8_t rx[FRAME_MAX];
+		size_t rxIdx = 0, rxLen = 4;
+		uint64_t rxLast = 0;
+
+		auto resolve = [&](size_t k, const uint8_t *reply) {
+			// everything queued ahead of a matched request went missing on the ring
+			res.lost += k;
+			if (k) resync = true;
+			pending.erase(pending.begin(), pending.begin() + k);
+			Request &r = pending.front();
+			uint8_t addr = r.addr();
+			uint8_t got = r.len > 4 ? reply[1] : reply[2];
+			if (got == addr) {
+				for (unsigned i = 0; i < perRequest; i++) {
+					const uint8_t *d = r.len > 4 ? &reply[3 + 2 * i] : reply;
+					if ((uint16_t)(d[0] | d[1] << 8) == r.expect[i]) res.ok++;
+					else res.wrongData++;
+				}
+			} else if (((got ^ addr) & 0x0f) == CRC_ERROR) {
+				res.crcErr += perRequest;
+			} else {
+				res.bufErr += perRequest;
+			}
+			uint64_t rtt = ring.now() - r.sentAt;
+			res.rttTotal += rtt;
+			res.answered++;
+			if (rtt > res.rttMax) res.rttMax = rtt;
+			res.lastReply = ring.now();
+			pending.pop_front();
+		};
+
+		ring.onMasterRx = [&](uint8_t data, bool framingError) {
+			uint64_t now = ring.now();
+			if (now - rxLast > 3 * ring.byteCycles(config.baud)) {
+				rxIdx = 0;		// idle line, start of a new token
+				rxLen = 4;
+			}
+			rxLast = now;
+			rx[rxIdx++] = data;
+			if (rxIdx == 3) rxLen = frameLength(rx[0], rx[1], rx[2]);
+			if (rxIdx < rxLen) return;
+			size_t len = rxLen;
+			rxIdx = 0;
+			rxLen = 4;
+			uint8_t crc = ring.frameCrc(rx, len);
+			if (crc != rx[len - 1] || framingError) {
+				res.bad++;		// the request it belonged to times out as lost
+				resync = true;
+				return;
+			}
+			for (size_t k = 0; k < pending.size(); k++) {
+				if (pending[k].len != len) continue;
+				uint8_t addr = pending[k].addr();
+				uint8_t got = len > 4 ? rx[1] : rx[2];
+				uint8_t code = (got ^ addr) & 0x0f;
+				if (got == addr || code == CRC_ERROR || code == BUFFER_ERROR) {
+					resolve(k, rx);
+					return;
+				}
+			}
+			res.bad++;
+			resync = true;
+		};
+
+		std::function<void()> pump = [&]() {
+			uint64_t now = ring.now();
+			while (!pending.empty() && now - pending.front().sentAt > timeout) {
+				res.lost += perRequest;
+				pending.pop_front();
+				resync = true;
+			}
+			if (resync && pending.empty()) {
+				// a corrupted length byte leaves nodes framing at the wrong offset until their input goes idle
+				resync = false;
+				nextSendAt = std::max(nextSendAt, now + resyncIdle);
+			}
+			if (next < tokens && ring.masterTxIdle() && !resync && now >= nextSendAt && (!window || pending.size() < window)) {
+				Request r;
+				uint64_t request = next / perRequest;
+				uint8_t node = (uint8_t)(request % nodes);
+				uint8_t reg = (uint8_t)((request / nodes * perRequest) % 8);
+				uint8_t nid = ring.nid(node);
+				memset(r.frame, 0, sizeof r.frame);
+				if (block) {
+					r.len = (uint8_t)(4 + 2 * block);
+					r.frame[0] = (uint8_t)block;
+					r.frame[1] = (uint8_t)(nid | reg);
+					r.frame[2] = EXT_BLOCK;
+				} else {
+					r.len = 4;
+					r.frame[2] = (uint8_t)(nid | reg);
+				}
+				r.frame[r.len - 1] = ring.frameCrc(r.frame, r.len);
+				for (unsigned i = 0; i < perRequest; i++)
+					r.expect[i] = (uint16_t)(nid << 8 | ((reg + i) & 7));
+				r.sentAt = now;
+				if (!res.sent) res.firstSent = now;
+				pending.push_back(r);
+				ring.masterSend(r.frame, r.len);
+				res.sent += perRequest;
+				next += perRequest;
+				nextSendAt = now + tokenCycles + gap;
+			}
+			if (next < tokens || !pending.empty()) {
+				uint64_t wake = ring.byteCycles(config.baud) / 4;
+				ring.at(now + wake, pump);
+			}
+		};
+		ring.at(0, pump);
+		while (ring.step()) {
+			if (next >= tokens && pending.empty()) break;
+		}
+
+		double elapsed = ring.seconds(res.lastReply - res.firstSent);
+		double tps = elapsed > 0 ? res.ok / elapsed : 0;
+
+		HopStats hop;
+		uint64_t framing = 0, overruns = 0;
+		for (size_t n = 0; n < nodes; n++) {
+			const HopStats &h = ring.hopStats(n);
+			hop.tokens += h.tokens;
+			hop.totalCycles += h.totalCycles;
+			if (h.maxCycles > hop.maxCycles) hop.maxCycles = h.maxCycles;
+			framing += h.framingErrors;
+			overruns += h.overruns;
+		}
+		double baudErr = (ring.nodeBaud(0) / config.baud - 1.0) * 100;
+		int32_t worstForward = -1;
+		size_t worstNode = 0;
+		for (size_t n = 0; n < nodes; n++) {
+			if (ring.maxForwardLatencyUs(n) > worstForward) {
+				worstForward = ring.maxForwardLatencyUs(n);
+				worstNode = n;
+			}
+		}
+
+		printf("ring:       1 ringmaster + %zu nodes, %u baud (node UBRR %u, %+.2f%%), window %zu, gap %.2f ms, ber %g\n",
+			nodes, config.baud, ring.nodeUbrr(0), baudErr, window, gapMs, config.ber);
+		printf("tokens:     sent %llu  ok %llu  wrong %llu  crc_err %llu  buf_err %llu  bad %llu  lost %llu\n",
+			(unsigned long long)res.sent, (unsigned long long)res.ok, (unsigned long long)res.wrongData,
+			(unsigned long long)res.crcErr, (unsigned long long)res.bufErr, (unsigned long long)res.bad,
+			(unsigned long long)res.lost);
+		printf("throughput: %.1f tok/s over %.2f s\n", tps, elapsed);
+		printf("round trip: mean %.2f ms  max %.2f ms\n",
+			res.answered ? ring.seconds(res.rttTotal / res.answered) * 1e3 : 0.0, ring.seconds(res.rttMax) * 1e3);
+		printf("per hop:    mean %.2f ms  max %.2f ms  (%llu samples)\n",
+			hop.tokens ? ring.seconds(hop.totalCycles / hop.tokens) * 1e3 : 0.0, ring.seconds(hop.maxCycles) * 1e3,
+			(unsigned long long)hop.tokens);
+		if (worstForward >= 0)
+			printf("forward:    worst last byte in to first byte out %.2f ms (NID 0x%02X)\n",
+				worstForward / 1e3, ring.nid(worstNode));
+		printf("link:       framing %llu  overrun %llu\n", (unsigned long long)framing, (unsigned long long)overruns);
+		printf("BENCH %s tok_s=%.1f rtt_ms=%.2f hop_ms=%.2f error_rate=%.4f\n", name.c_str(), tps,
+			res.answered ? ring.seconds(res.rttTotal / res.answered) * 1e3 : 0.0,
+			hop.tokens ? ring.seconds(hop.totalCycles / hop.tokens) * 1e3 : 0.0,
+			res.sent ? (double)(res.sent - res.ok) / res.sent : 0.0);
+
+		if (minTps > 0 && tps < minTps) {
+			fprintf(stderr, "%s: %.1f tok/s is below the baseline of %.1f\n", name.c_str(), tps, minTps);
+			return 1;
+		}
+	} catch (const std::exception &e) {
+		fprintf(stderr, "ringsim: %s\n", e.what());
+		return 2;
+	}
+	return 0;
+}
@@ -0,0 +1,106 @@
+/*************************************************************************
+Title:    Simulated Circus node
+File:     extras/host/SimNode.c
+Software: Linux, gcc
+License:  GNU General Public License Version 2.0
+
+    Plays the part of a user's sketch for one node.  It is linked together
+    with the real Circus.c and the AVR silicon in SimSilicon.c into
+    circusnode.so; the simulator loads one private copy of that library per
+    node so every node gets its own Token, CDA, indices and registers.
+
+    The simulator pokes the node through the sim*() entry points below and
+    the ISR symbols exported by Circus.c (USART_RX_vect, USART_UDRE_vect).
+*************************************************************************/
+
+#include <Arduino.h>
+
+// Circus.h is not included here: it declares the sketch constants below as
+// const, they are left writable so the simulator can assign them after loading
+void circusMilliTic(void);
+extern volatile uint16_t _milliTicReload;
+extern volatile uint16_t CDA[8];		// Circus_Data_Array, seen as its registers
+
+uint8_t NID = 0x10;
+uint32_t BAUD = 9600;
+uint8_t DEBOUNCE_TIME = 0;
+uint8_t DEBOUNCE_PIN = 0;
+uint8_t DEBOUNCE_PULLUP = 0;
+uint8_t TIMERS = 0;
+void (*TIMER_1)(uint8_t);
+void (*TIMER_2)(uint8_t);
+void (*TIMER_3)(uint8_t);
+void (*TIMER_4)(uint8_t);
+
+volatile uint8_t _timersRun;
+
+uint8_t _simTicRuns;		// 1 = count Tic like CTic.c, off keeps register 7 as the simulator set it
+static uint16_t mTic;
+
+void setupTic(void) { /* Tic timer is driven by simMilliTic() */ }
+
+/*************************************************************************
+Function: simMilliTic()
+Purpose:  the part of the CTic.c Timer1 compare ISR that Circus depends on
+Returns:  the compare value for the next milliTic
+**************************************************************************/
+uint16_t simMilliTic(void)
+{
+	if (_simTicRuns && !(++mTic & 0x03ff))
+		CDA[7]++;		// Tic
+	circusMilliTic();
+	return _milliTicReload;
+}
+
+/*************************************************************************
+Function: circusEvent()
+Purpose:  the sketch's actions for EVENTS, action n counts runs in register
+          n so the simulator can see them
+**************************************************************************/
+void circusEvent(uint8_t action)
+{
+	if (action >= 1 && action <= 6)
+		CDA[action]++;
+}
+
+#if PAGES
+/*************************************************************************
+Pages for the pages scenario, as a sketch maps them (Circus.h PAGES):
+page 1 variables, page 2 constants, page 3 on a getter.  Circus_Page is
+declared again, Circus.h isn't included here
+**************************************************************************/
+typedef struct {
+	uint8_t kind;
+	union {
+		volatile uint16_t *ram;
+		const uint16_t *progmem;
+		uint16_t (*getter)(uint8_t page, uint8_t reg);
+	} at;
+} Circus_Page;
+
+static volatile uint16_t Levels[6];
+static const uint16_t Limits[6] PROGMEM = {0x21, 0x22, 0x23, 0x24, 0x25, 0x26};
+
+static uint16_t pageGetter(uint8_t page, uint8_t reg)
+{
+	return NID << 8 | page << 4 | reg;
+}
+
+const Circus_Page PAGE_MAP[] = {{0, {.ram = Levels}}, {1, {.progmem = Limits}}, {2, {.getter = pageGetter}}};
+
+/*************************************************************************
+Function: nodeControl()
+Purpose:  the same 18 values the way a node without pages hands them out:
+          a store to register 0 with newCmd set and the value's number
+          (0 - 17) in _cmdStat puts it in register 6 and sets newStat
+**************************************************************************/
+void nodeControl(uint8_t target)
+{
+	uint8_t k = CDA[0] >> 8;
+
+	if ((target & 0x0f) != 0x08 || !(CDA[0] & 0x10) || k >= 18)
+		return;
+	CDA[6] = k < 6 ? Levels[k] : k < 12 ? pgm_read_word(&Limits[k - 6]) : pageGetter(3, k - 11);
+	CDA[0] = (CDA[0] & ~0x10) | 0x20;
+}
+#endif
@@ -0,0 +1,49 @@
+/*************************************************************************
+Title:    Simulated AVR silicon and Arduino core
+File:     extras/host/SimSilicon.c
+Software: Linux, gcc
+License:  GNU General Public License Version 2.0
+
+    The registers and Arduino calls hal/Arduino.h declares, for the node
+    images (with SimNode.c) and for nodecheck (with the CircusNode example).
+    Pins only remember what was written to them; attachInterrupt() keeps
+    the handler so a test can call it.
+*************************************************************************/
+
+#include <Arduino.h>
+
+volatile uint8_t UCSR0A;
+volatile uint8_t UCSR0B;
+volatile uint8_t UCSR0C;
+volatile uint8_t UBRR0H;
+volatile uint8_t UBRR0L;
+volatile uint8_t SREG;
+volatile uint16_t _simUdr;
+volatile uint8_t UCSR1A, UCSR1B, UCSR1C, UBRR1H, UBRR1L;
+volatile uint8_t UCSR2A, UCSR2B, UCSR2C, UBRR2H, UBRR2L;
+volatile uint8_t UCSR3A, UCSR3B, UCSR3C, UBRR3H, UBRR3L;
+volatile uint16_t _simUdr1, _simUdr2, _simUdr3;
+volatile uint8_t PIND, TCCR1A, TCCR1B, TIMSK1;
+volatile uint16_t TCNT1, OCR1A;
+uint64_t _simCycles;		// simulated CPU clock, set before every call into the node
+uint8_t _simPins[20];		// last digitalWrite() of every pin
+void (*_simInterrupts[2])(void);	// attachInterrupt() handlers of INT0 and INT1
+
+unsigned long micros(void)
+{
+	return (unsigned long)(_simCycles / (F_CPU / 1000000UL));
+}
+
+void pinMode(uint8_t pin, uint8_t mode) { /* nothing to set up */ }
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+	if (pin < 20)
+		_simPins[pin] = value;
+}
+
+void attachInterrupt(uint8_t interrupt, void (*isr)(void), int mode)
+{
+	if (interrupt < 2)
+		_simInterrupts[interrupt] = isr;
+}
@@ -0,0 +1,58 @@
+/*************************************************************************
+Title:    SimTransport - CircusMaster on a simulated ring
+File:     extras/host/SimTransport.h
+Software: Linux, g++ (C++17)
+License:  GNU General Public License Version 2.0
+
+DESCRIPTION:
+    Plugs a circus::Ring (CircusSim.h) in as the ringmaster's serial port.
+    Time is simulated time: read() runs the ring until a byte comes back
+    or waitUs have passed on the ring's clock, so timeouts and throughput
+    come out as they would on the wire.  Only the CircusMaster worker
+    thread may call it.
+*************************************************************************/
+
+#pragma once
+
+#include <deque>
+
+#include "CircusMaster.h"
+#include "CircusSim.h"
+
+namespace circus {
+
+class SimTransport : public Transport {
+public:
+	explicit SimTransport(Ring &ring) : _ring(ring)
+	{
+		_ring.onMasterRx = [this](uint8_t data, bool framingError) {
+			_rx.push_back(framingError ? (uint8_t)~data : data);	// a framing error garbles the byte
+		};
+	}
+
+	void write(const uint8_t *data, size_t len) override { _ring.masterSend(data, len); }
+
+	size_t read(uint8_t *buf, size_t len, uint32_t waitUs) override
+	{
+		uint64_t until = _ring.now() + _ring.cycles(waitUs / 1e6);
+		while (_rx.empty() && _ring.now() < until && _ring.step())
+			;
+		size_t n = 0;
+		while (n < len && !_rx.empty()) {
+			buf[n++] = _rx.front();
+			_rx.pop_front();
+		}
+		return n;
+	}
+
+	uint64_t nowUs() override { return (uint64_t)(_ring.seconds(_ring.now()) * 1e6); }
+	uint32_t baud() const override { return _ring.masterBaud(); }
+	void setBaud(uint32_t baud) override { _ring.setMasterBaud(baud); }
+	bool simulated() const override { return true; }
+
+private:
+	Ring &_ring;
+	std::deque<uint8_t> _rx;
+};
+
+} // namespace circus
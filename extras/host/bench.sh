@@ -0,0 +1,18 @@
+#!/bin/sh
+# Runs every scenario in the baseline file through ringsim and fails if any
+# of them drops below its recorded minimum throughput.
+#   usage: bench.sh [baseline file]
+
+baseline=${1:-bench_baseline.txt}
+status=0
+
+while read -r name min args; do
+	[ -n "$name" ] || continue
+	# shellcheck disable=SC2086
+	out=$(./ringsim --name "$name" --min-tps "$min" $args) || status=1
+	echo "$out" | grep '^BENCH'
+done <<EOF
+$(sed -e 's/#.*//' "$baseline")
+EOF
+
+exit $status
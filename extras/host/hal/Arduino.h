@@ -0,0 +1,115 @@
+/*************************************************************************
+Title:    Host stand-in for <Arduino.h>
+File:     extras/host/hal/Arduino.h
+Software: Linux, gcc
+License:  GNU General Public License Version 2.0
+
+    Lets Circus.c compile unmodified on Linux for the ring simulator.
+    Only what the node code actually touches is provided: the USART0
+    registers and bit names (ATmega328P numbering, USART1-3 as on the
+    ATmega2560 for CIRCUS_RINGS > 1), ISR(), _BV(), cli()/sei(), PROGMEM
+    and the handful of Arduino/digitalWriteFast calls made from circus_init(),
+    plus declarations of what CircusNode.h needs for `make nodecheck`;
+    SimSilicon.c defines them.
+
+    UDR0 is modelled as a 16 bit cell so the simulator can tell a write from
+    a read: before calling an ISR the simulator loads 0x100 | rx byte, reading
+    it into a uint8_t yields the received byte, and any value < 0x100 found
+    afterwards is a byte the node wrote for transmission.
+*************************************************************************/
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef F_CPU
+#define F_CPU 16000000UL
+#endif
+
+#define _BV(bit) (1 << (bit))
+#ifdef __cplusplus
+#define ISR(vector) extern "C" void vector(void)		// as avr/interrupt.h, the vector's own name from a sketch too
+#else
+#define ISR(vector) void vector(void)
+#endif
+
+// UCSR0A
+#define RXC0	7
+#define TXC0	6
+#define UDRE0	5
+#define FE0		4
+#define DOR0	3
+#define UPE0	2
+#define U2X0	1
+#define MPCM0	0
+// UCSR0B
+#define RXCIE0	7
+#define TXCIE0	6
+#define UDRIE0	5
+#define RXEN0	4
+#define TXEN0	3
+#define UCSZ02	2
+// UCSR0C
+#define UCSZ01	2
+#define UCSZ00	1
+
+extern volatile uint8_t UCSR0A;
+extern volatile uint8_t UCSR0B;
+extern volatile uint8_t UCSR0C;
+extern volatile uint8_t UBRR0H;
+extern volatile uint8_t UBRR0L;
+extern volatile uint8_t SREG;
+extern volatile uint16_t _simUdr;
+#define UDR0 _simUdr
+
+// further rings, same layout as USART0
+extern volatile uint8_t UCSR1A, UCSR1B, UCSR1C, UBRR1H, UBRR1L;
+extern volatile uint8_t UCSR2A, UCSR2B, UCSR2C, UBRR2H, UBRR2L;
+extern volatile uint8_t UCSR3A, UCSR3B, UCSR3C, UBRR3H, UBRR3L;
+extern volatile uint16_t _simUdr1, _simUdr2, _simUdr3;
+#define UDR1 _simUdr1
+#define UDR2 _simUdr2
+#define UDR3 _simUdr3
+
+#define cli() (SREG &= ~0x80)
+#define sei() (SREG |= 0x80)
+
+// <avr/pgmspace.h>, flash is just memory here
+#define PROGMEM
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define LOW 0
+#define HIGH 1
+
+#define pinModeFast(pin, mode) ((void)(pin), (void)(mode))
+#define digitalWriteFast(pin, value) ((void)(pin), (void)(value))
+
+// Timer1, PORTD and the Arduino pin calls CircusNode.h uses, declared so the example sketch compiles
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+#define WGM12	3
+#define CS10	0
+#define OCIE1A	1
+extern volatile uint8_t PIND, TCCR1A, TCCR1B, TIMSK1;
+extern volatile uint16_t TCNT1, OCR1A;
+void TIMER1_COMPA_vect(void);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+void attachInterrupt(uint8_t interrupt, void (*isr)(void), int mode);
+
+void setupTic(void);
+void initVariant(void);
+void yield(void);
+unsigned long micros(void);
+
+#ifdef __cplusplus
+}
+#endif